@@ -0,0 +1,704 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Benchmarks
+ *
+ * @section DESCRIPTION
+ *
+ * Times the numerical kernels one call at a time and whole integrations one
+ * step at a time. Every case is warmed up, then sized to run for about
+ * BENCH_TARGET seconds, and the best of BENCH_REPEAT runs is reported.
+ *
+ * Usage: bench [-j] [-l label] [filter]
+ *   -j        JSON instead of CSV
+ *   -l label  tag every result, e.g. with a version
+ *   filter    only run cases whose name contains this
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include "../libsim_types.h"
+#include "../libsim.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "../math/runge-kutta.h"
+#include "../math/dormand-prince.h"
+#include "../math/dormand-prince-853.h"
+#include "../math/interpolation.h"
+#include "../math/table.h"
+#include "../physics/physics.h"
+#include "../physics/gravity.h"
+#include "../physics/aero.h"
+#include "../physics/thrust.h"
+#include "../physics/atmosphere.h"
+#include "../physics/kernels.h"
+#include "../utils/coord.h"
+#include "../utils/sink.h"
+#include "../utils/columns.h"
+
+/// Seconds each timed run should take
+#define BENCH_TARGET 0.2
+/// Timed runs per case, the fastest is kept
+#define BENCH_REPEAT 5
+
+/**
+ * Run a case n times, return how many units (calls or steps) were done
+ */
+typedef long (*bench_fn)(long n);
+
+typedef struct {
+	const char *name;
+	const char *unit;
+	bench_fn fn;
+} bench_case;
+
+// Results go here so the compiler cannot drop the work
+static volatile double sink_value;
+
+// Shared inputs, set up once by setup()
+static sim_context ctx;
+static rocket vehicle;
+static state launch;
+static double y0[NEQ], dydx0[NEQ], yscale[NEQ];
+static double work[RK_WORK_SIZE(NEQ)];
+static double spline_x[64], spline_y[64], spline_y2[64], spline_coef[TABLE_COEF_SIZE(64)];
+static table1d spline_table;
+static double motor_t[51], motor_m[51];
+static state_history flight;
+static state_columns flight_columns;
+static double *flight_out;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Kernels
+ */
+static long bench_rkck(long n)
+{
+	double yout[NEQ], yerr[NEQ];
+	long i;
+	for (i=0;i<n;i++)
+	{
+		rkck(y0, dydx0, 0, 0.01, yout, yerr, NEQ, work, deriv, &ctx);
+		sink_value = yout[0];
+	}
+	return n;
+}
+
+static long bench_rkqc(long n)
+{
+	double y[NEQ], dydx[NEQ], x, hdid, hnext;
+	rk_control control;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		memcpy(y, y0, sizeof(y));
+		memcpy(dydx, dydx0, sizeof(dydx));
+		x = 0;
+		rk_control_init(&control);
+		rkqc(y, dydx, &x, 0.01, 1.0, yscale, &hdid, &hnext, &control, NEQ, work, deriv, &ctx);
+		sink_value = y[0];
+	}
+	return n;
+}
+
+static long bench_rkqc_kernel(long n)
+{
+	double y[NEQ], dydx[NEQ], x, hdid, hnext;
+	rk_control control;
+	const sim_kernel *k = kernel_find(&ctx);
+	long i;
+	for (i=0;i<n;i++)
+	{
+		memcpy(y, y0, sizeof(y));
+		memcpy(dydx, dydx0, sizeof(dydx));
+		x = 0;
+		rk_control_init(&control);
+		k->method.step(y, dydx, &x, 0.01, 1.0, yscale, &hdid, &hnext, &control, NEQ, work, k->deriv, &ctx);
+		sink_value = y[0];
+	}
+	return n;
+}
+
+static long bench_rkdp(long n)
+{
+	double y[NEQ], dydx[NEQ], x, hdid, hnext;
+	rk_control control;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		memcpy(y, y0, sizeof(y));
+		memcpy(dydx, dydx0, sizeof(dydx));
+		x = 0;
+		rk_control_init(&control);
+		rkdp(y, dydx, &x, 0.01, 1.0, yscale, &hdid, &hnext, &control, NEQ, work, deriv, &ctx);
+		sink_value = y[0];
+	}
+	return n;
+}
+
+static long bench_rkdp853(long n)
+{
+	double y[NEQ], dydx[NEQ], x, hdid, hnext;
+	rk_control control;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		memcpy(y, y0, sizeof(y));
+		memcpy(dydx, dydx0, sizeof(dydx));
+		x = 0;
+		rk_control_init(&control);
+		rkdp853(y, dydx, &x, 0.01, 1.0, yscale, &hdid, &hnext, &control, NEQ, work, deriv, &ctx);
+		sink_value = y[0];
+	}
+	return n;
+}
+
+static long bench_rk4(long n)
+{
+	double y[NEQ];
+	long i;
+	for (i=0;i<n;i++)
+	{
+		memcpy(y, y0, sizeof(y));
+		rk4(y, dydx0, 0, NEQ, 0.01, work, deriv, &ctx);
+		sink_value = y[0];
+	}
+	return n;
+}
+
+static long bench_deriv(long n)
+{
+	double dydx[NEQ];
+	long i;
+	memcpy(dydx, dydx0, sizeof(dydx));
+	for (i=0;i<n;i++)
+	{
+		deriv(y0, dydx, (i & 1023) * 0.001, &ctx);
+		sink_value = dydx[RK_V];
+	}
+	return n;
+}
+
+static long bench_physics(long n)
+{
+	rk_state ds;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		physics(RK_CSTATE(y0), (i & 1023) * 0.001, &ctx, &ds);
+		sink_value = ds.v.v.i;
+	}
+	return n;
+}
+
+static long bench_gravity_sphere(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+	{
+		vec f = {{0, 0, 0}};
+		gravity_sphere(RK_CSTATE(y0), &ctx, &f);
+		sink_value = f.v.i;
+	}
+	return n;
+}
+
+static long bench_gravity_j2(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+	{
+		vec f = {{0, 0, 0}};
+		gravity_j2(RK_CSTATE(y0), &ctx, &f);
+		sink_value = f.v.i;
+	}
+	return n;
+}
+
+static long bench_gravity_harmonic(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+	{
+		vec f = {{0, 0, 0}};
+		gravity_harmonic(RK_CSTATE(y0), &ctx, &f);
+		sink_value = f.v.i;
+	}
+	return n;
+}
+
+static long bench_drag(long n)
+{
+	long i;
+	atmosphere air = atmosphere_at(1000);
+	for (i=0;i<n;i++)
+	{
+		vec f = {{0, 0, 0}};
+		drag(RK_CSTATE(y0), &air, &ctx, &f);
+		sink_value = f.v.i;
+	}
+	return n;
+}
+
+static long bench_atmosphere(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+		sink_value = atmosphere_at((i & 1023) * 80.0).density;
+	return n;
+}
+
+static long bench_ECEF2GEO(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+		sink_value = ECEF2GEO(launch.x).v.k;
+	return n;
+}
+
+static long bench_GEO2ECEF(long n)
+{
+	vec geo = ECEF2GEO(launch.x);
+	long i;
+	for (i=0;i<n;i++)
+		sink_value = GEO2ECEF(geo).v.i;
+	return n;
+}
+
+static long bench_splint(long n)
+{
+	double y;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		splint(spline_x, spline_y, spline_y2, 64, (i & 1023) * (63.0 / 1024), &y);
+		sink_value = y;
+	}
+	return n;
+}
+
+static long bench_table1d(long n)
+{
+	long i;
+	int hint = 0;
+	for (i=0;i<n;i++)
+		sink_value = table1d_eval(&spline_table, (i & 1023) * (63.0 / 1024), &hint);
+	return n;
+}
+
+static long bench_thrust_curve(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+		sink_value = get_thrust_curve_segment(&ctx, (i & 1023) * (5.0 / 1024));
+	return n;
+}
+
+/**
+ * Post-processing a flight, counted in states
+ */
+static long bench_post_history(long n)
+{
+	long i;
+	int k;
+	for (i=0;i<n;i++)
+	{
+		for (k=0;k<flight.length;k++)
+			flight_out[k] = altitude(flight.states[k].x) + vertical_velocity(flight.states[k]);
+		sink_value = flight_out[i % flight.length];
+	}
+	return n * flight.length;
+}
+
+static long bench_post_columns(long n)
+{
+	const state_columns *c = &flight_columns;
+	double *alt = flight_out, *v_vel = flight_out + c->length;
+	long i, k;
+	for (i=0;i<n;i++)
+	{
+		altitude_columns(c->x, c->y, c->z, c->length, alt);
+		vertical_velocity_columns(c->x, c->y, c->z, c->vx, c->vy, c->vz, c->length, v_vel);
+		for (k=0;k<c->length;k++)
+			alt[k] += v_vel[k];
+		sink_value = alt[i % c->length];
+	}
+	return n * c->length;
+}
+
+/**
+ * Coordinate transforms over a flight, one point at a time and as arrays
+ */
+static long bench_geo_points(long n)
+{
+	const state_columns *c = &flight_columns;
+	long i, k;
+	for (i=0;i<n;i++)
+	{
+		for (k=0;k<c->length;k++)
+		{
+			vec geo = ECEF2GEO((vec) {{c->x[k], c->y[k], c->z[k]}});
+			flight_out[k] = geo.v.i + geo.v.j + geo.v.k;
+		}
+		sink_value = flight_out[i % c->length];
+	}
+	return n * c->length;
+}
+
+static long bench_geo_columns(long n)
+{
+	const state_columns *c = &flight_columns;
+	double *lon = flight_out, *lat = flight_out + c->length, *alt = flight_out + 2*c->length;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		ECEF2GEO_columns(c->x, c->y, c->z, c->length, lon, lat, alt);
+		sink_value = lat[i % c->length];
+	}
+	return n * c->length;
+}
+
+static long bench_geodetic_points(long n)
+{
+	const state_columns *c = &flight_columns;
+	long i, k;
+	for (i=0;i<n;i++)
+	{
+		for (k=0;k<c->length;k++)
+		{
+			vec geo = ECEF2geodetic(&earth_wgs84, (vec) {{c->x[k], c->y[k], c->z[k]}});
+			flight_out[k] = geo.v.i + geo.v.j + geo.v.k;
+		}
+		sink_value = flight_out[i % c->length];
+	}
+	return n * c->length;
+}
+
+static long bench_geodetic_columns(long n)
+{
+	const state_columns *c = &flight_columns;
+	double *lon = flight_out, *lat = flight_out + c->length, *h = flight_out + 2*c->length;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		ECEF2geodetic_columns(&earth_wgs84, c->x, c->y, c->z, c->length, lon, lat, h);
+		sink_value = lat[i % c->length];
+	}
+	return n * c->length;
+}
+
+static long bench_earth_altitude(long n)
+{
+	long i;
+	for (i=0;i<n;i++)
+		sink_value = earth_altitude(&earth_wgs84, launch.x);
+	return n;
+}
+
+static long bench_enu_points(long n)
+{
+	const state_columns *c = &flight_columns;
+	long i, k;
+	for (i=0;i<n;i++)
+	{
+		for (k=0;k<c->length;k++)
+		{
+			vec d = {{c->x[k] - launch.x.v.i, c->y[k] - launch.x.v.j, c->z[k] - launch.x.v.k}};
+			vec enu = ECEF2ENU(d, -2.14031, 0.79412);
+			flight_out[k] = enu.v.i + enu.v.j + enu.v.k;
+		}
+		sink_value = flight_out[i % c->length];
+	}
+	return n * c->length;
+}
+
+static long bench_enu_columns(long n)
+{
+	const state_columns *c = &flight_columns;
+	double *e = flight_out, *north = flight_out + c->length, *u = flight_out + 2*c->length;
+	long i;
+	for (i=0;i<n;i++)
+	{
+		mat3 T = ENU_matrix(-2.14031, 0.79412);
+		ECEF2ENU_columns(&T, launch.x, c->x, c->y, c->z, c->length, e, north, u);
+		sink_value = u[i % c->length];
+	}
+	return n * c->length;
+}
+
+/**
+ * Whole flights, counted in accepted steps
+ */
+static long bench_integrate(long n)
+{
+	long i, steps = 0;
+	for (i=0;i<n;i++)
+	{
+		state_history h = Integrate_Rocket_r(&ctx, vehicle, launch);
+		steps += h.length;
+		state_history_free(&h);
+	}
+	return steps;
+}
+
+static long bench_integrate_generic(long n)
+{
+	long steps;
+	ctx.specialize = 0;
+	steps = bench_integrate(n);
+	ctx.specialize = 1;
+	return steps;
+}
+
+static long bench_integrate_6dof(long n)
+{
+	long steps;
+	ctx.rigid_body = 1;
+	ctx.physics_model.body_drag_model = drag_body;
+	ctx.physics_model.body_thrust_model = thrust_body;
+	steps = bench_integrate(n);
+	ctx.rigid_body = 0;
+	ctx.physics_model.body_drag_model = NULL;
+	ctx.physics_model.body_thrust_model = NULL;
+	return steps;
+}
+
+static long bench_integrate_dopri5(long n)
+{
+	long steps;
+	ctx.integrator = &rk_dopri5;
+	steps = bench_integrate(n);
+	ctx.integrator = &rk_cash_karp;
+	return steps;
+}
+
+static long bench_integrate_dop853(long n)
+{
+	long steps;
+	ctx.integrator = &rk_dop853;
+	steps = bench_integrate(n);
+	ctx.integrator = &rk_cash_karp;
+	return steps;
+}
+
+static long bench_integrate_summary(long n)
+{
+	long i, steps = 0;
+	for (i=0;i<n;i++)
+	{
+		trajectory_sink sink;
+		trajectory_summary sum;
+		sink_summary(&sink, &sum);
+		steps += Integrate_Rocket_sink(&ctx, vehicle, launch, &sink);
+		sink_value = sum.apogee;
+	}
+	return steps;
+}
+
+static const bench_case cases[] = {
+	{ "rkck",                    "call", bench_rkck },
+	{ "rkqc",                    "call", bench_rkqc },
+	{ "rkqc_kernel",             "call", bench_rkqc_kernel },
+	{ "rkdp",                    "call", bench_rkdp },
+	{ "rkdp853",                 "call", bench_rkdp853 },
+	{ "rk4",                     "call", bench_rk4 },
+	{ "deriv",                   "call", bench_deriv },
+	{ "physics",                 "call", bench_physics },
+	{ "gravity_sphere",          "call", bench_gravity_sphere },
+	{ "gravity_j2",              "call", bench_gravity_j2 },
+	{ "gravity_harmonic",        "call", bench_gravity_harmonic },
+	{ "drag",                    "call", bench_drag },
+	{ "atmosphere_at",           "call", bench_atmosphere },
+	{ "ECEF2GEO",                "call", bench_ECEF2GEO },
+	{ "GEO2ECEF",                "call", bench_GEO2ECEF },
+	{ "earth_altitude_wgs84",    "call", bench_earth_altitude },
+	{ "splint",                  "call", bench_splint },
+	{ "table1d_eval",            "call", bench_table1d },
+	{ "get_thrust_curve_segment","call", bench_thrust_curve },
+	{ "post_history",            "state",bench_post_history },
+	{ "post_columns",            "state",bench_post_columns },
+	{ "ECEF2GEO_points",         "point",bench_geo_points },
+	{ "ECEF2GEO_columns",        "point",bench_geo_columns },
+	{ "ECEF2geodetic_points",    "point",bench_geodetic_points },
+	{ "ECEF2geodetic_columns",   "point",bench_geodetic_columns },
+	{ "ECEF2ENU_points",         "point",bench_enu_points },
+	{ "ECEF2ENU_columns",        "point",bench_enu_columns },
+	{ "Integrate_Rocket",        "step", bench_integrate },
+	{ "Integrate_Rocket_generic","step", bench_integrate_generic },
+	{ "Integrate_Rocket_6dof",   "step", bench_integrate_6dof },
+	{ "Integrate_Rocket_summary","step", bench_integrate_summary },
+	{ "Integrate_Rocket_dopri5", "step", bench_integrate_dopri5 },
+	{ "Integrate_Rocket_dop853", "step", bench_integrate_dop853 },
+};
+
+/**
+ * A 5 s motor on a 50 kg rocket launched straight up, with drag
+ */
+static void setup(void)
+{
+	int i;
+
+	Init_Context(&ctx);
+	ctx.physics_model.drag_model = drag;
+	ctx.physics_model.thrust_model = thrust;
+	ctx.duration = 1000;
+
+	for (i=0;i<=50;i++)
+	{
+		motor_t[i] = i * 0.1;
+		motor_m[i] = 0.8 + 0.2 * sin(i * 0.3);
+	}
+	thrust_curve motor = { .time = motor_t, .m_dot = motor_m, .length = 50, .Isp = 200 };
+	vehicle = (rocket) { .thrust = motor, .area = 0.02, .Cd = 0.4,
+	                     .body = { .inertia_full = {.v={0.1, 20, 20}},
+	                               .inertia_empty = {.v={0.08, 16, 16}},
+	                               .mass_full = 50, .mass_empty = 45,
+	                               .CN_alpha = 8, .cp = 0.2, .diameter = 0.15, .Cmq = -30 } };
+
+	// Nose up, for 6-DOF, and spinning
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	vec up = unit_vec(position);
+	launch = (state) { .x = position, .v = {.v={0,0,0}}, .a = {.v={0,0,0}}, .m = 50 };
+	ctx.initial_attitude.q = quat_normalize((quat) {{ 1 + up.v.i, 0, -up.v.k, up.v.j }});
+	ctx.initial_attitude.omega = (vec) {{1, 0.01, 0}};
+	ctx.launch_axis = position;
+	ctx.vehicle = vehicle;
+	thrust_init(&ctx);
+
+	RK_STATE(y0)->x = launch.x;
+	RK_STATE(y0)->v = (vec) {{10, 10, 10}};
+	RK_STATE(y0)->m = launch.m;
+	for (i=0;i<NEQ;i++)
+	{
+		dydx0[i] = 0;
+		yscale[i] = ctx.eps * ctx.atol[i];
+	}
+	deriv(y0, dydx0, 0, &ctx);
+
+	for (i=0;i<64;i++)
+	{
+		spline_x[i] = i + 0.3 * sin(i);
+		spline_y[i] = cos(i * 0.2);
+	}
+	spline(spline_x, spline_y, 64, 1e30, 1e30, spline_y2);
+	table1d_init(&spline_table, spline_x, spline_y, 64, TABLE_SPLINE, spline_coef);
+
+	// One flight to post-process, both ways
+	flight = Integrate_Rocket_r(&ctx, vehicle, launch);
+	state_columns_from_history(&flight_columns, &flight, 0);
+	flight_out = malloc(sizeof(double) * 3 * flight.length);
+}
+
+/**
+ * @returns the best nanoseconds per unit, units done in that run in *count
+ */
+static double run_case(const bench_case *c, long *count)
+{
+	long n = 1;
+	double t, best = HUGE_VAL;
+	int r;
+
+	// Warm up and grow n until one run takes a measurable time
+	for (;;)
+	{
+		t = now();
+		c->fn(n);
+		t = now() - t;
+		if (t > BENCH_TARGET / 10)
+			break;
+		n *= 2;
+	}
+	n = (long) (n * (BENCH_TARGET / t)) + 1;
+
+	for (r=0;r<BENCH_REPEAT;r++)
+	{
+		long units;
+		t = now();
+		units = c->fn(n);
+		t = now() - t;
+		if (units > 0 && t * 1e9 / units < best)
+		{
+			best = t * 1e9 / units;
+			*count = units;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = "";
+	const char *filter = NULL;
+	int json = 0, first = 1;
+	size_t i;
+
+	for (i=1;i<(size_t) argc;i++)
+	{
+		if (strcmp(argv[i], "-j") == 0)
+			json = 1;
+		else if (strcmp(argv[i], "-l") == 0 && i+1 < (size_t) argc)
+			label = argv[++i];
+		else
+			filter = argv[i];
+	}
+
+	setup();
+
+	if (json)
+		printf("{\"label\": \"%s\", \"results\": [\n", label);
+	else
+		printf("label,name,unit,count,ns_per_unit,units_per_s\n");
+
+	for (i=0;i<sizeof(cases)/sizeof(cases[0]);i++)
+	{
+		const bench_case *c = &cases[i];
+		long count = 0;
+		double ns;
+
+		if (filter && strstr(c->name, filter) == NULL)
+			continue;
+
+		ns = run_case(c, &count);
+		if (json)
+		{
+			printf("%s  {\"name\": \"%s\", \"unit\": \"%s\", \"count\": %ld, "
+			       "\"ns_per_unit\": %.3f, \"units_per_s\": %.1f}",
+			       first ? "" : ",\n", c->name, c->unit, count, ns, 1e9 / ns);
+		}
+		else
+		{
+			printf("%s,%s,%s,%ld,%.3f,%.1f\n", label, c->name, c->unit, count, ns, 1e9 / ns);
+		}
+		fflush(stdout);
+		first = 0;
+	}
+
+	if (json)
+		printf("\n]}\n");
+
+	return 0;
+}
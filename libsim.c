@@ -22,198 +22,743 @@
  * Calls to the rest of the program are handled through here.
  */
 
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <math.h>
 #include "libsim_types.h"
+#include "utils/sink.h"
+#include "utils/boundary_conditions.h"
+#include "utils/stats.h"
 #include "physics/physics.h"
+#include "physics/rigid_body.h"
 #include "physics/gravity.h"
+#include "physics/thrust.h"
+#include "physics/atmosphere.h"
+#include "physics/kepler.h"
+#include "physics/models/earth.h"
+#include "utils/coord.h"
 #include "math/runge-kutta.h"
+#include "math/dormand-prince.h"
+#include "math/dormand-prince-853.h"
+#include "physics/kernels.h"
+#include "math/root.h"
+#include "math/vector.h"
+#include "math/quaternion.h"
 #include "libsim.h"
 
-/// Number of ODE's (3 position, 3 velocity, mass)
-#define n 7
+/**
+ * Progress of one flight: the start of the step in progress (which is also
+ * the last output point), where it is on the output grid and the value of
+ * each event function at the start of the step.
+ */
+typedef struct {
+	int stepnum;         // steps taken
+	long next;           // index of the next grid time
+	double x;
+	double y[NEQ_6DOF];
+	double dydx[NEQ_6DOF];
+	double g[MAX_EVENTS];
+	int coasting;        // the step just taken was a Kepler coast along orbit
+	kepler_orbit orbit;
+} flight_state;
 
 // Local functions
-void deriv(double *y ,double *dydx, double t);
-static state rk2state(double *y, double *dydx);
-static void integrate(state y0, state *yp, double *xp, double x1, double x2, int *steps);
-
-// Globals
-physics_model_strategy physics_model;
+void deriv(double *y ,double *dydx, double t, void *ctx);
+static state rk2state(const double *y, const double *dydx);
+static int push_state(const sim_context *ctx, trajectory_sink *sink, double t, const double *y,
+	const double *dydx);
+static int load_vehicle(sim_context *ctx, rocket r);
+static int integrate(sim_context *ctx, state y0, trajectory_sink *sink, double x1, double x2);
+static void load_state(const sim_context *ctx, state y0, double *y, double *dydx);
+static void error_scale(const sim_context *ctx, const double *y, double *yscale);
+static int flight_start(const sim_context *ctx, flight_state *fl, trajectory_sink *sink,
+	double x, const double *y, const double *dydx);
+static int flight_step(sim_context *ctx, flight_state *fl, trajectory_sink *sink,
+	double *x, double *y, double *dydx, double time_to_stop);
+static int coast(sim_context *ctx, flight_state *fl, double *x, double *y, double *dydx,
+	double h, double time_to_stop);
+
+// The RK vector is an rk_state, see libsim_types.h
+typedef char rk_state_is_neq_doubles[(sizeof(rk_state) == NEQ*sizeof(double)) ? 1 : -1];
+typedef char rk_attitude_fills_6dof[(sizeof(rk_attitude) == (NEQ_6DOF - RK_Q)*sizeof(double)) ? 1 : -1];
+// Output states stay 3-DOF sized, the attitude goes in a state_attitude
+typedef char state_is_3dof[(sizeof(state) == 10*sizeof(double)) ? 1 : -1];
+
+// Context used by the non-reentrant Init_Model()/Integrate_Rocket() pair
+static sim_context default_context;
+
+// Stop at the ground unless told otherwise
+static const event default_events[] = {
+	{ boundary_condition_ground, -1, 1 },
+};
 
 void Init_Model(void)
 {
-	physics_model.gravity_model = gravity_sphere;
+	Init_Context(&default_context);
 }
 
-state_history Integrate_Rocket(rocket r, state initial_conditions)
+void Init_Context(sim_context *ctx)
 {
 	int i;
-	// History
-	state *yp;
-	double *xp;
-	yp = malloc(sizeof(state) * MAXSTEPS);
-	xp = malloc(sizeof(double) * MAXSTEPS);
-	state_history history;
-	state *h;
-	double *times;
-
-	int steps_taken = 0;
-
-	integrate(initial_conditions, yp, xp, 0, 1, &steps_taken);
-
-	h = malloc(sizeof(state) * steps_taken);
-	times = malloc(sizeof(double) * steps_taken);
-	for (i=0;i<steps_taken;i++)
+
+	ctx->physics_model.gravity_model = gravity_sphere;
+	ctx->physics_model.drag_model    = NULL;
+	ctx->physics_model.thrust_model  = NULL;
+	ctx->physics_model.body_drag_model   = NULL;
+	ctx->physics_model.body_thrust_model = NULL;
+	ctx->integrator = &rk_cash_karp;
+	ctx->earth = &earth_sphere;
+	ctx->specialize = 1;
+	ctx->rigid_body = 0;
+	ctx->initial_attitude.q = (quat) {{ .w = 1 }};
+	ctx->initial_attitude.omega = (vec) {{0, 0, 0}};
+	ctx->neq = NEQ;
+	ctx->eps = eps;
+	for (i=0;i<NEQ_6DOF;i++)
 	{
-		h[i] = yp[i];
-		times[i] = xp[i];
+		ctx->atol[i] = 1e-9;
+		ctx->rtol[i] = 0;
 	}
+	ctx->duration = 1;
+	ctx->coast_altitude = 0;
+	ctx->gravity_field = gravity_egm96();
+	ctx->gravity_degree = GRAVITY_DEGREE_MAX;
+	ctx->gravity_tol = 1e-10;
+	ctx->wind = (vec) {{0, 0, 0}};
+	ctx->launch_axis = (vec) {{1, 0, 0}};
+	ctx->output_dt = 0;
+	ctx->output_times = NULL;
+	ctx->output_count = 0;
+	ctx->events = default_events;
+	ctx->event_count = sizeof(default_events) / sizeof(default_events[0]);
+	ctx->event_tol = 1e-9;
+	ctx->on_event = NULL;
+	ctx->event_user = NULL;
+	ctx->pool = NULL;
+
+	atmosphere_init();
+}
 
-	history.times = times;
-	history.states = h;
-	history.length = steps_taken;
+void Set_Tolerances(sim_context *ctx, double rtol, double atol_position, double atol_velocity,
+	double atol_mass)
+{
+	int i;
 
-	return history;
+	for (i=0;i<3;i++)
+	{
+		ctx->atol[RK_X+i] = atol_position;
+		ctx->atol[RK_V+i] = atol_velocity;
+	}
+	ctx->atol[RK_M] = atol_mass;
+	for (i=0;i<NEQ_6DOF;i++)
+		ctx->rtol[i] = rtol;
+	ctx->eps = 1;
 }
 
-static void integrate(state y0, state *yp, double *xp, double x1, double x2, int *steps)
+void Set_Attitude_Tolerances(sim_context *ctx, double atol_attitude, double atol_rate)
 {
 	int i;
-	int stepnum = 0;   // Track number of steps the integrator has run
 
+	for (i=0;i<4;i++)
+		ctx->atol[RK_Q+i] = atol_attitude;
+	for (i=0;i<3;i++)
+		ctx->atol[RK_W+i] = atol_rate;
+}
+
+state_history Integrate_Rocket(rocket r, state initial_conditions)
+{
+	return Integrate_Rocket_r(&default_context, r, initial_conditions);
+}
+
+state_history Integrate_Rocket_r(sim_context *ctx, rocket r, state initial_conditions)
+{
+	trajectory_sink sink;
+	memory_sink mem;
+
+	sink_memory_arena(&sink, &mem, ctx->pool);
+	if (Integrate_Rocket_sink(ctx, r, initial_conditions, &sink) < 0)
+	{
+		// Don't hand back a partial flight as if it were the whole one
+		state_history_free(&mem.history);
+		mem.history.length = -1;
+	}
+
+	return mem.history;
+}
+
+/**
+ * @brief Release a history returned by Integrate_Rocket()
+ *
+ * Histories that came from an arena (see sim_context.pool) are left alone,
+ * they go back when the arena is reset.
+ */
+void state_history_free(state_history *h)
+{
+	if (h->owned)
+	{
+		free(h->times);
+		free(h->states);
+		free(h->attitude);
+	}
+	h->times = NULL;
+	h->states = NULL;
+	h->attitude = NULL;
+	h->length = 0;
+}
+
+/**
+ * @brief Integrate a rocket, streaming every step into a sink
+ *
+ * The sink is finished (flushed and closed) before this returns.
+ *
+ * @returns Number of states written, or -1 if the context could not be loaded
+ *          (more than MAX_EVENTS events, a bad thrust curve), the step size
+ *          underflowed or the sink reported an error. The sink keeps the
+ *          flight up to the failed step.
+ */
+long Integrate_Rocket_sink(sim_context *ctx, rocket r, state initial_conditions, trajectory_sink *sink)
+{
+	if (load_vehicle(ctx, r) != 0)
+	{
+		sink_finish(sink);
+		return -1;
+	}
+
+	STATS(stats_reset(&ctx->stats));
+	STATS(double wall = stats_now());
+	int failed = integrate(ctx, initial_conditions, sink, 0, ctx->duration) != 0;
+	STATS(ctx->stats.wall = stats_now() - wall);
+
+	if (sink_finish(sink) != 0 || failed)
+		return -1;
+	return sink->total;
+}
+
+/**
+ * Put the vehicle in the context and build the model tables for it
+ */
+static int load_vehicle(sim_context *ctx, rocket r)
+{
+	// The flight keeps the events' values in fixed arrays
+	if (ctx->event_count < 0 || ctx->event_count > MAX_EVENTS)
+		return -1;
+
+	ctx->vehicle = r;
+	ctx->neq = ctx->rigid_body ? NEQ_6DOF : NEQ;
+	ctx->kernel = (ctx->specialize && !ctx->rigid_body) ? kernel_find(ctx) : NULL;
+	if (ctx->physics_model.thrust_model && thrust_init(ctx) != 0)
+		return -1;
+	return 0;
+}
+
+/**
+ * Fly from x1 to x2 into sink
+ *
+ * @returns 0, or -1 if the step size underflowed. Sink errors are left for
+ *          sink_finish() to report.
+ */
+static int integrate(sim_context *ctx, state y0, trajectory_sink *sink, double x1, double x2)
+{
 	double x = x1;     // Current time, begin at x1
-	state s;           // Current state
 
-	// Integrator memory, each position in an array is a DOF of the system
-	double y[n];       // array of integrator outputs, y = integral(y' dx)
-	double dydx[n];    // array of RHS, dy/dx
-	double yscale[n];  // array of yscale factors (integraion error tolorence)
+	// Integrator memory lives in the context
+	double *y = ctx->y;
+	double *dydx = ctx->dydx;
+	double *yscale = ctx->yscale;
 	double h;          // timestep
 	double hdid;       // stores actual timestep taken by RK45
 	double hnext;      // guess for next timestep
+	rk_control control; // PI step size controller
+	flight_state fl;   // output grid and events
+	const integration_strategy *method = ctx->integrator;
+	rk_derivs rhs = deriv;
+	int n = ctx->neq;   // 3-DOF flights never touch the attitude block
+
+	// Compiled for these models if possible
+	if (ctx->kernel)
+	{
+		method = &ctx->kernel->method;
+		rhs = ctx->kernel->deriv;
+	}
 
 	// stop the integrator
 	double time_to_stop = x2;
 
-	// First guess for timestep
-	h = x2 - x1;
-
 	// Inital conditions
-	y[0] = y0.x.v.i;
-	y[1] = y0.v.v.i;
-	y[2] = y0.x.v.j;
-	y[3] = y0.v.v.j;
-	y[4] = y0.x.v.k;
-	y[5] = y0.v.v.k;
-	dydx[1] = y0.a.v.i;
-	dydx[3] = y0.a.v.j;
-	dydx[5] = y0.a.v.k;
-	y[6] = y0.m;
-
-	while (stepnum <= MAXSTEPS)
-	{
-		// First RHS call
-		deriv(y, dydx, x);
-		s = rk2state(y, dydx);
+	load_state(ctx, y0, y, dydx);
 
-		// Store current state
-		xp[stepnum] = x;
-		yp[stepnum] = s;
+	// First RHS call, store the starting point
+	rhs(y, dydx, x, ctx);
+	if (flight_start(ctx, &fl, sink, x, y, dydx) != 0)
+		return 0;
 
-		// Y-scaling. Holds down fractional errors
-		for (i=0;i<n;i++) {
-			yscale[i] = 0.000000001;//dydx[i]+TINY;
-		}
+	// First guess for timestep
+	error_scale(ctx, y, yscale);
+	h = rk_first_step(y, dydx, x, x2 - x1, 1.0, yscale, method->order, n, ctx->work, rhs, ctx);
+	rk_control_init(&control);
+
+	for (;;)
+	{
+		// Error allowed in each element
+		error_scale(ctx, y, yscale);
 
 		// Check for stepsize overshoot
 		if ((x + h) > time_to_stop)
 			h = time_to_stop - x;
 
-		// One quality controled integrator step
-		rkqc(y, dydx, &x, h, eps, yscale, &hdid, &hnext, n, deriv);
-		s = rk2state(y, dydx);
+		// Above the air with the motor out, jump along the orbit
+		if (coast(ctx, &fl, &x, y, dydx, h, time_to_stop))
+		{
+			fl.stepnum++;
+			STATS(ctx->stats.coasts++);
+		}
+		else
+		{
+			// One quality controled integrator step
+			STATS(long calls = ctx->stats.derivs);
+			if (method->step(y, dydx, &x, h, 1.0, yscale, &hdid, &hnext, &control, n, ctx->work,
+				rhs, ctx) != 0)
+				return -1;
+			fl.stepnum++;
+			STATS(stats_step(&ctx->stats, hdid, (ctx->stats.derivs - calls) / method->stages - 1));
+
+			// Back onto unit length. The DCM does not depend on |q|, so an
+			// FSAL derivative taken before this still holds
+			if (ctx->rigid_body)
+				RK_ATTITUDE(y)->q = quat_normalize(RK_ATTITUDE(y)->q);
+
+			// RHS at the new point, the first RHS call of the next step. FSAL
+			// methods have already done it
+			if (!method->fsal)
+				rhs(y, dydx, x, ctx);
+		}
+
+		// Events, output, and are we finished?
+		if (flight_step(ctx, &fl, sink, &x, y, dydx, time_to_stop) != 0)
+			return 0;
+
+		// set timestep for next go around, a coast leaves it as it was
+		if (!fl.coasting)
+			h = hnext;
+	}
+}
+
+/**
+ * Time of grid point k, returns 0 once past the end of the grid
+ */
+static int grid_time(const sim_context *ctx, long k, double *t)
+{
+	if (ctx->output_times)
+	{
+		if (k >= ctx->output_count)
+			return 0;
+		*t = ctx->output_times[k];
+		return 1;
+	}
+	*t = k * ctx->output_dt;
+	return 1;
+}
+
+static int output_grid(const sim_context *ctx)
+{
+	return ctx->output_dt > 0 || ctx->output_times != NULL;
+}
+
+/**
+ * Write the point at the end of a step. Without an output grid that is every
+ * point; with one only points right on the grid, and always the last point
+ * of a flight so the end (e.g. impact) is never lost between grid points.
+ */
+static int output_point(const sim_context *ctx, flight_state *fl, trajectory_sink *sink,
+	double x, const double *y, const double *dydx, int last)
+{
+	double t;
+	int write = last || !output_grid(ctx);
+
+	// Grid time right on the step point
+	if (output_grid(ctx) && grid_time(ctx, fl->next, &t) && t == x)
+	{
+		write = 1;
+		fl->next++;
+	}
+
+	if (!write)
+		return 0;
+
+	return push_state(ctx, sink, x, y, dydx);
+}
+
+/**
+ * @brief Start of a flight: write the first point and note the events
+ *
+ * @returns 0, or the error from the sink
+ */
+static int flight_start(const sim_context *ctx, flight_state *fl, trajectory_sink *sink,
+	double x, const double *y, const double *dydx)
+{
+	int i, k;
+	double t;
+
+	fl->stepnum = 0;
+	fl->coasting = 0;
+	fl->next = 0;
+	fl->x = x;
+	for (i=0;i<ctx->neq;i++) { fl->y[i] = y[i]; fl->dydx[i] = dydx[i]; }
+
+	for (k=0;k<ctx->event_count;k++)
+		fl->g[k] = ctx->events[k].g(rk2state(y, dydx), x, ctx);
+
+	// Skip grid times before the start
+	if (output_grid(ctx))
+		while (grid_time(ctx, fl->next, &t) && t < x)
+			fl->next++;
 
-		// Are we finished?
-		// hit ground
-		if (underground(s))
+	return output_point(ctx, fl, sink, x, y, dydx, 0);
+}
+
+/**
+ * Fill an RK vector from a point on a coast orbit. Only gravity acts, as in
+ * physics() with gravity_sphere() alone.
+ *
+ * @returns 0, or -1 if kepler_at() did not converge
+ */
+static int coast_at(const kepler_orbit *k, double t, double m, double *y, double *dydx)
+{
+	rk_state *s = RK_STATE(y), *ds = RK_STATE(dydx);
+	int ret = kepler_at(k, t, &s->x, &s->v);
+	double rn = norm(s->x);
+	double a = -k->mu / (rn*rn*rn);
+
+	s->m = m;
+	ds->x = s->v;
+	ds->v = vec_scale(s->x, a);
+	ds->m = 0;
+	return ret;
+}
+
+/**
+ * @brief Jump along a two-body orbit instead of taking a step
+ *
+ * Only when the result is what physics() would give: a 3-DOF flight,
+ * gravity_sphere() is the gravity model, the motor has burnt out and the
+ * vehicle is above
+ * ctx->coast_altitude, where drag is taken to be nothing. The jump ends at
+ * apoapsis, so the top of the flight is an output point, or on the way down
+ * at coast_altitude, where the integrator takes over again, or at the end of
+ * the run.
+ *
+ * @param h The step the integrator would take, shorter jumps are not made
+ *
+ * @returns 1 if x, y and dydx were moved along fl->orbit, otherwise 0
+ */
+static int coast(sim_context *ctx, flight_state *fl, double *x, double *y, double *dydx,
+	double h, double time_to_stop)
+{
+	const physics_model_strategy *model = &ctx->physics_model;
+	const rk_state *s = RK_CSTATE(y);
+	double dt;
+	double yc[NEQ], dc[NEQ];
+	int i;
+
+	fl->coasting = 0;
+	if (ctx->coast_altitude <= 0 || ctx->rigid_body || model->gravity_model != gravity_sphere)
+		return 0;
+	// Leaving the orbit again needs the radius of the altitude, only known on a sphere
+	if (ctx->earth->e2 != 0)
+		return 0;
+	if (model->thrust_model && *x <= thrust_burnout(ctx))
+		return 0;
+	if (earth_altitude(ctx->earth, s->x) <= ctx->coast_altitude)
+		return 0;
+
+	kepler_init(&fl->orbit, s->x, s->v, *x, -G * MASS_EARTH);
+
+	// Escaping orbits are only followed on the way out
+	if (fl->orbit.alpha <= 0 && fl->orbit.sigma0 < 0)
+		return 0;
+
+	dt = kepler_time_to_apoapsis(&fl->orbit);
+	if (dt <= 0)
+		dt = kepler_time_to_radius(&fl->orbit, ctx->earth->a + ctx->coast_altitude);
+	if (dt < 0 || *x + dt > time_to_stop)
+		dt = time_to_stop - *x;
+	if (dt <= h)
+		return 0;
+
+	// If the orbit cannot be solved there, integrate the step as usual
+	if (coast_at(&fl->orbit, *x + dt, s->m, yc, dc) != 0)
+		return 0;
+
+	*x += dt;
+	for (i=0;i<NEQ;i++)
+		y[i] = yc[i];
+	deriv(y, dydx, *x, ctx);
+	fl->coasting = 1;
+	return 1;
+}
+
+/**
+ * The continuous solution over the step that just ended. Built on first use:
+ * integrators with their own dense output may need more RHS calls for it, so
+ * steps with no event and no grid point never pay for one.
+ */
+typedef struct {
+	sim_context *ctx;
+	const flight_state *fl;   // start of the step
+	double x;                 // end of the step
+	const double *y, *dydx;
+	rk_dense d;
+	int built;
+} step_output;
+
+static void step_at(step_output *out, double t, double *yi, double *fi)
+{
+	sim_context *ctx = out->ctx;
+	const flight_state *fl = out->fl;
+
+	// Inside a coast whose end was solved
+	if (fl->coasting)
+	{
+		(void) coast_at(&fl->orbit, t, RK_CSTATE(fl->y)->m, yi, fi);
+		return;
+	}
+
+	if (!out->built)
+	{
+		if (ctx->integrator->dense)
+			ctx->integrator->dense(&out->d, ctx->neq, ctx->work, deriv, ctx);
+		else
+			rk_dense_hermite(&out->d, ctx->neq, fl->x, out->x - fl->x, fl->y, fl->dydx,
+				out->y, out->dydx);
+		out->built = 1;
+	}
+	rk_dense_eval(&out->d, t, yi, fi);
+}
+
+/**
+ * An event function evaluated on the dense output of a step
+ */
+typedef struct {
+	step_output *out;
+	const sim_context *ctx;
+	event_function g;
+} event_on_step;
+
+static double event_at(double t, void *arg)
+{
+	event_on_step *e = arg;
+	double yi[NEQ_6DOF], fi[NEQ_6DOF];
+
+	step_at(e->out, t, yi, fi);
+	return e->g(rk2state(yi, fi), t, e->ctx);
+}
+
+static int event_crossed(double g0, double g1, int direction)
+{
+	if (g0 == 0 || (g0 > 0) == (g1 > 0))
+		return 0;
+	if (direction > 0)
+		return g1 > g0;
+	if (direction < 0)
+		return g1 < g0;
+	return 1;
+}
+
+/**
+ * @brief End of a step: events, output, and are we finished?
+ *
+ * Every event function is checked for a sign change over the step. Crossings
+ * are located by root finding on the step's dense output, handed to on_event
+ * in time order, and the first terminal one ends the flight right there. Grid
+ * output inside the step is interpolated on the same dense output.
+ *
+ * @param ctx Simulation context
+ * @param fl The flight, holding the start of the step
+ * @param sink Where output goes
+ * @param x End of the step, moved back to the event if one ends the flight
+ * @param y State at the end of the step, likewise
+ * @param dydx Derivative at the end of the step, likewise
+ * @param time_to_stop End of the integration
+ *
+ * @returns 0 to keep going, 1 when the flight is over, -1 on a sink error
+ */
+static int flight_step(sim_context *ctx, flight_state *fl, trajectory_sink *sink,
+	double *x, double *y, double *dydx, double time_to_stop)
+{
+	int i, k, n;
+	int finished = 0;
+	double g1[MAX_EVENTS];
+	double yi[NEQ_6DOF], fi[NEQ_6DOF];
+	double t;
+	step_output out = { ctx, fl, *x, y, dydx };
+	int hits[MAX_EVENTS];
+	double hit_time[MAX_EVENTS];
+
+	// Which events happened in this step, and when
+	n = 0;
+	for (k=0;k<ctx->event_count;k++)
+	{
+		const event *ev = &ctx->events[k];
+		g1[k] = ev->g(rk2state(y, dydx), *x, ctx);
+		if (!event_crossed(fl->g[k], g1[k], ev->direction))
+			continue;
+
+		event_on_step e = { &out, ctx, ev->g };
+		t = root_illinois(event_at, &e, fl->x, fl->g[k], *x, g1[k], ctx->event_tol);
+
+		// Keep hits in time order
+		for (i=n;i>0 && hit_time[i-1] > t;i--)
 		{
-			deriv(y, dydx, x);
-			s = rk2state(y, dydx);
-			xp[stepnum] = x;
-			yp[stepnum] = s;
-			stepnum++;
-			break;
+			hits[i] = hits[i-1];
+			hit_time[i] = hit_time[i-1];
+		}
+		hits[i] = k;
+		hit_time[i] = t;
+		n++;
+	}
+
+	for (i=0;i<n;i++)
+	{
+		const event *ev = &ctx->events[hits[i]];
+		t = hit_time[i];
+
+		if (ev->terminal)
+		{
+			// Flight ends at the event
+			step_at(&out, t, y, dydx);
+			*x = t;
+			deriv(y, dydx, t, ctx);
+			finished = 1;
 		}
 
-		// Passed requested integration time
-		if ( (time_to_stop - x) <= 0.0001 )
+		if (ctx->on_event)
 		{
-			deriv(y, dydx, x);
-			s = rk2state(y, dydx);
-			xp[stepnum] = x;
-			yp[stepnum] = s;
-			stepnum++;
+			step_at(&out, t, yi, fi);
+			if (ev->terminal)
+				for (k=0;k<ctx->neq;k++) { yi[k] = y[k]; fi[k] = dydx[k]; }
+			ctx->on_event(hits[i], t, rk2state(yi, fi), ctx->event_user);
+		}
+
+		if (finished)
 			break;
+	}
+
+	// Passed requested integration time
+	if ((time_to_stop - *x) <= 0.0001)
+		finished = 1;
+
+	// Out of steps, give up here. The flight still ends on this step's state
+	if (fl->stepnum >= MAXSTEPS)
+		finished = 1;
+
+	// Grid points inside the step
+	if (output_grid(ctx))
+	{
+		while (grid_time(ctx, fl->next, &t) && t < *x)
+		{
+			step_at(&out, t, yi, fi);
+			if (push_state(ctx, sink, t, yi, fi) != 0)
+				return -1;
+			fl->next++;
 		}
+	}
+
+	if (output_point(ctx, fl, sink, *x, y, dydx, finished) != 0)
+		return -1;
+	if (finished)
+		return 1;
+
+	// This step's end is the next one's start
+	fl->x = *x;
+	for (i=0;i<ctx->neq;i++) { fl->y[i] = y[i]; fl->dydx[i] = dydx[i]; }
+	for (k=0;k<ctx->event_count;k++)
+		fl->g[k] = g1[k];
+
+	return 0;
+}
 
-		// set timestep for next go around
-		h = hnext;
+/**
+ * Error allowed in each element of an RK vector, eps (atol + rtol |y|)
+ */
+static void error_scale(const sim_context *ctx, const double *y, double *yscale)
+{
+	int i;
+	for (i=0;i<ctx->neq;i++)
+		yscale[i] = ctx->eps * (ctx->atol[i] + ctx->rtol[i] * fabs(y[i]));
+}
 
-		// Incement step counter
-		stepnum++;
+/**
+ * Fill an RK vector from a state, with the attitude block for 6-DOF from
+ * ctx->initial_attitude.
+ */
+static void load_state(const sim_context *ctx, state y0, double *y, double *dydx)
+{
+	int i;
+	for (i=0;i<3;i++)
+	{
+		y[RK_X+i] = y0.x.component[i];
+		y[RK_V+i] = y0.v.component[i];
+		dydx[RK_V+i] = y0.a.component[i];
 	}
+	y[RK_M] = y0.m;
+
+	if (!ctx->rigid_body)
+		return;
+
+	// An attitude left zeroed starts level with ECEF
+	quat q = quat_normalize(ctx->initial_attitude.q);
+	for (i=0;i<4;i++)
+		y[RK_Q+i] = q.component[i];
+	for (i=0;i<3;i++)
+		y[RK_W+i] = ctx->initial_attitude.omega.component[i];
+}
+
+/**
+ * Output state from an RK vector and its derivative
+ */
+static state rk2state(const double *y, const double *dydx)
+{
+	const rk_state *s = RK_CSTATE(y);
+	state out;
 
-	(*steps) = stepnum;
-	return;
-}
-
-static state rk2state(double *y, double *dydx)
-{
-	state s;
-	s.x.v.i = y[0];
-	s.v.v.i = y[1];
-	s.x.v.j = y[2];
-	s.v.v.j = y[3];
-	s.x.v.k = y[4];
-	s.v.v.k = y[5];
-	s.m     = y[6];
-
-	s.a.v.i = dydx[1];
-	s.a.v.j = dydx[3];
-	s.a.v.k = dydx[5];
-
-	return s;
-}
-
-void deriv(double *y ,double *dydx, double t)
-{
-	state current_state;
-
-	// To solve for acceleration build a state struct to send to physics engine
-	current_state.x.v.i = y[0];
-	current_state.v.v.i = y[1];
-	current_state.x.v.j = y[2];
-	current_state.v.v.j = y[3];
-	current_state.x.v.k = y[4];
-	current_state.v.v.k = y[5];
-	current_state.a.v.i = dydx[1];
-	current_state.a.v.j = dydx[3];
-	current_state.a.v.k = dydx[5];
-	current_state.m = y[6];
-
-	// Do Physics to current state:
-	state_change deriv_state = physics(current_state, t, physics_model);
-
-	// Build RK vectors from state change
-	// Velocity is single integration of acceleration
-	dydx[0] = y[1];
-	dydx[2] = y[3];
-	dydx[4] = y[5];
-	// Acceleration is from physics model
-	dydx[1] = deriv_state.acc.v.i;
-	dydx[3] = deriv_state.acc.v.j;
-	dydx[5] = deriv_state.acc.v.k;
-	dydx[6] = deriv_state.m_dot;
+	out.x = s->x;
+	out.v = s->v;
+	out.a = RK_CSTATE(dydx)->v;
+	out.m = s->m;
+
+	return out;
+}
+
+/**
+ * Write the state in an RK vector to the sink, with its attitude for 6-DOF
+ *
+ * @returns 0, or the error from the sink
+ */
+static int push_state(const sim_context *ctx, trajectory_sink *sink, double t, const double *y,
+	const double *dydx)
+{
+	state_attitude a;
+
+	if (!ctx->rigid_body)
+		return sink_push(sink, t, rk2state(y, dydx), NULL);
+
+	// Interpolated points are a little off unit length
+	a.q = quat_normalize(RK_CATTITUDE(y)->q);
+	a.omega = RK_CATTITUDE(y)->omega;
+	return sink_push(sink, t, rk2state(y, dydx), &a);
+}
+
+void deriv(double *y ,double *dydx, double t, void *ctx)
+{
+	sim_context *sim = ctx;
+
+	// Physics works on the RK vectors in place
+	STATS(sim->stats.derivs++);
+	if (sim->rigid_body)
+		physics_rigid_body(RK_CSTATE(y), RK_CATTITUDE(y), t, sim, RK_STATE(dydx),
+			RK_ATTITUDE(dydx));
+	else
+		physics(RK_CSTATE(y), t, sim, RK_STATE(dydx));
 }
@@ -1,11 +1,61 @@
 /**
- * Maximum number of steps one integration is allowed to take
+ * Maximum number of steps one integration is allowed to take. Nothing is
+ * sized by this, it only stops runaway integrations.
  */
 #define MAXSTEPS 10000
 
+/**
+ * Set up models in the shared default context used by Integrate_Rocket().
+ * Not reentrant, use Init_Context() and Integrate_Rocket_r() from threads.
+ */
 void Init_Model(void);
 state_history Integrate_Rocket(rocket r, state initial_conditions);
 
+/**
+ * Set up a simulation context with the default models and tolerance
+ */
+void Init_Context(sim_context *ctx);
+
+/**
+ * Error allowed in each element of the state: atol + rtol |y|, with separate
+ * absolute tolerances for position (m), velocity (m/s) and mass (kg). Sets
+ * eps to 1 so that the tolerances are used as given.
+ */
+void Set_Tolerances(sim_context *ctx, double rtol, double atol_position, double atol_velocity,
+	double atol_mass);
+
+/**
+ * Absolute tolerances of the 6-DOF attitude block: quaternion components and
+ * body rates (rad/s). Call after Set_Tolerances(), which sets their rtol.
+ */
+void Set_Attitude_Tolerances(sim_context *ctx, double atol_attitude, double atol_rate);
+
+/**
+ * Reentrant Integrate_Rocket(). All state used during the integration is kept
+ * in ctx, so separate contexts can be integrated from separate threads.
+ * Where Integrate_Rocket_sink() would return -1 the history is empty with a
+ * length of -1.
+ */
+state_history Integrate_Rocket_r(sim_context *ctx, rocket r, state initial_conditions);
+
+/**
+ * Release a history from Integrate_Rocket() or Integrate_Rocket_r(). Does
+ * nothing to a history that lives in the context's arena.
+ */
+void state_history_free(state_history *h);
+
+/**
+ * Integrate_Rocket_r() streaming each step into a sink (see utils/sink.h)
+ * instead of keeping the whole history.
+ */
+long Integrate_Rocket_sink(sim_context *ctx, rocket r, state initial_conditions, trajectory_sink *sink);
+
+/**
+ * Right hand side the integrator uses: RK vector y at time t to dy/dt through
+ * physics(). ctx is the sim_context.
+ */
+void deriv(double *y, double *dydx, double t, void *ctx);
+
 /**
  * Integration Error Tolorance
  */
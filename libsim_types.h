@@ -49,67 +49,421 @@ typedef union mat3
 	double component[3][3];
 } mat3;
 
+/**
+ * @brief Quaternion, w + xi + yj + zk, see math/quaternion.h
+ */
+typedef union quat {
+	struct {
+		double w, x, y, z;
+	} q;
+	double component[4];
+} quat;
+
 /**
  * Rocket State
  */
 typedef struct {vec x; vec v; vec a; double m;} state;
 
+/**
+ * Attitude (body to ECEF) and body rates, only flown in 6-DOF (see
+ * sim_context.rigid_body). Kept out of state so 3-DOF output doesn't carry
+ * them.
+ */
+typedef struct {quat q; vec omega;} state_attitude;
+
 /**
  * Thrust Curve
  */
 typedef struct {double *time; double *m_dot; int length; double Isp;} thrust_curve;
 
 /**
- * Used to return the state from the physics model
+ * How a table1d fills in between its breakpoints
+ */
+typedef enum {
+	TABLE_LINEAR,     ///< straight lines
+	TABLE_MONOTONE,   ///< shape preserving cubic (Fritsch-Carlson), no overshoot
+	TABLE_SPLINE      ///< natural cubic spline, smooth second derivative
+} table_mode;
+
+/**
+ * @brief Tabulated function of one variable, see math/table.h
+ *
+ * The breakpoints and values are borrowed, not copied. Cubic modes keep three
+ * coefficients per segment in coef, so a lookup is a segment search plus a
+ * Horner evaluation.
+ */
+typedef struct {
+	const double *x;       ///< breakpoints, strictly increasing
+	const double *y;       ///< values at the breakpoints
+	double *coef;          ///< per segment b, c, d of y[k] + b dx + c dx^2 + d dx^3
+	int n;                 ///< number of breakpoints
+	table_mode mode;
+	int uniform;           ///< evenly spaced, the segment is found by division
+	double inv_dx;         ///< 1/spacing when uniform
+} table1d;
+
+/**
+ * Air at one altitude, see physics/atmosphere.h
+ */
+typedef struct {
+	double density;          ///< kg/m^3
+	double pressure;         ///< Pa
+	double temperature;      ///< K
+	double speed_of_sound;   ///< m/s
+} atmosphere;
+
+/**
+ * @brief Two-body orbit through a point, see physics/kepler.h
+ *
+ * Everything a universal variable propagation needs that does not depend on
+ * the time being asked for.
+ */
+typedef struct {
+	vec r0, v0;              ///< position and velocity at t0
+	double t0;
+	double mu;               ///< gravitational parameter, m^3/s^2
+	double sqrt_mu;
+	double r0n;              ///< |r0|
+	double sigma0;           ///< r0.v0 / sqrt(mu)
+	double alpha;            ///< 1/a: > 0 ellipse, 0 parabola, < 0 hyperbola
+} kepler_orbit;
+
+/**
+ * Highest degree a gravity_field can hold
+ */
+#define GRAVITY_DEGREE_MAX 36
+
+/**
+ * Coefficients up to degree n stored as a triangle, (n, m) at n(n+1)/2 + m
+ */
+#define GRAVITY_INDEX(n, m) ((n)*((n)+1)/2 + (m))
+#define GRAVITY_SIZE(n) GRAVITY_INDEX((n)+1, 0)
+
+/**
+ * @brief Spherical harmonic gravity field, see physics/gravity.h
+ *
+ * Fully normalized coefficients plus the factors of the normalized
+ * Cunningham recursion, worked out once by gravity_field_init(). Read only
+ * while integrating, so one field can be shared by any number of contexts.
+ */
+typedef struct {
+	int degree;              ///< highest degree in C and S
+	double mu;               ///< gravitational parameter, m^3/s^2
+	double radius;           ///< reference radius of the coefficients, m
+	double C[GRAVITY_SIZE(GRAVITY_DEGREE_MAX)];   ///< normalized C(n, m)
+	double S[GRAVITY_SIZE(GRAVITY_DEGREE_MAX)];   ///< normalized S(n, m)
+	// Recursion for V(n, m), W(n, m) up to degree + 1
+	double alpha[GRAVITY_SIZE(GRAVITY_DEGREE_MAX + 1)];
+	double beta[GRAVITY_SIZE(GRAVITY_DEGREE_MAX + 1)];
+	double gamma[GRAVITY_DEGREE_MAX + 2];
+	// Acceleration of term (n, m) from V, W at degree n + 1
+	double k_up[GRAVITY_SIZE(GRAVITY_DEGREE_MAX)];    ///< order m + 1
+	double k_down[GRAVITY_SIZE(GRAVITY_DEGREE_MAX)];  ///< order m - 1
+	double k_z[GRAVITY_SIZE(GRAVITY_DEGREE_MAX)];     ///< order m
+	double size[GRAVITY_DEGREE_MAX + 1];  ///< bound on degree n's acceleration at r = radius, over mu/r^2
+} gravity_field;
+
+/**
+ * Used to return the an arrany of states and times from the integration.
+ * owned is set when times and states were malloc'd and should be released
+ * with state_history_free(); otherwise they belong to an arena. attitude has
+ * one entry per state for 6-DOF flights and is NULL otherwise.
  */
-typedef struct {vec acc; double m_dot;} state_change;
+typedef struct {double *times; state *states; int length; int owned; state_attitude *attitude;} state_history;
 
 /**
- * Used to return the an arrany of states and times from the integration
+ * @brief States as columns, one array per value (structure of arrays)
+ *
+ * For working on one value over whole histories, or many of them end to end,
+ * in a loop the compiler can vectorize. All the columns are in one
+ * allocation; the attitude ones are NULL unless asked for. See
+ * utils/columns.h.
  */
-typedef struct {double *times; state *states; int length;} state_history;
+typedef struct {
+	double *t;
+	double *x, *y, *z;
+	double *vx, *vy, *vz;
+	double *ax, *ay, *az;
+	double *m;
+	double *qw, *qx, *qy, *qz;
+	double *wx, *wy, *wz;
+	long length;
+} state_columns;
 
 /*
  * Model Types: 
  */
 
+/**
+ * @brief Mass properties and body aero of a rocket, for 6-DOF
+ *
+ * Body axes have x along the rocket, nose forward. The inertia is about the
+ * CG in those axes, principal moments only, and moves in a straight line
+ * from inertia_empty at mass_empty to inertia_full at mass_full as
+ * propellant burns.
+ */
+typedef struct {
+	vec inertia_full;     ///< Ixx, Iyy, Izz at mass_full, kg m^2
+	vec inertia_empty;    ///< at mass_empty
+	double mass_full;     ///< kg
+	double mass_empty;    ///< kg, equal to mass_full for a fixed inertia
+	double CN_alpha;      ///< normal force slope, per rad, on the rocket's area
+	double cp;            ///< centre of pressure behind the CG, m; > 0 is stable
+	double diameter;      ///< reference length for damping, m
+	double Cmq;           ///< pitch and yaw damping coefficient, < 0 damps
+} rigid_body;
+
 /**
  * A thrusting rocket
  * TODO: replace Cd with aero model
  */
-typedef struct {thrust_curve thrust; double area; double Cd;} rocket;
+typedef struct {thrust_curve thrust; double area; double Cd; rigid_body body;} rocket;
+
+/**
+ * A freefalling piece, see staging.h. Leaves the vehicle with its velocity
+ * plus dv.
+ */
+typedef struct {double area; double Cd; double mass; vec dv;} fragment;
 
 /**
- * A freefalling piece
+ * Step size histogram: bin k counts 2^(k + STATS_LOW_EXP) <= h < 2^(k + 1 +
+ * STATS_LOW_EXP), the ends catch everything smaller or larger
  */
-typedef struct {double area; double Cd;} fragment;
+#define STATS_BINS 32
+#define STATS_LOW_EXP -20
+
+/**
+ * @brief What the integrator did during one run, see utils/stats.h
+ *
+ * Only filled in when libsim is built with LIBSIM_STATS. The mean step is
+ * h_sum / accepted.
+ */
+typedef struct {
+	long accepted;                 ///< steps taken
+	long rejected;                 ///< attempts thrown away for too much error
+	long coasts;                   ///< Kepler coasts taken in place of steps
+	long derivs;                   ///< RHS evaluations
+	double h_min, h_max, h_sum;    ///< accepted step sizes, s
+	long h_hist[STATS_BINS];
+	double t_gravity;              ///< time in each physics model, s
+	double t_drag;
+	double t_thrust;
+	double wall;                   ///< time for the whole run, s
+} sim_stats;
+
+/**
+ * @brief Integrator state, as it is laid out in the RK vector
+ *
+ * y[] is one of these: the position block, the velocity block and then the
+ * mass, and dydx[] is its derivative laid out the same way (velocity,
+ * acceleration, mass flow). Physics works on y and dydx in place through
+ * RK_STATE() pointers, nothing is packed or unpacked. In 6-DOF an
+ * rk_attitude block follows the mass, see below.
+ */
+typedef struct {
+	vec x;       ///< position, ECEF m
+	vec v;       ///< velocity, ECEF m/s
+	double m;    ///< mass, kg
+} rk_state;
+
+/**
+ * First element of each block in the RK vector
+ */
+#define RK_X 0
+#define RK_V 3
+#define RK_M 6
+
+/**
+ * Number of ODE's in the integrator state, the doubles in an rk_state
+ */
+#define NEQ 7
+
+/**
+ * An RK vector (double *) seen as the rk_state it holds
+ */
+#define RK_STATE(y) ((rk_state *) (y))
+#define RK_CSTATE(y) ((const rk_state *) (y))
+
+/**
+ * @brief Attitude block of the RK vector, 6-DOF only
+ *
+ * Appended after the rk_state when sim_context.rigid_body is set, so 3-DOF
+ * flights integrate NEQ elements and never carry it. Its derivative is the
+ * quaternion rate and the angular acceleration.
+ */
+typedef struct {
+	quat q;      ///< attitude, body to ECEF, kept at unit length
+	vec omega;   ///< body rates, rad/s in body axes
+} rk_attitude;
+
+/**
+ * First element of each attitude block, and the 6-DOF RK vector length
+ */
+#define RK_Q 7
+#define RK_W 11
+#define NEQ_6DOF 14
+
+/**
+ * The attitude block of an RK vector
+ */
+#define RK_ATTITUDE(y) ((rk_attitude *) ((y) + RK_Q))
+#define RK_CATTITUDE(y) ((const rk_attitude *) ((y) + RK_Q))
+
+/**
+ * Simulation context, defined below
+ */
+typedef struct sim_context sim_context;
+
+/**
+ * Shape of the Earth altitudes are measured from, see utils/coord.h
+ */
+typedef struct earth_shape earth_shape;
+
+/**
+ * Destination for integrator output, see utils/sink.h
+ */
+typedef struct trajectory_sink trajectory_sink;
+
+/**
+ * Bump allocator, see utils/arena.h
+ */
+typedef struct arena arena;
 
 /**
  * Physics model stratagy pattern
+ *
+ * Each model reads the state in place and adds its force, in ECEF, to f.
+ * Models that are left NULL are skipped. Aero models are handed the air,
+ * looked up once per physics() call. Propulsion sets the mass flow and may
+ * update its lookup hints in the context as it goes.
+ */
+typedef void (*gravity)(const rk_state *s, const sim_context *ctx, vec *f);
+typedef void (*aero)(const rk_state *s, const atmosphere *air, const sim_context *ctx, vec *f);
+typedef void (*propulsion)(const rk_state *s, double t, sim_context *ctx, vec *f, double *mdot);
+
+/**
+ * @brief What 6-DOF models need to know about the body, once per RHS call
+ *
+ * Built by physics_rigid_body() before any model runs, so the direction
+ * cosines are worked out once however many models use them.
  */
-typedef vec (*gravity)(state s);
-typedef vec (*aero)(state s);
+typedef struct {
+	mat3 dcm;         ///< body to ECEF, from the attitude quaternion
+	vec omega;        ///< body rates, rad/s
+	vec inertia;      ///< principal moments at the current mass, kg m^2
+} body_frame;
+
+/**
+ * Body frame models, 6-DOF only: as aero and propulsion, and they also add
+ * their moment about the CG, in body axes, to moment.
+ */
+typedef void (*aero_body)(const rk_state *s, const body_frame *b, const atmosphere *air,
+	const sim_context *ctx, vec *f, vec *moment);
+typedef void (*propulsion_body)(const rk_state *s, const body_frame *b, double t,
+	sim_context *ctx, vec *f, vec *moment, double *mdot);
+
 typedef struct {
 	gravity gravity_model;
 	aero drag_model;
+	propulsion thrust_model;
+	aero_body body_drag_model;         ///< 6-DOF: used in place of drag_model when set
+	propulsion_body body_thrust_model; ///< 6-DOF: used in place of thrust_model when set
 } physics_model_strategy;
 
 
+/**
+ * Event function. An event happens where it crosses zero, see
+ * utils/boundary_conditions.c for stock ones.
+ */
+typedef double (*event_function)(state s, double t, const sim_context *ctx);
 
-typedef double (*boundary_condition)(state *history, double *x_history, int point_history, double x2);
+/**
+ * Called with every event that happens during an integration
+ */
+typedef void (*event_handler)(int index, double t, state s, void *user);
 
 /**
- *
+ * @brief A zero crossing to watch for during the integration
  */
-/*
 typedef struct {
-  integrator integrator;
-  int DOF;
-  boundary_condition boundary;
-  gravity gravity_model;
-  aero    drag_model;
-  } integration_strategy;
-*/
+	event_function g;
+	int direction;   ///< +1 only rising crossings, -1 only falling, 0 both
+	int terminal;    ///< stop the integration here
+} event;
+
+/**
+ * Most events one integration can watch
+ */
+#define MAX_EVENTS 8
+
+/**
+ * Adaptive integrator, see math/runge-kutta.h
+ */
+typedef struct integration_strategy integration_strategy;
+
+/**
+ * Stepper and RHS specialized for one set of models, see physics/kernels.h
+ */
+typedef struct sim_kernel sim_kernel;
+
+/**
+ * @brief Simulation context
+ *
+ * Everything one simulation needs while it runs. Nothing in the integration
+ * path touches global state, so any number of contexts can be integrated at
+ * once, one per thread, without locking.
+ */
+struct sim_context {
+	physics_model_strategy physics_model;  ///< Models used by physics()
+	const integration_strategy *integrator; ///< rk_cash_karp, rk_dopri5, ...
+	int specialize;                        ///< use a compiled kernel for these models if there is one
+	int rigid_body;                        ///< 6-DOF: fly the attitude as well, see physics/rigid_body.h
+	state_attitude initial_attitude;       ///< 6-DOF attitude and body rates at the start
+	int neq;                               ///< RK vector length for this run, NEQ or NEQ_6DOF
+	rocket vehicle;                        ///< Vehicle being flown, incl. thrust curve
+	double eps;                            ///< Integration error tolerance, scales atol and rtol
+	double atol[NEQ_6DOF];                 ///< per RK element: error allowed is eps (atol + rtol |y|)
+	double rtol[NEQ_6DOF];
+	double duration;                       ///< Integrate from 0 to here unless the ground comes first
+	double coast_altitude;                 ///< > 0: unpowered flight above this is a Kepler orbit, jumped in one go
+
+	// Environment
+	const earth_shape *earth;              ///< earth_sphere or earth_wgs84, for altitude and the ground
+	const gravity_field *gravity_field;    ///< for gravity_j2() and gravity_harmonic()
+	int gravity_degree;                    ///< highest degree gravity_harmonic() uses
+	double gravity_tol;                    ///< drop degrees below this fraction of mu/r^2, 0 keeps all
+	vec wind;                              ///< Constant wind, ECEF m/s
+	vec launch_axis;                       ///< Thrust direction, ECEF (the start of the turn for thrust_gravity_turn)
+
+	// Model caches, rebuilt at the start of every run
+	table1d thrust_table;                  ///< vehicle.thrust m_dot against time
+	int thrust_hint;                       ///< last thrust_table segment used
+	const sim_kernel *kernel;              ///< kernel for this run, NULL for the strategies
+
+	// Output grid. With neither set every accepted step is output
+	double output_dt;                      ///< > 0: output every output_dt s, from t = 0
+	const double *output_times;            ///< or: output at these increasing times
+	int output_count;                      ///< number of output_times
+
+	// Events
+	const event *events;                   ///< zero crossings to locate, at most MAX_EVENTS
+	int event_count;
+	double event_tol;                      ///< locate events to within this many seconds
+	event_handler on_event;                ///< told about every event, may be NULL
+	void *event_user;                      ///< passed to on_event
+
+	// Statistics
+	sim_stats stats;                       ///< for the last run, with LIBSIM_STATS
+
+	// Memory
+	arena *pool;                           ///< allocate histories here instead of malloc, may be NULL
+
+	// Integrator memory, each position in an array is a DOF of the system
+	double y[NEQ_6DOF];                    ///< integrator outputs, y = integral(y' dx)
+	double dydx[NEQ_6DOF];                 ///< RHS, dy/dx
+	double yscale[NEQ_6DOF];               ///< error allowed in each element this step, from atol and rtol
+	double work[16*NEQ_6DOF];              ///< integrator scratch, RK_WORK_SIZE(NEQ_6DOF)
+};
 
 /**
  * PI
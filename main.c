@@ -2,29 +2,41 @@
  * Main
  *
  * Author: Nathan Bergey
+ *
+ * Usage: libsim [file.traj]
+ *
+ * Flies the example rocket. With a file name the trajectory is written there
+ * in the binary format (utils/trajfile.h, read it with traj2csv), otherwise
+ * it is printed as text.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "libsim_types.h"
 #include "libsim.h"
+#include "utils/sink.h"
+#include "utils/trajfile.h"
 
 /**
  * main
  */
 int main(int argc, char **argv)
 {
-	int i;
+	sim_context ctx;
+	trajectory_sink sink;
+	traj_writer writer;
+	FILE *out = NULL;
 
 	/// Initilize libsim models
-	Init_Model();
+	Init_Context(&ctx);
 
 	/// Initilize a rocket
 	double t[2] = {0,1};
 	double m[2] = {1,1};
 	thrust_curve motor = { .time = t,
                            .m_dot = m,
-                           .length = 2,
+                           .length = 1,
                            .Isp = 254
                          };
 	rocket a_rocket = { .thrust = motor,
@@ -36,17 +48,25 @@ int main(int argc, char **argv)
                                  .a = {.v={0,0,0}},
                                  .m = 45
                                };
-	state_history flight_history;
-
-    /// Run a simulation
-	flight_history = Integrate_Rocket(a_rocket, initial_conditions);
 
-	for (i=0;i<flight_history.length;i++)
+	/// Where the trajectory goes
+	if (argc > 1)
 	{
-		double x = flight_history.times[i];
-		state  h = flight_history.states[i];
-		printf("x: %f,    y:%f\n", x, h.x.v.i);
+		out = fopen(argv[1], "wb");
+		if (out == NULL || sink_trajfile(&sink, &writer, out, &ctx, "example") != 0)
+		{
+			fprintf(stderr, "libsim: cannot write %s\n", argv[1]);
+			return 1;
+		}
 	}
+	else
+		sink_file(&sink, stdout);
+
+    /// Run a simulation
+	long n = Integrate_Rocket_sink(&ctx, a_rocket, initial_conditions, &sink);
+
+	if (out && fclose(out) != 0)
+		n = -1;
 
-	return 0; //exit
+	return n < 0 ? 1 : 0; //exit
 }
@@ -0,0 +1,6 @@
+int rkdp853(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx);
+void dop853_dense(rk_dense *d, int n, double *work, rk_derivs f, void *ctx);
+
+extern const integration_strategy rk_dop853;
@@ -0,0 +1,132 @@
+/**
+ * @brief Dormand-Prince rkdp() for one fixed system size and RHS
+ *
+ * A template like runge-kutta-fixed.h, included once per instance after
+ * defining
+ *
+ *   DP_FIXED_NAME   name of the stepper to define (static)
+ *   DP_FIXED_N      number of elements in the RK vector, a constant
+ *   DP_FIXED_DERIV  the RHS, called directly instead of through f
+ *
+ * n and f are ignored. Same arithmetic, in the same order, as rkdp(), and
+ * like it dydx is left holding the derivative at the new point.
+ *
+ * Needs runge-kutta.h and math.h. The parameters are
+ * undefined again at the end.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define DP_FIXED_UNROLL _Pragma("GCC unroll 16")
+#else
+#define DP_FIXED_UNROLL
+#endif
+
+static int DP_FIXED_NAME(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx)
+{
+	int i;
+	double errmax, htemp, h = htry;
+	double k2[DP_FIXED_N], k3[DP_FIXED_N], k4[DP_FIXED_N], k5[DP_FIXED_N], k6[DP_FIXED_N],
+	       k7[DP_FIXED_N];
+	double yout[DP_FIXED_N], yerr;
+	const double *k1 = dydx;
+
+	(void) n;
+	(void) work;
+	(void) f;
+
+	for (;;)
+	{
+		/// One Dormand-Prince step, see dopri5_step() for the tableau
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((1.0/5.0)*k1[i]);
+		DP_FIXED_DERIV(yout, k2, *x + (1.0/5.0)*h, ctx);
+
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((3.0/40.0)*k1[i] + (9.0/40.0)*k2[i]);
+		DP_FIXED_DERIV(yout, k3, *x + (3.0/10.0)*h, ctx);
+
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((44.0/45.0)*k1[i] + (-56.0/15.0)*k2[i] + (32.0/9.0)*k3[i]);
+		DP_FIXED_DERIV(yout, k4, *x + (4.0/5.0)*h, ctx);
+
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((19372.0/6561.0)*k1[i] + (-25360.0/2187.0)*k2[i]
+			                    + (64448.0/6561.0)*k3[i] + (-212.0/729.0)*k4[i]);
+		DP_FIXED_DERIV(yout, k5, *x + (8.0/9.0)*h, ctx);
+
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((9017.0/3168.0)*k1[i] + (-355.0/33.0)*k2[i]
+			                    + (46732.0/5247.0)*k3[i] + (49.0/176.0)*k4[i]
+			                    + (-5103.0/18656.0)*k5[i]);
+		DP_FIXED_DERIV(yout, k6, *x + h, ctx);
+
+		/// 5th order solution, and the derivative there
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+			yout[i] = y[i] + h*((35.0/384.0)*k1[i] + (500.0/1113.0)*k3[i] + (125.0/192.0)*k4[i]
+			                    + (-2187.0/6784.0)*k5[i] + (11.0/84.0)*k6[i]);
+		DP_FIXED_DERIV(yout, k7, *x + h, ctx);
+
+		errmax = 0.0;
+		DP_FIXED_UNROLL
+		for (i=0;i<DP_FIXED_N;i++)
+		{
+			yerr = h*((71.0/57600.0)*k1[i] + (-71.0/16695.0)*k3[i] + (71.0/1920.0)*k4[i]
+			          + (-17253.0/339200.0)*k5[i] + (22.0/525.0)*k6[i] + (-1.0/40.0)*k7[i]);
+			errmax = FMAX(errmax, fabs(yerr/yscal[i]));
+		}
+		errmax /= eps;
+
+		/// If within error tolorences then we're done
+		if (errmax <= 1.0)
+			break;
+
+		/// If the error is too high scale h, by no more than a factor of 10
+		if (ctl)
+		{
+			h = rk_control_reject(ctl, h, errmax, 5);
+		}
+		else
+		{
+			htemp = SAFETY * h * pow(errmax, -0.2);
+			h = (h >= 0.0) ? FMAX(htemp, 0.1*h) : FMIN(htemp, 0.1*h);
+		}
+
+		/// Give up on underflow, leaving y and x as they were
+		if (h < TINY)
+			return -1;
+	}
+
+	/// Grow the next step, by no more than a factor of 5
+	if (ctl)
+		*hnext = rk_control_accept(ctl, h, errmax, 5);
+	else if (errmax > ERRCON)
+		*hnext = SAFETY * h * pow(errmax, -0.2);
+	else
+		*hnext = 5.0 * h;
+
+	*hdid = h;
+	*x += h;
+
+	/// Update values, the last stage is the next step's first
+	DP_FIXED_UNROLL
+	for (i=0;i<DP_FIXED_N;i++)
+	{
+		y[i] = yout[i];
+		dydx[i] = k7[i];
+	}
+
+	return 0;
+}
+
+#undef DP_FIXED_UNROLL
+#undef DP_FIXED_NAME
+#undef DP_FIXED_N
+#undef DP_FIXED_DERIV
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Dormand-Prince 5(4) Integrator
+ *
+ * @section DESCRIPTION
+ *
+ * Seven stages, but the last is evaluated at the new point with the new
+ * state (First Same As Last), so it is also the first stage of the next step.
+ * An accepted step therefore costs six RHS calls, the same as Cash-Karp's
+ * five plus the driver's one at the new point; what FSAL buys here is the
+ * better error constants, and the 5th order solution is the one kept. Coefficients from Hairer, Norsett & Wanner, Solving ODEs I.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "runge-kutta.h"
+#include "dormand-prince.h"
+
+// Dormand-Prince Tableau
+static const double c2 = 1.0/5.0, c3 = 3.0/10.0, c4 = 4.0/5.0, c5 = 8.0/9.0;
+static const double a21 = 1.0/5.0;
+static const double a31 = 3.0/40.0, a32 = 9.0/40.0;
+static const double a41 = 44.0/45.0, a42 = -56.0/15.0, a43 = 32.0/9.0;
+static const double a51 = 19372.0/6561.0, a52 = -25360.0/2187.0, a53 = 64448.0/6561.0,
+                    a54 = -212.0/729.0;
+static const double a61 = 9017.0/3168.0, a62 = -355.0/33.0, a63 = 46732.0/5247.0,
+                    a64 = 49.0/176.0, a65 = -5103.0/18656.0;
+static const double a71 = 35.0/384.0, a73 = 500.0/1113.0, a74 = 125.0/192.0,
+                    a75 = -2187.0/6784.0, a76 = 11.0/84.0;
+// 5th order minus 4th order weights
+static const double e1 = 71.0/57600.0, e3 = -71.0/16695.0, e4 = 71.0/1920.0,
+                    e5 = -17253.0/339200.0, e6 = 22.0/525.0, e7 = -1.0/40.0;
+
+// Error is 4th order
+#define DP_GROW -0.2
+#define DP_SHRINK -0.2
+
+/**
+ * One Dormand-Prince step, the last stage k7 is f(x + h, yout)
+ */
+static void dopri5_step(const double *y, const double *k1, double x, double h,
+	double *yout, double *yerr, int n, double *work, rk_derivs f, void *ctx)
+{
+	int i;
+	double *k2 = work, *k3 = work + n, *k4 = work + 2*n, *k5 = work + 3*n,
+	       *k6 = work + 4*n, *k7 = work + 5*n;
+
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a21*k1[i]);
+	(*f)(yout, k2, x + c2*h, ctx);
+
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a31*k1[i] + a32*k2[i]);
+	(*f)(yout, k3, x + c3*h, ctx);
+
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a41*k1[i] + a42*k2[i] + a43*k3[i]);
+	(*f)(yout, k4, x + c4*h, ctx);
+
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a51*k1[i] + a52*k2[i] + a53*k3[i] + a54*k4[i]);
+	(*f)(yout, k5, x + c5*h, ctx);
+
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a61*k1[i] + a62*k2[i] + a63*k3[i] + a64*k4[i] + a65*k5[i]);
+	(*f)(yout, k6, x + h, ctx);
+
+	/// 5th order solution, and the derivative there
+	for (i=0;i<n;i++)
+		yout[i] = y[i] + h*(a71*k1[i] + a73*k3[i] + a74*k4[i] + a75*k5[i] + a76*k6[i]);
+	(*f)(yout, k7, x + h, ctx);
+
+	for (i=0;i<n;i++)
+		yerr[i] = h*(e1*k1[i] + e3*k3[i] + e4*k4[i] + e5*k5[i] + e6*k6[i] + e7*k7[i]);
+}
+
+/**
+ * @brief A quality controled Dormand-Prince step
+ *
+ * Same interface as rkqc() except that on return dydx holds the derivative at
+ * the new point, so the caller must not evaluate it again.
+ *
+ * @param y The current RK state vector
+ * @param dydx Derivative at the current point, replaced by the one at the new point
+ * @param x The current time
+ * @param htry The timestep to try
+ * @param eps Error tolerance
+ * @param yscal A scaling vector for the error tolorance
+ * @param hdid A placeholder for the timestep that was actually used
+ * @param hnext A suggested timestep for the next go around
+ * @param ctl Step size controller state, NULL for the classic controller
+ * @param n The number of elements in the RK vectors
+ * @param work Scratch space of RK_WORK_SIZE(n) doubles
+ * @param f A function that will evaluate the derivative of the RK vectors
+ * @param ctx Opaque context handed through to every call of f
+ *
+ * @returns 0, or -1 if the step size underflowed before the error was met
+ */
+int rkdp(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx)
+{
+	int i;
+	double errmax, htemp, h = htry;
+	double *yerr = work;
+	double *ytemp = work + n;
+	double *k7 = work + 2*n + 5*n;
+
+	for (;;)
+	{
+		/// Run one step
+		dopri5_step(y, dydx, *x, h, ytemp, yerr, n, work + 2*n, f, ctx);
+
+		/// Find the element with the highest error
+		errmax = 0.0;
+		for (i=0;i<n;i++)
+			errmax = FMAX(errmax, fabs(yerr[i]/yscal[i]));
+		errmax /= eps;
+
+		/// If within error tolorences then we're done
+		if (errmax <= 1.0)
+			break;
+
+		/// If the error is too high scale h, by no more than a factor of 10
+		if (ctl)
+		{
+			h = rk_control_reject(ctl, h, errmax, 5);
+		}
+		else
+		{
+			htemp = SAFETY * h * pow(errmax, DP_SHRINK);
+			h = (h >= 0.0) ? FMAX(htemp, 0.1*h) : FMIN(htemp, 0.1*h);
+		}
+
+		/// Give up on underflow, leaving y and x as they were
+		if (h < TINY)
+			return -1;
+	}
+
+	/// Grow the next step, by no more than a factor of 5
+	if (ctl)
+		*hnext = rk_control_accept(ctl, h, errmax, 5);
+	else if (errmax > ERRCON)
+		*hnext = SAFETY * h * pow(errmax, DP_GROW);
+	else
+		*hnext = 5.0 * h;
+
+	*hdid = h;
+	*x += h;
+
+	/// Update values, the last stage is the next step's first
+	for (i=0;i<n;i++)
+	{
+		y[i] = ytemp[i];
+		dydx[i] = k7[i];
+	}
+
+	return 0;
+}
+
+const integration_strategy rk_dopri5 = { "dopri5", rkdp, 6, 1, 5, NULL };
@@ -0,0 +1,5 @@
+int rkdp(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx);
+
+extern const integration_strategy rk_dopri5;
@@ -18,8 +18,12 @@
 
 /**
  * Cubic Spline interpolater helper
+ *
+ * Fills y2[0..n-1] with the second derivatives of the spline through
+ * x[0..n-1], y[0..n-1]. yp1 and ypn are the end slopes; 1e30 or more gives a
+ * natural end. For repeated lookups build a table1d (math/table.h) instead.
  */
-void spline(double *x, double *y, int n, double yp1, double ypn, double *y2)
+void spline(const double *x, const double *y, int n, double yp1, double ypn, double *y2)
 {
   int i,k;
   double p, qn, sig, un, *u;
@@ -27,13 +31,13 @@ void spline(double *x, double *y, int n, double yp1, double ypn, double *y2)
   u = (double*) malloc(sizeof(double)*n);
   
   if (yp1 > 0.99e30)
-    y2[1]=u[1]=0.0;
+    y2[0]=u[0]=0.0;
   else {
-    y2[1] = -0.5;
-    u[1]=(3.0/(x[2]-x[1]))*((y[2]-y[1])/(x[2]-x[1])-yp1);
+    y2[0] = -0.5;
+    u[0]=(3.0/(x[1]-x[0]))*((y[1]-y[0])/(x[1]-x[0])-yp1);
   }
   
-  for (i=2;i<n-1;i++) {
+  for (i=1;i<n-1;i++) {
     sig=(x[i]-x[i-1])/(x[i+1]-x[i-1]);
     p=sig*y2[i-1]+2.0;
     y2[i]=(sig-1.0)/p;
@@ -45,54 +49,23 @@ void spline(double *x, double *y, int n, double yp1, double ypn, double *y2)
     qn=un=0.0;
   else {
     qn=0.5;
-    un=(3.0/(x[n]-x[n-1]))*(ypn-(y[n]-y[n-1])/(x[n]-x[n-1]));
+    un=(3.0/(x[n-1]-x[n-2]))*(ypn-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
   }
   
-  y2[n]=(un-qn*u[n-1])/(qn*y2[n-1]+1.0);
+  y2[n-1]=(un-qn*u[n-2])/(qn*y2[n-2]+1.0);
   
-  for (k=n-1;k>=1;k--)
+  for (k=n-2;k>=0;k--)
     y2[k]=y2[k]*y2[k+1]+u[k];
 
-  //free(u);
+  free(u);
 }
 
-
-/*
-
-void spline(float x[], float y[], int n, float yp1, float ypn, float y2[])
-{
-        int i,k;
-        float p,qn,sig,un,*u;
-
-        u=vector(1,n-1);
-        if (yp1 > 0.99e30)
-                y2[1]=u[1]=0.0;
-        else {
-                y2[1] = -0.5;
-                u[1]=(3.0/(x[2]-x[1]))*((y[2]-y[1])/(x[2]-x[1])-yp1);
-        }
-        for (i=2;i<=n-1;i++) {
-                sig=(x[i]-x[i-1])/(x[i+1]-x[i-1]);
-                p=sig*y2[i-1]+2.0;
-                y2[i]=(sig-1.0)/p;
-                u[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
-                u[i]=(6.0*u[i]/(x[i+1]-x[i-1])-sig*u[i-1])/p;
-        }
-        if (ypn > 0.99e30)
-                qn=un=0.0;
-        else {
-                qn=0.5;
-                un=(3.0/(x[n]-x[n-1]))*(ypn-(y[n]-y[n-1])/(x[n]-x[n-1]));
-        }
-        y2[n]=(un-qn*u[n-1])/(qn*y2[n-1]+1.0);
-        for (k=n-1;k>=1;k--)
-                y2[k]=y2[k]*y2[k+1]+u[k];
-        free_vector(u,1,n-1);
-}
-
-*/
-
-void splint(double xa[], double ya[], double y2a[], int n, double x, double *y)
+/**
+ * Cubic Spline interpolater, y2a from spline()
+ *
+ * @returns 0, or -1 if two breakpoints are the same (y is not set)
+ */
+int splint(const double xa[], const double ya[], const double y2a[], int n, double x, double *y)
 {
         int klo,khi,k;
         double h,b,a;
@@ -106,13 +79,11 @@ void splint(double xa[], double ya[], double y2a[], int n, double x, double *y)
         }
         h=xa[khi]-xa[klo];
         if (h == 0.0)
-        {
-          printf("Bad xa input to routine splint (interpolation.c)\n");
-          exit(1);
-        }
+          return -1;
         a=(xa[khi]-x)/h;
         b=(x-xa[klo])/h;
         *y=a*ya[klo]+b*ya[khi]+((a*a*a-a)*y2a[klo]+(b*b*b-b)*y2a[khi])*(h*h)/6.0;
+        return 0;
 }
 
 double linear_interpolate(double x1, double y1, double x2, double y2, double x)
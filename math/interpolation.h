@@ -1,3 +1,3 @@
-void spline(double *x, double *y, int n, double yp1, double ypn, double *y2);
-void splint(double xa[], double ya[], double y2a[], int n, double x, double *y);
+void spline(const double *x, const double *y, int n, double yp1, double ypn, double *y2);
+int splint(const double xa[], const double ya[], const double y2a[], int n, double x, double *y);
 double linear_interpolate(double x1, double y1, double x2, double y2, double x);
@@ -0,0 +1,115 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Quaternions
+ *
+ * @section DESCRIPTION
+ *
+ * An attitude is the unit quaternion q that takes body axes to ECEF,
+ * v_ecef = q v_body q*. Only building a quaternion from an angle needs trig;
+ * turning one into a direction cosine matrix is products and sums, so the
+ * 6-DOF RHS never calls sin() or cos().
+ */
+#include <math.h>
+#include "../libsim_types.h"
+#include "vector.h"
+#include "quaternion.h"
+
+/**
+ * Hamilton product a b: rotate by b, then by a
+ */
+quat quat_mult(quat a, quat b)
+{
+	quat p;
+
+	p.q.w = a.q.w*b.q.w - a.q.x*b.q.x - a.q.y*b.q.y - a.q.z*b.q.z;
+	p.q.x = a.q.w*b.q.x + a.q.x*b.q.w + a.q.y*b.q.z - a.q.z*b.q.y;
+	p.q.y = a.q.w*b.q.y - a.q.x*b.q.z + a.q.y*b.q.w + a.q.z*b.q.x;
+	p.q.z = a.q.w*b.q.z + a.q.x*b.q.y - a.q.y*b.q.x + a.q.z*b.q.w;
+
+	return p;
+}
+
+/**
+ * Scale to unit length, the identity for the zero quaternion
+ */
+quat quat_normalize(quat q)
+{
+	double n = sqrt(q.q.w*q.q.w + q.q.x*q.q.x + q.q.y*q.q.y + q.q.z*q.q.z);
+	int i;
+
+	if (n == 0)
+		return (quat) {{ .w = 1 }};
+	for (i=0;i<4;i++)
+		q.component[i] /= n;
+	return q;
+}
+
+/**
+ * The rotation through |axis_angle| radians about axis_angle, as
+ * axis_angle_to_rotation_matrix() but as a quaternion
+ */
+quat quat_from_axis_angle(vec axis_angle)
+{
+	double angle = norm(axis_angle);
+	double s;
+	quat q;
+
+	if (angle < 1e-30)
+		return (quat) {{ .w = 1 }};
+
+	s = sin(0.5*angle) / angle;
+	q.q.w = cos(0.5*angle);
+	q.q.x = axis_angle.v.i * s;
+	q.q.y = axis_angle.v.j * s;
+	q.q.z = axis_angle.v.k * s;
+
+	return q;
+}
+
+/**
+ * @brief Direction cosine matrix of an attitude, body to ECEF
+ *
+ * Divides by |q|^2, so a quaternion that has drifted off unit length during
+ * a step still gives a proper rotation.
+ */
+mat3 quat_to_dcm(quat q)
+{
+	mat3 C;
+	double w = q.q.w, x = q.q.x, y = q.q.y, z = q.q.z;
+	double s = 2.0 / (w*w + x*x + y*y + z*z);
+
+	C.component[0][0] = 1 - s*(y*y + z*z);
+	C.component[0][1] = s*(x*y - w*z);
+	C.component[0][2] = s*(x*z + w*y);
+	C.component[1][0] = s*(x*y + w*z);
+	C.component[1][1] = 1 - s*(x*x + z*z);
+	C.component[1][2] = s*(y*z - w*x);
+	C.component[2][0] = s*(x*z - w*y);
+	C.component[2][1] = s*(y*z + w*x);
+	C.component[2][2] = 1 - s*(x*x + y*y);
+
+	return C;
+}
+
+/**
+ * Rotate v from body axes to ECEF
+ */
+vec quat_rotate(quat q, vec v)
+{
+	return matrix_mult(quat_to_dcm(q), v);
+}
@@ -0,0 +1,5 @@
+quat quat_mult(quat a, quat b);
+quat quat_normalize(quat q);
+quat quat_from_axis_angle(vec axis_angle);
+mat3 quat_to_dcm(quat q);
+vec quat_rotate(quat q, vec v);
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Root finding
+ *
+ * @section DESCRIPTION
+ *
+ * Bracketed root finders for scalar functions.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "root.h"
+
+/// Give up after this many iterations, the bracket is still returned
+#define ROOT_MAXIT 100
+
+/**
+ * @brief Find a root inside a bracket with the Illinois method
+ *
+ * Regula falsi, except that when the same end of the bracket is kept twice in
+ * a row its function value is halved. That stops one end from getting stuck
+ * and gives superlinear convergence while never leaving the bracket.
+ *
+ * @param f The function
+ * @param arg Passed through to f
+ * @param a One end of the bracket
+ * @param fa f(a)
+ * @param b Other end of the bracket
+ * @param fb f(b), of opposite sign to fa (or zero)
+ * @param tol Stop when the bracket is smaller than this
+ *
+ * @returns The root, or the end of the bracket on the far side of it (so a
+ * caller stepping from a to b lands just past the root, never short of it)
+ */
+double root_illinois(root_func f, void *arg, double a, double fa, double b, double fb, double tol)
+{
+	int i;
+	int side = 0;
+
+	if (fa == 0)
+		return a;
+	if (fb == 0)
+		return b;
+
+	for (i=0;i<ROOT_MAXIT;i++)
+	{
+		if (fabs(b - a) <= tol)
+			break;
+
+		double c = (a*fb - b*fa) / (fb - fa);
+		double fc = f(c, arg);
+
+		if (fc == 0)
+			return c;
+
+		if ((fc > 0) == (fb > 0))
+		{
+			b = c;
+			fb = fc;
+			if (side == -1)
+				fa /= 2;
+			side = -1;
+		}
+		else
+		{
+			a = c;
+			fa = fc;
+			if (side == 1)
+				fb /= 2;
+			side = 1;
+		}
+	}
+
+	return b;
+}
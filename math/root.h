@@ -0,0 +1,6 @@
+/**
+ * A scalar function of one variable, with a pointer to whatever else it needs
+ */
+typedef double (*root_func)(double x, void *arg);
+
+double root_illinois(root_func f, void *arg, double a, double fa, double b, double fb, double tol);
@@ -0,0 +1,129 @@
+/**
+ * @brief Cash-Karp rkqc() for one fixed system size and RHS
+ *
+ * Not a normal header: it is a template, included once per instance after
+ * defining
+ *
+ *   RK_FIXED_NAME   name of the stepper to define (static)
+ *   RK_FIXED_N      number of elements in the RK vector, a constant
+ *   RK_FIXED_DERIV  the RHS, called directly instead of through f
+ *
+ * The stepper has the rk_stepper signature so it can go in an
+ * integration_strategy; n and f are ignored. With the size known the stages
+ * live in registers rather than in work, every loop over the RK vector is
+ * unrolled, and the RHS can be inlined. The arithmetic is done in the same
+ * order as rkck()/rkqc(), so it gives bit for bit their result.
+ *
+ * Needs runge-kutta.h and math.h. The parameters are
+ * undefined again at the end.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define RK_FIXED_UNROLL _Pragma("GCC unroll 16")
+#else
+#define RK_FIXED_UNROLL
+#endif
+
+static int RK_FIXED_NAME(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx)
+{
+	int i;
+	double errmax, htemp, h = htry;
+	double ak2[RK_FIXED_N], ak3[RK_FIXED_N], ak4[RK_FIXED_N], ak5[RK_FIXED_N], ak6[RK_FIXED_N];
+	double ytemp[RK_FIXED_N], yout[RK_FIXED_N], yerr[RK_FIXED_N];
+	const double *ak1 = dydx;
+
+	(void) n;
+	(void) work;
+	(void) f;
+
+	for (;;)
+	{
+		/// One Cash-Karp step, see rkck() for the tableau
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+			ytemp[i] = y[i] + h*(0.2*ak1[i]);
+		RK_FIXED_DERIV(ytemp, ak2, *x + h*0.2, ctx);
+
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+			ytemp[i] = y[i] + h*(0.075*ak1[i] + 0.225*ak2[i]);
+		RK_FIXED_DERIV(ytemp, ak3, *x + h*0.3, ctx);
+
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+			ytemp[i] = y[i] + h*(0.3*ak1[i] + -0.9*ak2[i] + 1.2*ak3[i]);
+		RK_FIXED_DERIV(ytemp, ak4, *x + h*0.6, ctx);
+
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+			ytemp[i] = y[i] + h*((-11.0/54.0)*ak1[i] + 2.5*ak2[i] + (-70.0/27.0)*ak3[i]
+			                     + (35.0/27.0)*ak4[i]);
+		RK_FIXED_DERIV(ytemp, ak5, *x + h*1.0, ctx);
+
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+			ytemp[i] = y[i] + h*((1631.0/55296.0)*ak1[i] + (175.0/512.0)*ak2[i]
+			                     + (575.0/13824.0)*ak3[i] + (44275.0/110592.0)*ak4[i]
+			                     + (253.0/4096.0)*ak5[i]);
+		RK_FIXED_DERIV(ytemp, ak6, *x + h*0.875, ctx);
+
+		/// 4th order solution, and the error as its difference from the 5th
+		errmax = 0.0;
+		RK_FIXED_UNROLL
+		for (i=0;i<RK_FIXED_N;i++)
+		{
+			yout[i] = y[i] + h*((37.0/378.0)*ak1[i] + (250.0/621.0)*ak3[i]
+			                    + (125.0/594.0)*ak4[i] + (512.0/1771.0)*ak6[i]);
+			yerr[i] = h*(((37.0/378.0) - (2825.0/27648.0))*ak1[i]
+			             + (250.0/621.0 - 18575.0/48384.0)*ak3[i]
+			             + (125.0/594.0 - 13525.0/55296.0)*ak4[i]
+			             + (-277.0/14336.0)*ak5[i]
+			             + (512.0/1771.0 - 0.25)*ak6[i]);
+			errmax = FMAX(errmax, fabs(yerr[i]/yscal[i]));
+		}
+		errmax /= eps;
+
+		/// If within error tolorences then we're done
+		if (errmax <= 1.0)
+			break;
+
+		/// If the error is too high scale h
+		if (ctl)
+		{
+			h = rk_control_reject(ctl, h, errmax, 5);
+		}
+		else
+		{
+			htemp = SAFETY * h * pow(errmax, HSHRINK);
+			h = (h >= 0.0) ? FMAX(htemp, 0.1*h) : FMIN(htemp, 0.1*h);
+		}
+
+		/// Give up on underflow, leaving y and x as they were
+		if (h < TINY)
+			return -1;
+	}
+
+	/// Grow the next step
+	if (ctl)
+		*hnext = rk_control_accept(ctl, h, errmax, 5);
+	else if (errmax > ERRCON)
+		*hnext = SAFETY * h * pow(errmax, HGROW);
+	else
+		*hnext = 5.0 * h;
+
+	*hdid = h;
+	*x += h;
+
+	RK_FIXED_UNROLL
+	for (i=0;i<RK_FIXED_N;i++)
+		y[i] = yout[i];
+
+	return 0;
+}
+
+#undef RK_FIXED_UNROLL
+#undef RK_FIXED_NAME
+#undef RK_FIXED_N
+#undef RK_FIXED_DERIV
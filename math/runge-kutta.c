@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include "../libsim_types.h"
 #include "runge-kutta.h"
 
 // Kash-Carp Tableau
@@ -56,14 +57,12 @@ static const double dc[7] = {0, (37.0/378.0) - (2825.0/27648.0)
 															, -277.0/14336.0
 															, 512.0/1771.0 - 0.25};
 
-static void rkck(double *y, double *ak1, double x, double h, double *yout, double *yerr, int n, void(*f)(double[],double[],double));
-
 
 void ode_int_fix_step(double *y, double *dydx, double *x, double h, int n, 
-  void(*f)(double[],double[],double))
+  double *work, rk_derivs f, void *ctx)
 {
-  f(y,dydx,(*x));
-  rk4(y,dydx,(*x),n,h,f);
+  f(y,dydx,(*x),ctx);
+  rk4(y,dydx,(*x),n,h,work,f,ctx);
   (*x) += h;
 }
 
@@ -83,25 +82,30 @@ void ode_int_fix_step(double *y, double *dydx, double *x, double h, int n,
  * @param yscal A scaling vector for the error tolorance
  * @param hdid A placeholder for the timestep that was actually used
  * @param hnext A suggested timestep for the next go around
+ * @param ctl Step size controller state, NULL for the classic controller
  * @param n The number of elements in the RK vectors
+ * @param work Scratch space of RK_WORK_SIZE(n) doubles
  * @param f A function that will evaluate the derivative of the RK vectors
+ * @param ctx Opaque context handed through to every call of f
+ *
+ * @returns 0, or -1 if the step size underflowed before the error was met
  */
-void rkqc(double *y, double *dydx, double *x, double htry, double eps, 
-	double *yscal, double *hdid, double *hnext, int n,
-	void(*f)(double[],double[],double))
+int rkqc(double *y, double *dydx, double *x, double htry, double eps, 
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx)
 {
 	int i;
 	double errmax, htemp, h;
 	//double xnew;
-	double yerr[n];
-	double ytemp[n];
+	double *yerr = work;
+	double *ytemp = work + n;
 	h = htry;
 
   /// Begin Loop
 	for (;;)
 	{
     /// Run one step
-    rkck(y, dydx, *x, h, ytemp, yerr, n, f);
+    rkck(y, dydx, *x, h, ytemp, yerr, n, work + 2*n, f, ctx);
 
     /// Find the element with the highest error
     errmax = 0.0;
@@ -115,22 +119,28 @@ void rkqc(double *y, double *dydx, double *x, double htry, double eps,
     if (errmax <= 1.0) break;
 
     /// If the error is too high scale h
-    htemp = SAFETY * h * pow(errmax, HSHRINK);
-    // But don't scale by more than a factor of 10 (beware of sign)
-    h = (h >= 0.0) ? FMAX(htemp, 0.1*h) : FMIN(htemp, 0.1*h);
+    if (ctl)
+    {
+      h = rk_control_reject(ctl, h, errmax, 5);
+    }
+    else
+    {
+      htemp = SAFETY * h * pow(errmax, HSHRINK);
+      // But don't scale by more than a factor of 10 (beware of sign)
+      h = (h >= 0.0) ? FMAX(htemp, 0.1*h) : FMIN(htemp, 0.1*h);
+    }
 
-    /// Check for underflow
-    //xnew = (*x) + h;
-    //if (xnew == *x)
+    /// Give up on underflow, leaving y and x as they were
     if (h < TINY)
-		{
-      printf("Stepsize underflow\n");
-      exit(1);
-		}
+      return -1;
 	}/// Repeat
 	
 	/// Loop exited cleanly so we can increase timestep for next go-round
-	if (errmax > ERRCON)
+	if (ctl)
+	{
+		*hnext = rk_control_accept(ctl, h, errmax, 5);
+	}
+	else if (errmax > ERRCON)
 	{
 		*hnext = SAFETY * h * pow(errmax, HGROW);
 	}
@@ -145,15 +155,18 @@ void rkqc(double *y, double *dydx, double *x, double htry, double eps,
 	
 	/// Update values
 	for (i=0;i<n;i++) y[i] = ytemp[i];
+
+	return 0;
 }
 
 void rkck(double *y, double *ak1, double x, double h, double *yout, double *yerr, int n,
-	void(*f)(double[],double[],double))
+	double *work, rk_derivs f, void *ctx)
 {
 	int i;
 	
-	double ak2[n], ak3[n], ak4[n], ak5[n], ak6[n];
-	double ytemp[n];
+	// Stages and the intermediate state live in the caller's scratch space
+	double *ak2 = work, *ak3 = work + n, *ak4 = work + 2*n, *ak5 = work + 3*n, *ak6 = work + 4*n;
+	double *ytemp = work + 5*n;
 	
 	/// Steps:
 	
@@ -162,27 +175,27 @@ void rkck(double *y, double *ak1, double x, double h, double *yout, double *yerr
 	  ytemp[i] = y[i] + h*(b[2][1]*ak1[i]);
 	  
 	// Second Step
-	(*f)(ytemp, ak2, x + h*a[2]);
+	(*f)(ytemp, ak2, x + h*a[2], ctx);
 	for (i=0;i<n;i++)
 	  ytemp[i] = y[i] + h*(b[3][1]*ak1[i] + b[3][2]*ak2[i]);
 	
 	// Third Step
-	(*f)(ytemp, ak3, x + h*a[3]);
+	(*f)(ytemp, ak3, x + h*a[3], ctx);
 	for (i=0;i<n;i++)
 	  ytemp[i] = y[i] + h*(b[4][1]*ak1[i] + b[4][2]*ak2[i] + b[4][3]*ak3[i]);
 	
 	// Fourth Step
-	(*f)(ytemp, ak4, x + h*a[4]);
+	(*f)(ytemp, ak4, x + h*a[4], ctx);
 	for (i=0;i<n;i++)
 	  ytemp[i] = y[i] + h*(b[5][1]*ak1[i] + b[5][2]*ak2[i] + b[5][3]*ak3[i] + b[5][4]*ak4[i]);
 	
 	// Fifth Step
-	(*f)(ytemp, ak5, x + h*a[5]);
+	(*f)(ytemp, ak5, x + h*a[5], ctx);
 	for (i=0;i<n;i++)
 	  ytemp[i] = y[i] + h*(b[6][1]*ak1[i] + b[6][2]*ak2[i] + b[6][3]*ak3[i] + b[6][4]*ak4[i] + b[6][5]*ak5[i]);
 	  
 	// Sixth Step
-  (*f)(ytemp, ak6, x + h*a[6]);
+  (*f)(ytemp, ak6, x + h*a[6], ctx);
   
   /// Accumulate 4th order solution
   for (i=0;i<n;i++)
@@ -194,10 +207,10 @@ void rkck(double *y, double *ak1, double x, double h, double *yout, double *yerr
 }
 
 void rk4(double y[], double f1[], double x, int n, double h,
-  void(*f)(double[],double[],double))
+  double *work, rk_derivs f, void *ctx)
 {
   int i;
-  double f2[n], f3[n], f4[n], tmp[n];
+  double *f2 = work, *f3 = work + n, *f4 = work + 2*n, *tmp = work + 3*n;
   double hh = h/2.0;
   double h6 = h/6.0;
   double xh = x + hh;
@@ -206,17 +219,243 @@ void rk4(double y[], double f1[], double x, int n, double h,
   for (i=0;i<n;i++) tmp[i] = y[i] + hh*f1[i];
   
   // Second Step
-  (*f)(tmp, f2, xh);
+  (*f)(tmp, f2, xh, ctx);
   for (i=0;i<n;i++) tmp[i] = y[i] + hh*f2[i];
   
   // Third Step
-  (*f)(tmp, f3, xh);
+  (*f)(tmp, f3, xh, ctx);
   for (i=0;i<n;i++) tmp[i] = y[i] + h*f3[i];
   
   // Fourth Step
-  (*f)(tmp, f4, x+h);
+  (*f)(tmp, f4, x+h, ctx);
   
   // Add Up
   for (i=0;i<n;i++)
     y[i] += h6*(f1[i] + 2.0*(f2[i] + f3[i]) + f4[i]);
 }
+
+/**
+ * @brief Start a PI controller afresh, as if the last error were exactly at
+ * the tolerance
+ */
+void rk_control_init(rk_control *ctl)
+{
+  ctl->log_errold = 0;
+  ctl->rejected = 0;
+}
+
+/**
+ * @brief Smaller step to retry with after a rejected attempt
+ *
+ * @param ctl Controller state
+ * @param h The step that was rejected
+ * @param errmax Its error over the tolerance, > 1
+ * @param order The error estimate is O(h^order)
+ */
+double rk_control_reject(rk_control *ctl, double h, double errmax, int order)
+{
+  double fac = SAFETY * exp(-log(errmax) / order);
+
+  ctl->rejected = 1;
+  // Don't scale by more than a factor of 10
+  return h * FMAX(fac, 0.1);
+}
+
+/**
+ * @brief Next step to try after an accepted one
+ *
+ * h errold^(0.4/k) / err^(0.7/k), the step after a rejection is not allowed
+ * to grow and no step grows more than 5 times or shrinks below a fifth. One
+ * log and one exp per step: the old error is kept as its log.
+ *
+ * @param ctl Controller state
+ * @param h The step that was accepted
+ * @param errmax Its error over the tolerance, <= 1
+ * @param order The error estimate is O(h^order)
+ */
+double rk_control_accept(rk_control *ctl, double h, double errmax, int order)
+{
+  double l = log(FMAX(errmax, RK_ERRMIN));
+  double fac = SAFETY * exp((0.4*ctl->log_errold - 0.7*l) / order);
+
+  fac = FMIN(fac, 5.0);
+  fac = FMAX(fac, 0.2);
+  if (ctl->rejected)
+    fac = FMIN(fac, 1.0);
+
+  ctl->rejected = 0;
+  ctl->log_errold = l;
+  return h * fac;
+}
+
+/**
+ * @brief Guess the size of the first step
+ *
+ * Hairer, Norsett & Wanner's starting step: a step small enough that an
+ * Euler step changes y by about 1% of its size, then one explicit Euler step
+ * to estimate the second derivative and size the step so its local error
+ * would be about 1% of the tolerance. Costs one RHS call, more if the Euler
+ * step lands where the RHS is not finite.
+ *
+ * @param y The initial RK state vector
+ * @param dydx Derivative at the initial point
+ * @param x The initial time
+ * @param hmax Largest step to return, the whole span to integrate
+ * @param eps Error tolerance
+ * @param yscal A scaling vector for the error tolorance
+ * @param order The method's error estimate is O(h^order)
+ * @param n The number of elements in the RK vectors
+ * @param work Scratch space of at least 2n doubles
+ * @param f A function that will evaluate the derivative of the RK vectors
+ * @param ctx Opaque context handed through to every call of f
+ */
+double rk_first_step(const double *y, const double *dydx, double x, double hmax, double eps,
+	const double *yscal, int order, int n, double *work, rk_derivs f, void *ctx)
+{
+  int i;
+  double d0 = 0, d1 = 0, d2 = 0, d, h0, h1;
+  double *y1 = work, *f1 = work + n;
+
+  /// Size of y and y' against the tolerance
+  for (i=0;i<n;i++)
+  {
+    double sc = eps * yscal[i];
+    d0 = FMAX(d0, fabs(y[i]) / sc);
+    d1 = FMAX(d1, fabs(dydx[i]) / sc);
+  }
+  h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+  h0 = FMIN(h0, hmax);
+
+  /// One Euler step for y''. A long one can leave the physical domain (all
+  /// the mass burnt, say), so shorten it until y' there is finite
+  for (;;)
+  {
+    int finite = 1;
+    for (i=0;i<n;i++)
+      y1[i] = y[i] + h0*dydx[i];
+    (*f)(y1, f1, x + h0, ctx);
+    d2 = 0;
+    for (i=0;i<n;i++)
+    {
+      finite &= fabs(f1[i]) < HUGE_VAL;
+      d2 = FMAX(d2, fabs(f1[i] - dydx[i]) / (eps * yscal[i]));
+    }
+    if (finite || h0 <= 1e-6)
+      break;
+    h0 *= 0.01;
+  }
+  d2 /= h0;
+
+  d = FMAX(d1, d2);
+  if (d <= 1e-15)
+    h1 = FMAX(1e-6, h0*1e-3);
+  else
+    h1 = pow(0.01 / d, 1.0 / order);
+
+  return FMIN(FMIN(100*h0, h1), hmax);
+}
+
+/**
+ * @brief Build a cubic Hermite continuous extension of a step
+ *
+ * Cash-Karp has no dense output of its own, but the derivative at both ends
+ * of a step is known (the one at the end is the first RHS call of the next
+ * step) which pins down a cubic through the step. It matches the solution
+ * and its derivative at both ends and is third order accurate in between.
+ *
+ * Stored in the same form as Hairer's dense output:
+ * y(x0 + th) = c0 + t(c1 + (1-t)(c2 + t c3))
+ *
+ * @param d Dense output to fill in
+ * @param n The number of elements in the RK vectors
+ * @param x0 Start of the step
+ * @param h Size of the step
+ * @param y0 State at x0
+ * @param f0 Derivative at x0
+ * @param y1 State at x0 + h
+ * @param f1 Derivative at x0 + h
+ */
+void rk_dense_hermite(rk_dense *d, int n, double x0, double h, const double *y0,
+	const double *f0, const double *y1, const double *f1)
+{
+  int i;
+  
+  d->n = n;
+  d->rows = 4;
+  d->x0 = x0;
+  d->h = h;
+  for (i=0;i<n;i++)
+  {
+    double dy = y1[i] - y0[i];
+    double bspl = h*f0[i] - dy;
+    d->cont[0][i] = y0[i];
+    d->cont[1][i] = dy;
+    d->cont[2][i] = bspl;
+    d->cont[3][i] = dy - h*f1[i] - bspl;
+  }
+}
+
+/**
+ * Eight row dense output, Hairer's contd8():
+ * y(x0 + th) = c0 + t(c1 + (1-t)(c2 + t(c3 + (1-t)p)))
+ * p = c4 + t(c5 + (1-t)(c6 + t c7))
+ */
+static void rk_dense_eval8(const rk_dense *d, double t, double *y, double *dydx)
+{
+  int i;
+  double t1 = 1.0 - t;
+  
+  for (i=0;i<d->n;i++)
+  {
+    double q = d->cont[6][i] + t*d->cont[7][i];
+    double p = d->cont[4][i] + t*(d->cont[5][i] + t1*q);
+    double p4 = d->cont[3][i] + t1*p;
+    double p3 = d->cont[2][i] + t*p4;
+    double p2 = d->cont[1][i] + t1*p3;
+    y[i] = d->cont[0][i] + t*p2;
+    
+    if (dydx == NULL)
+      continue;
+    
+    // d/dt by the product rule, innermost first, then divided by h
+    double dp = d->cont[5][i] + t1*q + t*(t1*d->cont[7][i] - q);
+    double dp4 = t1*dp - p;
+    double dp3 = p4 + t*dp4;
+    double dp2 = t1*dp3 - p3;
+    dydx[i] = (p2 + t*dp2) / d->h;
+  }
+}
+
+/**
+ * @brief Evaluate a dense output
+ *
+ * @param d Dense output of a step
+ * @param x Where to evaluate, should be inside the step
+ * @param y Solution at x
+ * @param dydx Derivative of the solution at x, may be NULL
+ */
+void rk_dense_eval(const rk_dense *d, double x, double *y, double *dydx)
+{
+  int i;
+  double t = (d->x0 == x || d->h == 0) ? 0 : (x - d->x0) / d->h;
+  double t1 = 1.0 - t;
+  
+  if (d->rows > 4)
+  {
+    rk_dense_eval8(d, t, y, dydx);
+    return;
+  }
+  
+  for (i=0;i<d->n;i++)
+    y[i] = d->cont[0][i] + t*(d->cont[1][i] + t1*(d->cont[2][i] + t*d->cont[3][i]));
+  
+  if (dydx == NULL)
+    return;
+  
+  // d/dt of the above, divided by h
+  for (i=0;i<d->n;i++)
+    dydx[i] = (d->cont[1][i] + (1.0 - 2.0*t)*d->cont[2][i]
+              + t*(2.0 - 3.0*t)*d->cont[3][i]) / d->h;
+}
+
+const integration_strategy rk_cash_karp = { "cash-karp", rkqc, 5, 0, 5, NULL };
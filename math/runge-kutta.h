@@ -9,12 +9,109 @@
 // TODO: Calc this
 #define ERRCON 1.89e-4
 
+/**
+ * Right hand side of the ODE system, dy/dx = f(y, x).
+ *
+ * The last argument is an opaque context pointer that the integrators pass
+ * through untouched, so a caller can keep all of its model state there instead
+ * of in globals.
+ */
+typedef void (*rk_derivs)(double y[], double dydx[], double x, void *ctx);
+
+/**
+ * Largest system the dense output can hold
+ */
+#define RK_NMAX 16
+
+/**
+ * @brief Continuous extension of one accepted step
+ *
+ * Holds enough of a step from x0 to x0 + h to evaluate the solution anywhere
+ * inside it without calling the RHS again.
+ */
+typedef struct {
+	int n;
+	int rows;     ///< rows of cont in use: 4 for a cubic, 8 for DOP853's 7th degree
+	double x0, h;
+	double cont[8][RK_NMAX];
+} rk_dense;
+
+/**
+ * Scratch space, in doubles, the integrators need for an n element system.
+ * Callers provide it so that a step never allocates.
+ */
+#define RK_WORK_SIZE(n) (16*(n))
+
+/**
+ * Errors are floored here before their log is taken by the PI controller
+ */
+#define RK_ERRMIN 1e-4
+
+/**
+ * @brief Step size controller state, carried from one step to the next
+ *
+ * With one of these a stepper sizes its steps with a PI controller
+ * (Gustafsson): the next step depends on the error of the last accepted step
+ * as well as this one, which damps the accept/reject/accept see-saw of the
+ * classic controller. Steppers given NULL use the classic controller of
+ * Numerical Recipes.
+ */
+typedef struct {
+	double log_errold;   ///< log of the error of the last accepted step
+	int rejected;        ///< the attempt before this one was rejected
+} rk_control;
+
+/**
+ * A quality controled step: advance y and x by at most htry, returning the
+ * step taken in hdid and a suggestion for the next one in hnext. Returns 0,
+ * or -1 if the step size underflowed, in which case y and x are unchanged.
+ */
+typedef int (*rk_stepper)(double *y, double *dydx, double *x, double htry, double eps,
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n, double *work,
+	rk_derivs f, void *ctx);
+
+/**
+ * Build the dense output of the step the stepper just took from what it left
+ * in work. May call f again.
+ */
+typedef void (*rk_dense_builder)(rk_dense *d, int n, double *work, rk_derivs f, void *ctx);
+
+/**
+ * @brief Integrator strategy
+ *
+ * An adaptive method the driver can be run with, chosen by pointing
+ * sim_context.integrator at one of these.
+ */
+struct integration_strategy {
+	const char *name;
+	rk_stepper step;
+	int stages;   ///< RHS calls per attempted step, the first one is the caller's
+	int fsal;     ///< step leaves the derivative at its end point in dydx
+	int order;    ///< the error estimate is O(h^order)
+	rk_dense_builder dense; ///< own dense output, NULL to use rk_dense_hermite()
+};
+
+extern const integration_strategy rk_cash_karp;
+
 void ode_int_fix_step(double *y, double *dydx, double *x, double h, int n, 
-  void(*f)(double[],double[],double));
+  double *work, rk_derivs f, void *ctx);
 
 void rk4(double y[], double f1[], double x, int n, double h,
-  void(*f)(double[],double[],double));
+  double *work, rk_derivs f, void *ctx);
+
+void rkck(double *y, double *ak1, double x, double h, double *yout, double *yerr, int n,
+	double *work, rk_derivs f, void *ctx);
+
+int rkqc(double *y, double *dydx, double *x, double htry, double eps, 
+	double *yscal, double *hdid, double *hnext, rk_control *ctl, int n,
+	double *work, rk_derivs f, void *ctx);
+
+void rk_control_init(rk_control *c);
+double rk_control_reject(rk_control *c, double h, double errmax, int order);
+double rk_control_accept(rk_control *c, double h, double errmax, int order);
+double rk_first_step(const double *y, const double *dydx, double x, double hmax, double eps,
+	const double *yscal, int order, int n, double *work, rk_derivs f, void *ctx);
 
-void rkqc(double *y, double *dydx, double *x, double htry, double eps, 
-	double *yscal, double *hdid, double *hnext, int n,
-	void(*f)(double[],double[],double));
+void rk_dense_hermite(rk_dense *d, int n, double x0, double h, const double *y0,
+	const double *f0, const double *y1, const double *f1);
+void rk_dense_eval(const rk_dense *d, double x, double *y, double *dydx);
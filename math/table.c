@@ -0,0 +1,274 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Tabulated functions
+ *
+ * @section DESCRIPTION
+ *
+ * A table1d is built once from breakpoints and values; every per-segment
+ * coefficient is worked out then, so a lookup never solves anything. Finding
+ * the segment is a division on an evenly spaced table. Otherwise an optional
+ * hint remembers the last segment: a caller stepping forward in time (like
+ * the integrator) nearly always lands in the same or the next segment, and
+ * only falls back to bisection when it jumps.
+ *
+ * Outside the breakpoints the end values are held.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "table.h"
+
+/// Relative spacing error still counted as evenly spaced
+#define TABLE_UNIFORM_TOL 1e-12
+
+/**
+ * Fritsch-Carlson slope at breakpoint k: the weighted harmonic mean of the
+ * neighbouring secants, zero at a local extremum. End slopes use the three
+ * point formula, limited so they cannot overshoot.
+ */
+static double monotone_slope(const double *x, const double *y, int n, int k)
+{
+	double h0, h1, d0, d1, m;
+
+	if (n == 2)
+		return (y[1] - y[0]) / (x[1] - x[0]);
+
+	if (k == 0 || k == n-1)
+	{
+		// End breakpoint a and the next two inwards
+		int a = k, b = (k == 0) ? 1 : n-2, c = (k == 0) ? 2 : n-3;
+		h0 = fabs(x[b] - x[a]);
+		h1 = fabs(x[c] - x[b]);
+		d0 = (y[b] - y[a]) / (x[b] - x[a]);
+		d1 = (y[c] - y[b]) / (x[c] - x[b]);
+		m = ((2*h0 + h1)*d0 - h0*d1) / (h0 + h1);
+		if (m*d0 <= 0)
+			return 0;
+		if (d0*d1 <= 0 && fabs(m) > fabs(3*d0))
+			return 3*d0;
+		return m;
+	}
+
+	h0 = x[k] - x[k-1];
+	h1 = x[k+1] - x[k];
+	d0 = (y[k] - y[k-1]) / h0;
+	d1 = (y[k+1] - y[k]) / h1;
+	if (d0*d1 <= 0)
+		return 0;
+	double w0 = 2*h1 + h0;
+	double w1 = h1 + 2*h0;
+	return (w0 + w1) / (w0/d0 + w1/d1);
+}
+
+/**
+ * Hermite coefficients from the end slopes of every segment
+ */
+static void build_monotone(table1d *t)
+{
+	int k;
+	double m0 = monotone_slope(t->x, t->y, t->n, 0);
+
+	for (k=0;k<t->n-1;k++)
+	{
+		double h = t->x[k+1] - t->x[k];
+		double d = (t->y[k+1] - t->y[k]) / h;
+		double m1 = monotone_slope(t->x, t->y, t->n, k+1);
+		t->coef[3*k]   = m0;
+		t->coef[3*k+1] = (3*d - 2*m0 - m1) / h;
+		t->coef[3*k+2] = (m0 + m1 - 2*d) / (h*h);
+		m0 = m1;
+	}
+}
+
+/**
+ * Natural spline. The tridiagonal system for the second derivatives M is
+ * solved in place in coef: while solving, segment i holds the elimination
+ * factors in its b and c slots and M[i] in its d slot. M[0] = M[n-1] = 0.
+ */
+static void build_spline(table1d *t)
+{
+	const double *x = t->x, *y = t->y;
+	double *c = t->coef;
+	int n = t->n;
+	int i, k;
+
+	// Forward elimination over the interior breakpoints
+	for (i=1;i<n-1;i++)
+	{
+		double h0 = x[i] - x[i-1];
+		double h1 = x[i+1] - x[i];
+		double r = 6*((y[i+1] - y[i])/h1 - (y[i] - y[i-1])/h0);
+		double diag = 2*(h0 + h1);
+		if (i > 1)
+		{
+			diag -= h0 * c[3*(i-1)];
+			r -= h0 * c[3*(i-1)+1];
+		}
+		c[3*i] = h1 / diag;
+		c[3*i+1] = r / diag;
+	}
+
+	// Back substitution
+	for (i=n-2;i>=1;i--)
+	{
+		double next = (i+1 < n-1) ? c[3*(i+1)+2] : 0;
+		c[3*i+2] = c[3*i+1] - c[3*i]*next;
+	}
+
+	// Each segment overwrites only its own M after reading it
+	for (k=0;k<n-1;k++)
+	{
+		double h = x[k+1] - x[k];
+		double m0 = (k > 0) ? c[3*k+2] : 0;
+		double m1 = (k+1 < n-1) ? c[3*(k+1)+2] : 0;
+		c[3*k]   = (y[k+1] - y[k])/h - h*(2*m0 + m1)/6;
+		c[3*k+1] = m0/2;
+		c[3*k+2] = (m1 - m0)/(6*h);
+	}
+}
+
+/**
+ * @brief Build a table
+ *
+ * @param t The table
+ * @param x Breakpoints, strictly increasing. Borrowed, must outlive the table
+ * @param y Values at the breakpoints. Borrowed
+ * @param n Number of breakpoints, at least 2
+ * @param mode How to interpolate
+ * @param coef TABLE_COEF_SIZE(n) doubles for the cubic modes, may be NULL for
+ * TABLE_LINEAR
+ *
+ * @returns 0, or -1 if the breakpoints or storage are unusable
+ */
+int table1d_init(table1d *t, const double *x, const double *y, int n, table_mode mode,
+	double *coef)
+{
+	int i;
+
+	t->x = x;
+	t->y = y;
+	t->coef = coef;
+	t->n = 0;
+	t->mode = mode;
+	t->uniform = 0;
+	t->inv_dx = 0;
+
+	if (n < 2 || x == NULL || y == NULL)
+		return -1;
+	if (mode != TABLE_LINEAR && coef == NULL)
+		return -1;
+	for (i=1;i<n;i++)
+		if (!(x[i] > x[i-1]))
+			return -1;
+
+	t->n = n;
+
+	// Evenly spaced?
+	double dx = (x[n-1] - x[0]) / (n-1);
+	double tol = TABLE_UNIFORM_TOL * (x[n-1] - x[0]);
+	t->uniform = 1;
+	for (i=1;i<n-1;i++)
+		if (fabs(x[i] - (x[0] + i*dx)) > tol)
+			t->uniform = 0;
+	if (t->uniform)
+		t->inv_dx = 1.0 / dx;
+
+	if (mode == TABLE_MONOTONE)
+		build_monotone(t);
+	else if (mode == TABLE_SPLINE)
+		build_spline(t);
+
+	return 0;
+}
+
+/**
+ * @brief Segment holding x
+ *
+ * @param t The table
+ * @param x Where to look, already inside [x[0], x[n-1]]
+ * @param hint Last segment found, updated. May be NULL
+ *
+ * @returns k such that x[k] <= x < x[k+1], or the last segment at x[n-1]
+ */
+int table1d_find(const table1d *t, double x, int *hint)
+{
+	const double *xa = t->x;
+	int last = t->n - 2;
+	int k;
+
+	if (t->uniform)
+	{
+		k = (int) ((x - xa[0]) * t->inv_dx);
+		if (k > last)
+			k = last;
+		if (k < 0)
+			k = 0;
+	}
+	else if (hint && *hint >= 0 && *hint <= last && xa[*hint] <= x
+	         && (x < xa[*hint+1] || (*hint < last && x < xa[*hint+2])))
+	{
+		// Same segment as last time, or the next one
+		k = (x < xa[*hint+1]) ? *hint : *hint + 1;
+	}
+	else
+	{
+		int lo = 0, hi = last + 1;
+		while (hi - lo > 1)
+		{
+			int mid = (lo + hi) >> 1;
+			if (xa[mid] > x)
+				hi = mid;
+			else
+				lo = mid;
+		}
+		k = lo;
+	}
+
+	if (hint)
+		*hint = k;
+	return k;
+}
+
+/**
+ * @brief Look up the table at x
+ *
+ * @param t The table
+ * @param x Where to evaluate
+ * @param hint Segment of the last lookup, updated. May be NULL
+ *
+ * @returns The interpolated value, or the end value outside the table
+ */
+double table1d_eval(const table1d *t, double x, int *hint)
+{
+	if (x <= t->x[0])
+		return t->y[0];
+	if (x >= t->x[t->n-1])
+		return t->y[t->n-1];
+
+	int k = table1d_find(t, x, hint);
+	double dx = x - t->x[k];
+
+	if (t->mode == TABLE_LINEAR)
+	{
+		double h = t->uniform ? t->inv_dx : 1.0 / (t->x[k+1] - t->x[k]);
+		return t->y[k] + (t->y[k+1] - t->y[k]) * (dx * h);
+	}
+
+	const double *c = &t->coef[3*k];
+	return t->y[k] + dx*(c[0] + dx*(c[1] + dx*c[2]));
+}
@@ -0,0 +1,10 @@
+/**
+ * Coefficients, in doubles, a cubic table of n breakpoints needs. Linear
+ * tables need none.
+ */
+#define TABLE_COEF_SIZE(n) (3*((n)-1))
+
+int table1d_init(table1d *t, const double *x, const double *y, int n, table_mode mode,
+	double *coef);
+int table1d_find(const table1d *t, double x, int *hint);
+double table1d_eval(const table1d *t, double x, int *hint);
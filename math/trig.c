@@ -0,0 +1,10 @@
+/**
+ * Trig for vector loops
+ *
+ * See trig.h, the functions are inline there and these are their external
+ * definitions.
+ */
+#include "trig.h"
+
+extern void trig_sincos(double x, double *s, double *c);
+extern double trig_atan2(double y, double x);
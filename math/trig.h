@@ -0,0 +1,81 @@
+#include <math.h>
+
+/**
+ * sin, cos and atan2 written only with +, *, / and compares, so that loops
+ * over arrays of them vectorize (see the *_columns() transforms in
+ * utils/coord.c). Inline for that reason; trig.c has the external
+ * definitions.
+ *
+ * Error against the correctly rounded result, checked over dense grids:
+ *   trig_sincos   under 4e-16 absolute for |x| < 1e5
+ *   trig_atan2    under 5e-16 absolute (radians), everywhere
+ * Larger |x| loses accuracy in the range reduction; past 1.6e6 it is wrong.
+ */
+
+/**
+ * 1.5 * 2^52: adding and subtracting it rounds a double to an integer
+ */
+#define TRIG_ROUND 6755399441055744.0
+
+/**
+ * sin(x) and cos(x)
+ *
+ * x less the nearest multiple k of pi/2 (pi/2 in three parts, Cody-Waite),
+ * then the fdlibm kernel polynomials on [-pi/4, pi/4] and k mod 4 to swap
+ * and negate them.
+ */
+inline void trig_sincos(double x, double *s, double *c)
+{
+	double k = (x * 0.63661977236758134308 + TRIG_ROUND) - TRIG_ROUND;
+	double r = ((x - k * 1.57079632673412561417e+00) - k * 6.07710050630396597660e-11)
+	           - k * 2.02226624879595063154e-21;
+	double z = r * r;
+	double sr = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03
+	            + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06
+	            + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+	double cr = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02
+	            + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05
+	            + z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09
+	            + z * -1.13596475577881948265e-11)))));
+
+	// k mod 4 as -2 ... 2
+	double q = k - 4.0 * ((k * 0.25 + TRIG_ROUND) - TRIG_ROUND);
+	int swap = (q * q == 1.0);
+	double sv = swap ? cr : sr;
+	double cv = swap ? sr : cr;
+
+	*s = (q < -0.5 || q > 1.5) ? -sv : sv;
+	*c = (q > 0.5 || q < -1.5) ? -cv : cv;
+}
+
+/**
+ * atan2(y, x), zeros and their signs as in C99
+ *
+ * atan of a = min(|x|, |y|) / max(|x|, |y|) from the Cephes rational
+ * approximation (with atan(a) = pi/4 + atan((a-1)/(a+1)) above 0.66), then
+ * reflected into the right octant.
+ */
+inline double trig_atan2(double y, double x)
+{
+	double ax = fabs(x), ay = fabs(y);
+	double hi = ax > ay ? ax : ay;
+	double lo = ax > ay ? ay : ax;
+	// a = lo / hi, or (a-1)/(a+1) straight from lo and hi, with big 0 or 1
+	// rather than a branch so that there is only the one division
+	double big = (lo > 0.66 * hi);
+	double den = hi + big * lo;
+	double t = (lo - big * hi) / (den + (den == 0));
+	double z = t * t;
+	double p = (((-8.750608600031904122785e-1 * z - 1.615753718733365076637e1) * z
+	           - 7.500855792314704667340e1) * z - 1.228866684490136173410e2) * z
+	           - 6.485021904942025371773e1;
+	double q = ((((z + 2.485846490142306297962e1) * z + 1.650270098316988542046e2) * z
+	           + 4.328810604912902668951e2) * z + 4.853903996359136964868e2) * z
+	           + 1.945506571482613964425e2;
+	double r = t + t * (z * p / q);
+
+	r = big ? 0.78539816339744830962 + (r + 3.061616997868382943065e-17) : r;
+	r = ay > ax ? 1.57079632679489661923 - r : r;
+	r = copysign(1.0, x) < 0 ? 3.14159265358979323846 - r : r;
+	return copysign(r, y);
+}
@@ -14,39 +14,12 @@
 #include "vector.h"
 
 /**
- * norm
+ * norm, unit_vec and vec_scale are inline in vector.h, these are their
+ * external definitions
  */
-double norm(vec v)
-{
-  double n;
-  n = sqrt( (v.v.i*v.v.i) + (v.v.j*v.v.j) + (v.v.k*v.v.k) );
-  return n;
-}
-
-/**
- * unit_vec
- */
-vec unit_vec(vec v)
-{
-  //int i;
-  double magnitude;
-  vec unitVector;
-    
-  magnitude = norm(v);
-  
-  if (magnitude == 0)
-  {
-    unitVector.v.i = 0.0;
-    unitVector.v.j = 0.0;
-    unitVector.v.k = 0.0;
-    return unitVector;
-  }
-  unitVector.v.i = v.v.i / magnitude;
-  unitVector.v.j = v.v.j / magnitude;
-  unitVector.v.k = v.v.k / magnitude;
-  
-  return unitVector;
-}
+extern double norm(vec v);
+extern vec unit_vec(vec v);
+extern vec vec_scale(vec v, double s);
 
 /**
  * Dot Product
@@ -63,18 +36,19 @@ double dot_prod(vec a, vec b)
 }
 
 /**
- * Scale a vector; multiply a vector by a scalar
+ * Cross Product
  */
-vec vec_scale(vec v, double s)
+vec cross_prod(vec a, vec b)
 {
-  vec scaled;
+  vec cross;
   
-  scaled.v.i = v.v.i * s;
-  scaled.v.j = v.v.j * s;
-  scaled.v.k = v.v.k * s;
+  cross.v.i = a.v.j*b.v.k - a.v.k*b.v.j;
+  cross.v.j = a.v.k*b.v.i - a.v.i*b.v.k;
+  cross.v.k = a.v.i*b.v.j - a.v.j*b.v.i;
   
-  return scaled;
+  return cross;
 }
+
 /**
  * Vector times Matrix
  */
@@ -97,6 +71,22 @@ vec matrix_mult(mat3 m, vec v)
   return ans;
 }
 
+/**
+ * Transpose of the matrix times vector, for a rotation matrix its inverse
+ */
+vec matrix_mult_transpose(mat3 m, vec v)
+{
+  vec ans;
+  int i;
+
+  for (i=0;i<3;i++)
+    ans.component[i] = m.component[0][i] * v.component[0]
+                     + m.component[1][i] * v.component[1]
+                     + m.component[2][i] * v.component[2];
+
+  return ans;
+}
+
 /** 
  * Convert an axis angle to an equivalent rotation matrix
  *
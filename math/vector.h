@@ -1,13 +1,49 @@
+#include <math.h>
+
+/**
+ * The small helpers every RHS call goes through are defined here, inline, so
+ * that they can be inlined into the models and the kernels (physics/kernels.c).
+ * vector.c has the external definitions.
+ */
+
 /**
  * norm
  */
-double norm(vec v);
+inline double norm(vec v)
+{
+  return sqrt( (v.v.i*v.v.i) + (v.v.j*v.v.j) + (v.v.k*v.v.k) );
+}
 
 /**
- * unit_vec
+ * unit_vec, the zero vector for the zero vector
  */
-vec unit_vec(vec v);
-vec vec_scale(vec v, double s);
+inline vec unit_vec(vec v)
+{
+  double magnitude = norm(v);
+  vec unitVector = {{0.0, 0.0, 0.0}};
+
+  if (magnitude == 0)
+    return unitVector;
+  unitVector.v.i = v.v.i / magnitude;
+  unitVector.v.j = v.v.j / magnitude;
+  unitVector.v.k = v.v.k / magnitude;
+  return unitVector;
+}
+
+/**
+ * Scale a vector; multiply a vector by a scalar
+ */
+inline vec vec_scale(vec v, double s)
+{
+  vec scaled;
+  scaled.v.i = v.v.i * s;
+  scaled.v.j = v.v.j * s;
+  scaled.v.k = v.v.k * s;
+  return scaled;
+}
+
 double dot_prod(vec a, vec b);
+vec cross_prod(vec a, vec b);
 vec matrix_mult(mat3 m, vec v);
+vec matrix_mult_transpose(mat3 m, vec v);
 mat3 axis_angle_to_rotation_matrix(vec axis_angle);
@@ -0,0 +1,250 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Monte Carlo dispersion engine
+ *
+ * @section DESCRIPTION
+ *
+ * Flies many perturbed copies of a nominal rocket on a work-stealing thread
+ * pool and keeps only a small summary of each flight; no trajectory is ever
+ * held in memory.
+ *
+ * Every sample draws its random numbers from a generator seeded by the sample
+ * index, so results do not depend on which thread ran what.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "libsim_types.h"
+#include "libsim.h"
+#include "math/vector.h"
+#include "math/quaternion.h"
+#include "math/runge-kutta.h"
+#include "physics/physics.h"
+#include "physics/models/earth.h"
+#include "utils/coord.h"
+#include "utils/sink.h"
+#include "utils/threadpool.h"
+#include "montecarlo.h"
+
+/**
+ * Everything a sample task needs, shared read-only between tasks
+ */
+typedef struct {
+	const sim_context *nominal;
+	rocket r;
+	state initial_conditions;
+	const dispersion *disp;
+	mc_result *results;
+} mc_job;
+
+typedef struct {
+	const mc_job *job;
+	int index;
+} mc_task;
+
+/**
+ * splitmix64, small and good enough to seed per sample
+ */
+static uint64_t rng_next(uint64_t *s)
+{
+	uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Uniform in (0, 1]
+ */
+static double rng_uniform(uint64_t *s)
+{
+	return ((rng_next(s) >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Standard normal (Box-Muller)
+ */
+static double rng_gauss(uint64_t *s)
+{
+	double u1 = rng_uniform(s);
+	double u2 = rng_uniform(s);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * PI * u2);
+}
+
+/**
+ * Apply the dispersions for sample index to copies of the nominal inputs
+ */
+static void disperse(const sim_context *nominal, rocket *r, state *ic,
+	const dispersion *disp, int index, sim_context *ctx)
+{
+	uint64_t seed = disp->seed ^ ((uint64_t) index * 0xD1B54A32D192ED03ULL);
+
+	*ctx = *nominal;
+
+	// Local frame at the launch site
+	vec up = unit_vec(ic->x);
+	vec z_axis = {.v={0, 0, 1}};
+	vec east = unit_vec(cross_prod(z_axis, up));
+	if (norm(east) == 0)
+		east = (vec) {.v={1, 0, 0}};  // at a pole
+	vec north = cross_prod(up, east);
+
+	// Mass, drag and thrust
+	ic->m *= 1.0 + disp->mass_sigma * rng_gauss(&seed);
+	r->Cd *= 1.0 + disp->Cd_sigma * rng_gauss(&seed);
+	r->thrust.Isp *= 1.0 + disp->thrust_sigma * rng_gauss(&seed);
+
+	// Launch angle: tilt in the vertical plane of the launch axis then rotate
+	// about the local vertical. A vertical launch tilts about east.
+	double d_el = disp->elevation_sigma * rng_gauss(&seed);
+	double d_az = disp->azimuth_sigma * rng_gauss(&seed);
+	vec tilt_axis = unit_vec(cross_prod(up, ctx->launch_axis));
+	if (norm(tilt_axis) == 0)
+		tilt_axis = east;
+	mat3 R_el = axis_angle_to_rotation_matrix(vec_scale(tilt_axis, d_el));
+	mat3 R_az = axis_angle_to_rotation_matrix(vec_scale(up, d_az));
+	ctx->launch_axis = matrix_mult(R_az, matrix_mult(R_el, ctx->launch_axis));
+	ic->v = matrix_mult(R_az, matrix_mult(R_el, ic->v));
+	quat q_el = quat_from_axis_angle(vec_scale(tilt_axis, d_el));
+	quat q_az = quat_from_axis_angle(vec_scale(up, d_az));
+	ctx->initial_attitude.q = quat_normalize(quat_mult(q_az, quat_mult(q_el, ctx->initial_attitude.q)));
+
+	// Wind
+	double w_e = disp->wind_sigma * rng_gauss(&seed);
+	double w_n = disp->wind_sigma * rng_gauss(&seed);
+	ctx->wind.v.i += w_e*east.v.i + w_n*north.v.i;
+	ctx->wind.v.j += w_e*east.v.j + w_n*north.v.j;
+	ctx->wind.v.k += w_e*east.v.k + w_n*north.v.k;
+}
+
+/**
+ * Fill in a result from the summary of a sample, flown unless failed
+ */
+static void finish_sample(const sim_context *ctx, rocket r, state ic,
+	const trajectory_summary *sum, int failed, mc_result *result)
+{
+	memset(result, 0, sizeof(*result));
+	result->mass = ic.m;
+	result->Cd = r.Cd;
+	result->Isp = r.thrust.Isp;
+	result->launch_axis = ctx->launch_axis;
+	result->attitude = ctx->initial_attitude.q;
+	result->wind = ctx->wind;
+	result->stats = ctx->stats;
+
+	// An empty summary has no last state to look at
+	result->failed = failed || sum->count == 0;
+	if (result->failed)
+		return;
+
+	result->apogee = sum->apogee;
+	result->apogee_time = sum->apogee_time;
+	result->impact = sum->last.x;
+	result->impact_time = sum->last_time;
+	// The ground event stops the flight on the ground, not under it
+	result->landed = earth_altitude(ctx->earth, sum->last.x) - GROUND < 1e-3;
+	result->steps = sum->count;
+}
+
+/**
+ * @brief Fly one dispersed sample
+ *
+ * Sample index always produces the same perturbations for the same seed, so
+ * this can be used to re-fly a single interesting sample from a batch.
+ *
+ * @returns 0, or -1 if the sample could not be flown (result->failed)
+ */
+int Monte_Carlo_Sample(const sim_context *nominal, rocket r, state initial_conditions,
+	const dispersion *disp, int index, mc_result *result)
+{
+	sim_context ctx;
+	state ic = initial_conditions;
+	trajectory_sink sink;
+	trajectory_summary sum;
+	int failed;
+
+	disperse(nominal, &r, &ic, disp, index, &ctx);
+	sink_summary(&sink, &sum);
+	sum.earth = ctx.earth;
+	failed = Integrate_Rocket_sink(&ctx, r, ic, &sink) < 0;
+	finish_sample(&ctx, r, ic, &sum, failed, result);
+	return result->failed ? -1 : 0;
+}
+
+static void run_sample(void *arg)
+{
+	mc_task *t = arg;
+	const mc_job *job = t->job;
+
+	Monte_Carlo_Sample(job->nominal, job->r, job->initial_conditions, job->disp,
+		t->index, &job->results[t->index]);
+}
+
+/**
+ * @brief Fly a batch of dispersed flights in parallel
+ *
+ * @param nominal Context holding the models and tolerances every sample uses
+ * @param r The nominal rocket
+ * @param initial_conditions Nominal launch state
+ * @param disp Dispersions to apply
+ * @param samples Number of flights
+ * @param nthreads Worker threads, <= 0 uses every core
+ * @param results Array of samples results, filled in sample order
+ *
+ * @returns 0 on success, -1 if the workers could not be started or a sample
+ * failed (see mc_result.failed)
+ */
+int Monte_Carlo(const sim_context *nominal, rocket r, state initial_conditions,
+	const dispersion *disp, int samples, int nthreads, mc_result *results)
+{
+	int i;
+	mc_job job = { nominal, r, initial_conditions, disp, results };
+	mc_task *tasks;
+	threadpool *pool;
+
+	tasks = malloc(sizeof(mc_task) * samples);
+	if (tasks == NULL)
+		return -1;
+
+	pool = threadpool_create(nthreads);
+	if (pool == NULL)
+	{
+		free(tasks);
+		return -1;
+	}
+
+	for (i=0;i<samples;i++)
+	{
+		tasks[i].job = &job;
+		tasks[i].index = i;
+		if (threadpool_submit(pool, run_sample, &tasks[i]) != 0)
+			run_sample(&tasks[i]);
+	}
+
+	threadpool_wait(pool);
+	threadpool_destroy(pool);
+	free(tasks);
+
+	for (i=0;i<samples;i++)
+		if (results[i].failed)
+			return -1;
+	return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @brief Dispersions applied to every Monte Carlo sample
+ *
+ * All perturbations are gaussian with the given 1-sigma. Fractional sigmas
+ * scale the nominal value, e.g. mass_sigma = 0.02 is a 2% mass dispersion.
+ */
+typedef struct {
+	double mass_sigma;       ///< fraction of nominal initial mass
+	double Cd_sigma;         ///< fraction of nominal Cd
+	double thrust_sigma;     ///< fraction of nominal thrust (applied to Isp)
+	double elevation_sigma;  ///< launch axis tilt, radians
+	double azimuth_sigma;    ///< launch axis rotation about local vertical, radians
+	double wind_sigma;       ///< east and north wind components, m/s
+	unsigned long seed;      ///< same seed, same samples, whatever the thread count
+} dispersion;
+
+/**
+ * @brief Summary of one dispersed flight
+ */
+typedef struct {
+	int failed;              ///< 1 if the sample could not be flown, only the dispersed values below are set
+	double apogee;           ///< maximum altitude, m
+	double apogee_time;      ///< time of maximum altitude, s
+	vec impact;              ///< ECEF position at the end of the flight
+	double impact_time;      ///< time of the last state, s
+	int landed;              ///< 1 if the flight ended on the ground
+	int steps;               ///< number of states in the trajectory
+
+	// The dispersed values this sample flew with
+	double mass;
+	double Cd;
+	double Isp;
+	vec launch_axis;
+	quat attitude;           ///< initial attitude, only flown in 6-DOF
+	vec wind;
+
+	sim_stats stats;         ///< integrator statistics, merge with stats_merge()
+} mc_result;
+
+int Monte_Carlo(const sim_context *nominal, rocket r, state initial_conditions,
+	const dispersion *disp, int samples, int nthreads, mc_result *results);
+int Monte_Carlo_Sample(const sim_context *nominal, rocket r, state initial_conditions,
+	const dispersion *disp, int index, mc_result *result);
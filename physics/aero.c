@@ -8,30 +8,66 @@
 #include <math.h>
 #include "../libsim_types.h"
 #include "../math/vector.h"
-#include "../utils/coord.h"
 #include "aero.h"
 
 /**
 * Drag
 */
-vec drag(state s)
+void drag(const rk_state *s, const atmosphere *air, const sim_context *ctx, vec *f)
 {
   vec d;
-  double v = norm(s.v);
-  vec v_hat = unit_vec(s.v);
-  double h = altitude(s.x);
-  double rho_0 = 1.2041;
-  double k = 0.000115; // A guess
-  double Cd = 1;
-  double A = 0.015;
+  // Drag acts on the velocity relative to the air
+  vec v_air = {.v={ s->v.v.i - ctx->wind.v.i,
+                    s->v.v.j - ctx->wind.v.j,
+                    s->v.v.k - ctx->wind.v.k }};
+  double v = norm(v_air);
+  vec v_hat = unit_vec(v_air);
+  double Cd = ctx->vehicle.Cd;
+  double A = ctx->vehicle.area;
   double calc_drag = 0;
-  double rho = rho_0;
   
-  rho = rho_0*exp(-k*h);
-  
-  calc_drag = -0.5*rho*v*v*A*Cd;
+  calc_drag = -0.5*air->density*v*v*A*Cd;
   
   d = vec_scale(v_hat, calc_drag);
-  
-  return d;
+  f->v.i += d.v.i;
+  f->v.j += d.v.j;
+  f->v.k += d.v.k;
+}
+
+/**
+ * Drag and normal force in body axes, for 6-DOF
+ *
+ * Each force opposes its own component of the airflow: Cd along the body
+ * axis and CN_alpha across it, so with no angle of attack this is drag().
+ * The normal force acts at the centre of pressure, rigid_body.cp behind the
+ * CG, and the pitch and yaw rates are damped through Cmq.
+ */
+void drag_body(const rk_state *s, const body_frame *b, const atmosphere *air,
+  const sim_context *ctx, vec *f, vec *moment)
+{
+  const rigid_body *body = &ctx->vehicle.body;
+  vec v_air = {.v={ s->v.v.i - ctx->wind.v.i,
+                    s->v.v.j - ctx->wind.v.j,
+                    s->v.v.k - ctx->wind.v.k }};
+  vec v_body = matrix_mult_transpose(b->dcm, v_air);
+  double v = norm(v_body);
+  vec F, d;
+
+  if (v == 0)
+    return;
+
+  double qA = 0.5*air->density*v*ctx->vehicle.area;
+  F.v.i = -qA*ctx->vehicle.Cd*v_body.v.i;
+  F.v.j = -qA*body->CN_alpha*v_body.v.j;
+  F.v.k = -qA*body->CN_alpha*v_body.v.k;
+
+  d = matrix_mult(b->dcm, F);
+  f->v.i += d.v.i;
+  f->v.j += d.v.j;
+  f->v.k += d.v.k;
+
+  // (-cp, 0, 0) x F, plus damping
+  double damp = 0.5*qA*body->diameter*body->diameter*body->Cmq;
+  moment->v.j += body->cp*F.v.k + damp*b->omega.v.j;
+  moment->v.k += -body->cp*F.v.j + damp*b->omega.v.k;
 }
@@ -5,4 +5,6 @@
  /**
  * Drag
  */
-vec drag(state s);
+void drag(const rk_state *s, const atmosphere *air, const sim_context *ctx, vec *f);
+void drag_body(const rk_state *s, const body_frame *b, const atmosphere *air,
+	const sim_context *ctx, vec *f, vec *moment);
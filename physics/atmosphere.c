@@ -0,0 +1,170 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief U.S. Standard Atmosphere, 1976
+ *
+ * @section DESCRIPTION
+ *
+ * The seven layers of the 1976 standard below 86 km, where temperature is
+ * linear in geopotential height and the air is well mixed. Evaluating the
+ * model needs pow() or exp(), so atmosphere_init() samples it once onto evenly
+ * spaced tables and atmosphere_at() only interpolates them.
+ *
+ * Only temperature and pressure are tabulated, against geopotential height so
+ * that the corners between layers are breakpoints: temperature is then exact
+ * with linear interpolation. Density and speed of sound follow from the two
+ * with a division and a square root.
+ *
+ * Above the top of the tables density and pressure fall off exponentially
+ * with the scale height there; temperature is held.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include "../libsim_types.h"
+#include "../math/table.h"
+#include "models/earth.h"
+#include "atmosphere.h"
+
+/// Gas constant for air, J/(kg K)
+#define R_AIR 287.0531
+/// Ratio of specific heats for air
+#define GAMMA_AIR 1.4
+/// Earth radius used for geopotential height, m
+#define R_GEOPOTENTIAL 6356766.0
+
+/// Breakpoints from ATMOSPHERE_BOTTOM to ATMOSPHERE_TOP every ATMOSPHERE_STEP
+#define ATMOSPHERE_N 901
+
+// Layer bases, geopotential m, and lapse rates, K/m
+static const double layer_base[] = { 0, 11000, 20000, 32000, 47000, 51000, 71000 };
+static const double layer_lapse[] = { -0.0065, 0, 0.001, 0.0028, 0, -0.0028, -0.002 };
+#define LAYERS 7
+
+// Tables, against geopotential height
+static double table_h[ATMOSPHERE_N];
+static double table_T[ATMOSPHERE_N], table_p[ATMOSPHERE_N];
+static double coef_p[TABLE_COEF_SIZE(ATMOSPHERE_N)];
+static table1d temperature, pressure;
+static atmosphere top;
+static double top_scale;
+static pthread_once_t built = PTHREAD_ONCE_INIT;
+
+static atmosphere layers(double H);
+
+/**
+ * @brief Evaluate the standard directly
+ *
+ * Slow, every call works up through the layers. Used to build the tables.
+ *
+ * @param h Geometric altitude, m. Below the first layer its lapse rate is
+ * carried on down
+ */
+atmosphere atmosphere_us76(double h)
+{
+	return layers(R_GEOPOTENTIAL * h / (R_GEOPOTENTIAL + h));
+}
+
+/**
+ * The standard at geopotential height H, m
+ */
+static atmosphere layers(double H)
+{
+	atmosphere air;
+	double T = 288.15, p = 101325.0;
+	int i;
+
+	for (i=0;i<LAYERS;i++)
+	{
+		double top_H = (i+1 < LAYERS) ? layer_base[i+1] : HUGE_VAL;
+		double dH = ((H < top_H) ? H : top_H) - layer_base[i];
+		double L = layer_lapse[i];
+
+		if (L == 0)
+			p *= exp(-g_0 * dH / (R_AIR * T));
+		else
+			p *= pow(T / (T + L*dH), g_0 / (R_AIR * L));
+		T += L*dH;
+
+		if (H < top_H)
+			break;
+	}
+
+	air.temperature = T;
+	air.pressure = p;
+	air.density = p / (R_AIR * T);
+	air.speed_of_sound = sqrt(GAMMA_AIR * R_AIR * T);
+	return air;
+}
+
+static void build_tables(void)
+{
+	int i;
+
+	for (i=0;i<ATMOSPHERE_N;i++)
+	{
+		table_h[i] = ATMOSPHERE_BOTTOM + i*ATMOSPHERE_STEP;
+		atmosphere air = layers(table_h[i]);
+		table_T[i] = air.temperature;
+		table_p[i] = air.pressure;
+	}
+
+	// Temperature is piecewise linear. Pressure has a continuous slope
+	// (dp/dH = -rho g), which a monotone cubic follows closely
+	table1d_init(&temperature, table_h, table_T, ATMOSPHERE_N, TABLE_LINEAR, NULL);
+	table1d_init(&pressure, table_h, table_p, ATMOSPHERE_N, TABLE_MONOTONE, coef_p);
+
+	top = layers(ATMOSPHERE_TOP);
+	top_scale = R_AIR * top.temperature / g_0;
+}
+
+/**
+ * @brief Build the tables
+ *
+ * Called by Init_Context(). Only the first call does anything, and it is safe
+ * to call from several threads at once.
+ */
+void atmosphere_init(void)
+{
+	pthread_once(&built, build_tables);
+}
+
+/**
+ * @brief Look up the atmosphere, atmosphere_init() must have been called
+ *
+ * @param h Geometric altitude, m
+ */
+atmosphere atmosphere_at(double h)
+{
+	atmosphere air;
+	double H = R_GEOPOTENTIAL * h / (R_GEOPOTENTIAL + h);
+
+	if (H > ATMOSPHERE_TOP)
+	{
+		double f = exp(-(H - ATMOSPHERE_TOP) / top_scale);
+		air = top;
+		air.pressure *= f;
+		air.density *= f;
+		return air;
+	}
+
+	air.temperature = table1d_eval(&temperature, H, NULL);
+	air.pressure = table1d_eval(&pressure, H, NULL);
+	air.density = air.pressure / (R_AIR * air.temperature);
+	air.speed_of_sound = sqrt(GAMMA_AIR * R_AIR * air.temperature);
+	return air;
+}
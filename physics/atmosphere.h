@@ -0,0 +1,15 @@
+/**
+ * Bottom and top of the tables, geopotential altitude in m. The standard
+ * stops at 86 km geometric, 84852 m geopotential.
+ */
+#define ATMOSPHERE_BOTTOM -5000.0
+#define ATMOSPHERE_TOP    85000.0
+
+/**
+ * Table spacing, geopotential m. Every layer boundary falls on a breakpoint.
+ */
+#define ATMOSPHERE_STEP 100.0
+
+void atmosphere_init(void);
+atmosphere atmosphere_at(double h);
+atmosphere atmosphere_us76(double h);
@@ -9,28 +9,265 @@
  * Includes
  */
 #include <stdio.h>
+#include <math.h>
+#include <pthread.h>
 #include "../libsim_types.h"
 #include "../math/vector.h"
 #include "models/earth.h"
 #include "gravity.h"
 
+/**
+ * EGM96, fully normalized, through degree and order 4. Index with
+ * GRAVITY_INDEX(n, m).
+ */
+static const double egm96_C[GRAVITY_SIZE(4)] = {
+	1, 0, 0,
+	-4.84165371736e-4, -1.86987635955e-10, 2.43938357328e-6,
+	9.57254173792e-7, 2.03046201047e-6, 9.04787894809e-7, 7.21321757121e-7,
+	5.39873863789e-7, -5.36157389388e-7, 3.50501623962e-7, 9.90856766672e-7,
+	-1.88519633023e-7,
+};
+static const double egm96_S[GRAVITY_SIZE(4)] = {
+	0, 0, 0,
+	0, 1.19528012031e-9, -1.40027370385e-6,
+	0, 2.48200415856e-7, -6.19005475177e-7, 1.41434926192e-6,
+	0, -4.73567346518e-7, 6.62480026275e-7, -2.00956723567e-7,
+	3.08803882149e-7,
+};
+
+static gravity_field egm96;
+static pthread_once_t built = PTHREAD_ONCE_INIT;
+
 /**
  * Gravity
  */
-vec gravity_sphere(state s)
+void gravity_sphere(const rk_state *s, const sim_context *ctx, vec *f)
 {
-  vec g,e;
+  vec e;
   double calc_gravity;
-  double r = norm(s.x);
+  double r = norm(s->x);
   
+  (void) ctx;
+
   // G Mm/r^2
-  calc_gravity = G * ( (MASS_EARTH * s.m)/(r*r) );
+  calc_gravity = G * ( (MASS_EARTH * s->m)/(r*r) );
   
   // Direction of gravity vector
-  e = unit_vec(s.x);
-  g.v.i = calc_gravity * e.v.i;
-  g.v.j = calc_gravity * e.v.j;
-  g.v.k = calc_gravity * e.v.k;
-  
-  return g;
+  e = unit_vec(s->x);
+  f->v.i += calc_gravity * e.v.i;
+  f->v.j += calc_gravity * e.v.j;
+  f->v.k += calc_gravity * e.v.k;
+}
+
+/**
+ * @brief Point mass plus the J2 zonal, in closed form
+ *
+ * The fast path for when the oblateness is all that matters: J2 is taken from
+ * ctx->gravity_field, which is otherwise not looked at.
+ */
+void gravity_j2(const rk_state *s, const sim_context *ctx, vec *f)
+{
+  const gravity_field *g = ctx->gravity_field;
+  double x = s->x.v.i, y = s->x.v.j, z = s->x.v.k;
+  double r2 = x*x + y*y + z*z;
+  double r = sqrt(r2);
+  double J2 = -sqrt(5.0) * g->C[GRAVITY_INDEX(2, 0)];
+  double zz = 5.0 * z*z / r2;
+  double k = 1.5 * J2 * g->radius*g->radius / r2;
+
+  // -mu m/r^3, and the J2 terms on top of it
+  double a = -g->mu * s->m / (r2*r);
+  double axy = a * (1.0 + k*(1.0 - zz));
+  double az = a * (1.0 + k*(3.0 - zz));
+
+  f->v.i += axy * x;
+  f->v.j += axy * y;
+  f->v.k += az * z;
+}
+
+/**
+ * @brief Highest degree worth evaluating at radius r
+ *
+ * ctx->gravity_degree, or less where the higher degrees have fallen below
+ * ctx->gravity_tol of the point mass term: degree n falls off as (R/r)^n.
+ */
+int gravity_degree_at(const sim_context *ctx, double r)
+{
+  const gravity_field *g = ctx->gravity_field;
+  int n = ctx->gravity_degree < g->degree ? ctx->gravity_degree : g->degree;
+  double q, qn;
+
+  if (ctx->gravity_tol <= 0 || n < 1)
+    return n;
+
+  q = g->radius / r;
+  qn = pow(q, n);
+  while (n > 0 && g->size[n] * qn < ctx->gravity_tol)
+  {
+    n--;
+    qn /= q;
+  }
+  return n;
+}
+
+/**
+ * @brief Spherical harmonic gravity to degree and order
+ * gravity_degree_at() from ctx->gravity_field
+ *
+ * Uses the fully normalized form of Cunningham's recursion (as laid out by
+ * Montenbruck & Gill, Satellite Orbits 3.2.4) for the solid harmonics
+ *
+ *   V(n, m) + i W(n, m) = (R/r)^(n+1) Pnm(sin lat) e^(i m lon)
+ *
+ * which needs no trigonometry and is stable: each term is built from
+ * lower ones with factors of order one. Position is ECEF, and so is the
+ * force.
+ */
+void gravity_harmonic(const rk_state *s, const sim_context *ctx, vec *f)
+{
+  const gravity_field *g = ctx->gravity_field;
+  double V[GRAVITY_SIZE(GRAVITY_DEGREE_MAX + 1)], W[GRAVITY_SIZE(GRAVITY_DEGREE_MAX + 1)];
+  double x = s->x.v.i, y = s->x.v.j, z = s->x.v.k;
+  double r2 = x*x + y*y + z*z;
+  double R = g->radius;
+  double x0 = x*R/r2, y0 = y*R/r2, z0 = z*R/r2, rho = R*R/r2;
+  double ax = 0, ay = 0, az = 0, scale;
+  int N = gravity_degree_at(ctx, sqrt(r2));
+  int n, m;
+
+  /// V and W to degree N + 1, column by column
+  V[0] = R / sqrt(r2);
+  W[0] = 0;
+  for (m=0;m<=N+1;m++)
+  {
+    int mm = GRAVITY_INDEX(m, m);
+    if (m > 0)
+    {
+      int pp = GRAVITY_INDEX(m-1, m-1);
+      V[mm] = g->gamma[m] * (x0*V[pp] - y0*W[pp]);
+      W[mm] = g->gamma[m] * (x0*W[pp] + y0*V[pp]);
+    }
+    if (m + 1 <= N + 1)
+    {
+      int k = GRAVITY_INDEX(m+1, m);
+      V[k] = g->alpha[k] * z0 * V[mm];
+      W[k] = g->alpha[k] * z0 * W[mm];
+    }
+    for (n=m+2;n<=N+1;n++)
+    {
+      int k = GRAVITY_INDEX(n, m), k1 = GRAVITY_INDEX(n-1, m), k2 = GRAVITY_INDEX(n-2, m);
+      V[k] = g->alpha[k] * z0 * V[k1] - g->beta[k] * rho * V[k2];
+      W[k] = g->alpha[k] * z0 * W[k1] - g->beta[k] * rho * W[k2];
+    }
+  }
+
+  /// Sum the accelerations, smallest (highest degree) first
+  for (n=N;n>=0;n--)
+  {
+    for (m=0;m<=n;m++)
+    {
+      int k = GRAVITY_INDEX(n, m);
+      int up = GRAVITY_INDEX(n+1, m+1), mid = GRAVITY_INDEX(n+1, m);
+      double C = g->C[k], S = g->S[k];
+
+      if (m == 0)
+      {
+        ax -= g->k_up[k] * C * V[up];
+        ay -= g->k_up[k] * C * W[up];
+      }
+      else
+      {
+        int down = GRAVITY_INDEX(n+1, m-1);
+        ax += 0.5 * (g->k_up[k] * (-C*V[up] - S*W[up])
+                     + g->k_down[k] * (C*V[down] + S*W[down]));
+        ay += 0.5 * (g->k_up[k] * (-C*W[up] + S*V[up])
+                     + g->k_down[k] * (-C*W[down] + S*V[down]));
+      }
+      az += g->k_z[k] * (-C*V[mid] - S*W[mid]);
+    }
+  }
+
+  scale = g->mu * s->m / (R*R);
+  f->v.i += scale * ax;
+  f->v.j += scale * ay;
+  f->v.k += scale * az;
+}
+
+/**
+ * @brief Set up a field from fully normalized coefficients
+ *
+ * @param g The field
+ * @param degree Highest degree, at most GRAVITY_DEGREE_MAX
+ * @param mu Gravitational parameter, m^3/s^2
+ * @param radius Reference radius of the coefficients, m
+ * @param C, S Normalized coefficients to degree, by GRAVITY_INDEX(n, m).
+ * C(0, 0) should be 1 and degree 1 zero (origin at the centre of mass).
+ *
+ * @returns 0, or -1 if degree is out of range
+ */
+int gravity_field_init(gravity_field *g, int degree, double mu, double radius,
+  const double *C, const double *S)
+{
+  int n, m;
+
+  if (degree < 0 || degree > GRAVITY_DEGREE_MAX)
+    return -1;
+
+  g->degree = degree;
+  g->mu = mu;
+  g->radius = radius;
+
+  for (n=0;n<=degree;n++)
+  {
+    double sum = 0;
+    for (m=0;m<=n;m++)
+    {
+      int k = GRAVITY_INDEX(n, m);
+      double d0 = (m == 0) ? 1.0 : 2.0;           // 2 - delta(m, 0)
+      double d1 = (m == 1) ? 2.0 : 1.0;           // (2 - delta(m, 0))/(2 - delta(m-1, 0))
+      double q = (2.0*n + 1) / (2.0*n + 3);
+
+      g->C[k] = C[k];
+      g->S[k] = S[k];
+      g->k_up[k] = sqrt(0.5 * d0 * q * (n+m+1) * (n+m+2));
+      g->k_down[k] = (m > 0) ? sqrt(d1 * q * (n-m+1) * (n-m+2)) : 0;
+      g->k_z[k] = sqrt(q * (n+m+1) * (n-m+1));
+      sum += sqrt(C[k]*C[k] + S[k]*S[k]);
+    }
+    // Normalized Pnm and their slopes grow like sqrt(2n + 1) and n
+    g->size[n] = (n + 1) * sqrt(2.0*n + 1) * sum;
+  }
+
+  for (n=0;n<=degree+1;n++)
+  {
+    for (m=0;m<n;m++)
+    {
+      int k = GRAVITY_INDEX(n, m);
+      g->alpha[k] = sqrt((2.0*n + 1) * (2.0*n - 1) / ((n - m) * (double) (n + m)));
+      g->beta[k] = (n >= 2) ? sqrt((2.0*n + 1) * (n + m - 1) * (n - m - 1)
+                                   / ((2.0*n - 3) * (n + m) * (double) (n - m))) : 0;
+    }
+    g->alpha[GRAVITY_INDEX(n, n)] = 0;
+    g->beta[GRAVITY_INDEX(n, n)] = 0;
+    g->gamma[n] = (n == 0) ? 1 : (n == 1) ? sqrt(3.0) : sqrt((2.0*n + 1) / (2.0*n));
+  }
+
+  return 0;
+}
+
+static void build_egm96(void)
+{
+  // Same mu as gravity_sphere(), so the harmonics only add to it
+  gravity_field_init(&egm96, 4, -G * MASS_EARTH, EGM96_RADIUS, egm96_C, egm96_S);
+}
+
+/**
+ * @brief The built in field: EGM96 to degree and order 4
+ *
+ * Built on the first call, safe to call from several threads at once.
+ */
+const gravity_field *gravity_egm96(void)
+{
+  pthread_once(&built, build_egm96);
+  return &egm96;
 }
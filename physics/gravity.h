@@ -6,4 +6,14 @@
 /**
  * Gravity
  */
-vec gravity_sphere(state s);
+void gravity_sphere(const rk_state *s, const sim_context *ctx, vec *f);
+void gravity_j2(const rk_state *s, const sim_context *ctx, vec *f);
+void gravity_harmonic(const rk_state *s, const sim_context *ctx, vec *f);
+int gravity_degree_at(const sim_context *ctx, double r);
+
+/**
+ * Fields
+ */
+int gravity_field_init(gravity_field *g, int degree, double mu, double radius,
+	const double *C, const double *S);
+const gravity_field *gravity_egm96(void);
@@ -0,0 +1,228 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Two-body coast
+ *
+ * @section DESCRIPTION
+ *
+ * Closed form motion under point mass gravity alone, which is what
+ * physics() computes for a vehicle above the air once the motor is out.
+ *
+ * kepler_at() uses universal variables (Bate, Mueller & White ch. 4;
+ * Vallado's algorithm 8): Newton's method on the universal anomaly chi, to
+ * KEPLER_TOL in at most KEPLER_MAXITER iterations, for ellipses, parabolas
+ * and hyperbolas alike, then the Lagrange f and g coefficients. The times of
+ * apoapsis and of coming down through a radius are found directly from the
+ * eccentric anomaly, elliptic orbits only.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../math/vector.h"
+#include "kepler.h"
+
+#define KEPLER_MAXITER 50
+#define KEPLER_TOL 1e-14
+
+/**
+ * Stumpff functions C(z) and S(z), by series near zero where the closed forms
+ * cancel
+ */
+static void stumpff(double z, double *c, double *s)
+{
+	if (z > 0.1)
+	{
+		double sz = sqrt(z);
+		*c = (1.0 - cos(sz)) / z;
+		*s = (sz - sin(sz)) / (sz*z);
+	}
+	else if (z < -0.1)
+	{
+		double sz = sqrt(-z);
+		*c = (cosh(sz) - 1.0) / (-z);
+		*s = (sinh(sz) - sz) / (sz*(-z));
+	}
+	else
+	{
+		*c = 1.0/2 - z*(1.0/24 - z*(1.0/720 - z*(1.0/40320 - z*(1.0/3628800 - z/479001600.0))));
+		*s = 1.0/6 - z*(1.0/120 - z*(1.0/5040 - z*(1.0/362880 - z*(1.0/39916800 - z/6227020800.0))));
+	}
+}
+
+/**
+ * @brief The orbit through a position and velocity
+ *
+ * @param k Orbit to fill in
+ * @param r0 Position at t0, m
+ * @param v0 Velocity at t0, m/s
+ * @param t0 Time of r0 and v0
+ * @param mu Gravitational parameter of the central body, m^3/s^2
+ */
+void kepler_init(kepler_orbit *k, vec r0, vec v0, double t0, double mu)
+{
+	double v2 = dot_prod(v0, v0);
+
+	k->r0 = r0;
+	k->v0 = v0;
+	k->t0 = t0;
+	k->mu = mu;
+	k->sqrt_mu = sqrt(mu);
+	k->r0n = norm(r0);
+	k->sigma0 = dot_prod(r0, v0) / k->sqrt_mu;
+	// From the energy: 1/a = 2/r - v^2/mu
+	k->alpha = 2.0 / k->r0n - v2 / mu;
+}
+
+/**
+ * @brief Position and velocity on the orbit at any time
+ *
+ * @param k The orbit
+ * @param t Time, before or after k->t0
+ * @param r Position at t
+ * @param v Velocity at t
+ *
+ * @returns 0, or -1 if the universal anomaly did not converge (r and v are
+ * still filled in from the last iterate)
+ */
+int kepler_at(const kepler_orbit *k, double t, vec *r, vec *v)
+{
+	int i, ret = -1;
+	double dt = t - k->t0;
+	double chi, chi2, z, c, s, rn;
+	double f, g, fdot, gdot;
+
+	// First guess: exact for a circle, and for a straight line
+	if (k->alpha > 0)
+		chi = k->sqrt_mu * k->alpha * dt;
+	else
+		chi = k->sqrt_mu * dt / k->r0n;
+
+	/// Newton on the universal Kepler equation, its derivative is r
+	for (i=0;i<KEPLER_MAXITER;i++)
+	{
+		chi2 = chi*chi;
+		z = k->alpha * chi2;
+		stumpff(z, &c, &s);
+		rn = chi2*c + k->sigma0*chi*(1.0 - z*s) + k->r0n*(1.0 - z*c);
+		double err = chi2*chi*s + k->sigma0*chi2*c + k->r0n*chi*(1.0 - z*s) - k->sqrt_mu*dt;
+		double dchi = err / rn;
+		chi -= dchi;
+		if (fabs(dchi) <= KEPLER_TOL * (1.0 + fabs(chi)))
+		{
+			ret = 0;
+			break;
+		}
+	}
+
+	chi2 = chi*chi;
+	z = k->alpha * chi2;
+	stumpff(z, &c, &s);
+	rn = chi2*c + k->sigma0*chi*(1.0 - z*s) + k->r0n*(1.0 - z*c);
+
+	/// Lagrange coefficients
+	f = 1.0 - chi2*c / k->r0n;
+	g = dt - chi2*chi*s / k->sqrt_mu;
+	fdot = k->sqrt_mu / (rn * k->r0n) * chi * (z*s - 1.0);
+	gdot = 1.0 - chi2*c / rn;
+
+	r->v.i = f*k->r0.v.i + g*k->v0.v.i;
+	r->v.j = f*k->r0.v.j + g*k->v0.v.j;
+	r->v.k = f*k->r0.v.k + g*k->v0.v.k;
+	v->v.i = fdot*k->r0.v.i + gdot*k->v0.v.i;
+	v->v.j = fdot*k->r0.v.j + gdot*k->v0.v.j;
+	v->v.k = fdot*k->r0.v.k + gdot*k->v0.v.k;
+
+	return ret;
+}
+
+/**
+ * Eccentricity and eccentric anomaly at t0 of an elliptic orbit
+ */
+static double eccentric_anomaly(const kepler_orbit *k, double *e)
+{
+	double ecosE = 1.0 - k->r0n * k->alpha;
+	double esinE = k->sigma0 * sqrt(k->alpha);
+
+	*e = sqrt(ecosE*ecosE + esinE*esinE);
+	return atan2(esinE, ecosE);
+}
+
+/**
+ * Time from eccentric anomaly E0 to E, mean motion sqrt(mu/a^3)
+ */
+static double kepler_time(const kepler_orbit *k, double e, double E0, double E)
+{
+	double n = k->sqrt_mu * k->alpha * sqrt(k->alpha);
+	return ((E - e*sin(E)) - (E0 - e*sin(E0))) / n;
+}
+
+/**
+ * @brief Time from t0 to the next apoapsis, before the next periapsis
+ *
+ * @returns Seconds after k->t0, 0 at apoapsis, or -1 if the orbit is not an
+ * ellipse or is already on its way down
+ */
+double kepler_time_to_apoapsis(const kepler_orbit *k)
+{
+	double e, E0;
+
+	if (k->alpha <= 0)
+		return -1;
+
+	E0 = eccentric_anomaly(k, &e);
+	if (e == 0 || E0 < 0)
+		return -1;
+
+	return kepler_time(k, e, E0, PI);
+}
+
+/**
+ * @brief Time from t0 until the orbit comes down through a radius
+ *
+ * @param k The orbit
+ * @param radius Distance from the centre of the body, m
+ *
+ * @returns Seconds after k->t0, 0 if already below radius and falling, or -1
+ * if it never happens: not an ellipse, or the ellipse does not reach radius
+ */
+double kepler_time_to_radius(const kepler_orbit *k, double radius)
+{
+	double e, E0, E, cosE;
+
+	if (k->alpha <= 0)
+		return -1;
+
+	E0 = eccentric_anomaly(k, &e);
+	if (e == 0)
+		return -1;
+
+	// r = a(1 - e cos E)
+	cosE = (1.0 - radius * k->alpha) / e;
+	if (cosE > 1.0 || cosE < -1.0)
+		return -1;
+
+	/// The falling crossing is at -pi < E < 0, one orbit on if we are climbing
+	E = -acos(cosE);
+	if (E < E0)
+	{
+		if (E0 < 0)
+			return 0;
+		E += 2*PI;
+	}
+
+	return kepler_time(k, e, E0, E);
+}
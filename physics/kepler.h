@@ -0,0 +1,4 @@
+void kepler_init(kepler_orbit *k, vec r0, vec v0, double t0, double mu);
+int kepler_at(const kepler_orbit *k, double t, vec *r, vec *v);
+double kepler_time_to_apoapsis(const kepler_orbit *k);
+double kepler_time_to_radius(const kepler_orbit *k, double radius);
@@ -0,0 +1,238 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Specialized integrator kernels
+ *
+ * @section DESCRIPTION
+ *
+ * The generic path goes through two levels of function pointers on every
+ * RHS call: the stepper calls deriv() through f, and physics() calls each
+ * model through physics_model_strategy. Nothing can be inlined across them
+ * and the stepper loops run over a runtime n.
+ *
+ * Here the common model combinations (spherical or J2 gravity, with and
+ * without drag and thrust) are instantiated from the templates
+ * math/runge-kutta-fixed.h, math/dormand-prince-fixed.h and
+ * physics/physics-fixed.h: a deriv() that calls its models by name, and
+ * Cash-Karp and Dormand-Prince steppers of size NEQ that call that deriv()
+ * directly. kernel_find() picks the one matching a context; anything else
+ * runs through the strategies as before. Kernels give bit for bit the same
+ * trajectory as the generic path.
+ *
+ * To add a combination instantiate the templates for it and add a line to
+ * kernels[].
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../math/vector.h"
+#include "../math/runge-kutta.h"
+#include "../math/dormand-prince.h"
+#include "../utils/coord.h"
+#include "../utils/stats.h"
+#include "atmosphere.h"
+#include "gravity.h"
+#include "aero.h"
+#include "thrust.h"
+#include "kernels.h"
+
+/**
+ * RHS, one per model combination
+ */
+#define PHYSICS_FIXED_NAME deriv_sphere
+#define PHYSICS_FIXED_GRAVITY gravity_sphere
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_sphere_drag
+#define PHYSICS_FIXED_GRAVITY gravity_sphere
+#define PHYSICS_FIXED_DRAG drag
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_sphere_thrust
+#define PHYSICS_FIXED_GRAVITY gravity_sphere
+#define PHYSICS_FIXED_THRUST thrust
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_sphere_drag_thrust
+#define PHYSICS_FIXED_GRAVITY gravity_sphere
+#define PHYSICS_FIXED_DRAG drag
+#define PHYSICS_FIXED_THRUST thrust
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_j2
+#define PHYSICS_FIXED_GRAVITY gravity_j2
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_j2_drag
+#define PHYSICS_FIXED_GRAVITY gravity_j2
+#define PHYSICS_FIXED_DRAG drag
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_j2_thrust
+#define PHYSICS_FIXED_GRAVITY gravity_j2
+#define PHYSICS_FIXED_THRUST thrust
+#include "physics-fixed.h"
+
+#define PHYSICS_FIXED_NAME deriv_j2_drag_thrust
+#define PHYSICS_FIXED_GRAVITY gravity_j2
+#define PHYSICS_FIXED_DRAG drag
+#define PHYSICS_FIXED_THRUST thrust
+#include "physics-fixed.h"
+
+/**
+ * Steppers, one per RHS and method
+ */
+#define RK_FIXED_NAME rkqc_sphere
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_sphere
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_sphere_drag
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_sphere_drag
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_sphere_thrust
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_sphere_thrust
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_sphere_drag_thrust
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_sphere_drag_thrust
+#include "../math/runge-kutta-fixed.h"
+
+#define DP_FIXED_NAME rkdp_sphere
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_sphere
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_sphere_drag
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_sphere_drag
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_sphere_thrust
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_sphere_thrust
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_sphere_drag_thrust
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_sphere_drag_thrust
+#include "../math/dormand-prince-fixed.h"
+
+#define RK_FIXED_NAME rkqc_j2
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_j2
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_j2_drag
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_j2_drag
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_j2_thrust
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_j2_thrust
+#include "../math/runge-kutta-fixed.h"
+
+#define RK_FIXED_NAME rkqc_j2_drag_thrust
+#define RK_FIXED_N NEQ
+#define RK_FIXED_DERIV deriv_j2_drag_thrust
+#include "../math/runge-kutta-fixed.h"
+
+#define DP_FIXED_NAME rkdp_j2
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_j2
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_j2_drag
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_j2_drag
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_j2_thrust
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_j2_thrust
+#include "../math/dormand-prince-fixed.h"
+
+#define DP_FIXED_NAME rkdp_j2_drag_thrust
+#define DP_FIXED_N NEQ
+#define DP_FIXED_DERIV deriv_j2_drag_thrust
+#include "../math/dormand-prince-fixed.h"
+
+// Strategy fields other than the stepper are those of the generic method
+#define CK(step) { "cash-karp", step, 5, 0, 5, NULL }
+#define DP(step) { "dopri5", step, 6, 1, 5, NULL }
+
+static const sim_kernel kernels[] = {
+	{ "sphere/cash-karp",             gravity_sphere, NULL, NULL,   &rk_cash_karp,
+		CK(rkqc_sphere),             deriv_sphere },
+	{ "sphere+drag/cash-karp",        gravity_sphere, drag, NULL,   &rk_cash_karp,
+		CK(rkqc_sphere_drag),        deriv_sphere_drag },
+	{ "sphere+thrust/cash-karp",      gravity_sphere, NULL, thrust, &rk_cash_karp,
+		CK(rkqc_sphere_thrust),      deriv_sphere_thrust },
+	{ "sphere+drag+thrust/cash-karp", gravity_sphere, drag, thrust, &rk_cash_karp,
+		CK(rkqc_sphere_drag_thrust), deriv_sphere_drag_thrust },
+	{ "sphere/dopri5",                gravity_sphere, NULL, NULL,   &rk_dopri5,
+		DP(rkdp_sphere),             deriv_sphere },
+	{ "sphere+drag/dopri5",           gravity_sphere, drag, NULL,   &rk_dopri5,
+		DP(rkdp_sphere_drag),        deriv_sphere_drag },
+	{ "sphere+thrust/dopri5",         gravity_sphere, NULL, thrust, &rk_dopri5,
+		DP(rkdp_sphere_thrust),      deriv_sphere_thrust },
+	{ "sphere+drag+thrust/dopri5",    gravity_sphere, drag, thrust, &rk_dopri5,
+		DP(rkdp_sphere_drag_thrust), deriv_sphere_drag_thrust },
+	{ "j2/cash-karp",                 gravity_j2,     NULL, NULL,   &rk_cash_karp,
+		CK(rkqc_j2),                 deriv_j2 },
+	{ "j2+drag/cash-karp",            gravity_j2,     drag, NULL,   &rk_cash_karp,
+		CK(rkqc_j2_drag),            deriv_j2_drag },
+	{ "j2+thrust/cash-karp",          gravity_j2,     NULL, thrust, &rk_cash_karp,
+		CK(rkqc_j2_thrust),          deriv_j2_thrust },
+	{ "j2+drag+thrust/cash-karp",     gravity_j2,     drag, thrust, &rk_cash_karp,
+		CK(rkqc_j2_drag_thrust),     deriv_j2_drag_thrust },
+	{ "j2/dopri5",                    gravity_j2,     NULL, NULL,   &rk_dopri5,
+		DP(rkdp_j2),                 deriv_j2 },
+	{ "j2+drag/dopri5",               gravity_j2,     drag, NULL,   &rk_dopri5,
+		DP(rkdp_j2_drag),            deriv_j2_drag },
+	{ "j2+thrust/dopri5",             gravity_j2,     NULL, thrust, &rk_dopri5,
+		DP(rkdp_j2_thrust),          deriv_j2_thrust },
+	{ "j2+drag+thrust/dopri5",        gravity_j2,     drag, thrust, &rk_dopri5,
+		DP(rkdp_j2_drag_thrust),     deriv_j2_drag_thrust },
+};
+
+/**
+ * @brief Kernel for the models and integrator a context uses
+ *
+ * @returns The kernel, or NULL if there is none and the strategies must be
+ * used
+ */
+const sim_kernel *kernel_find(const sim_context *ctx)
+{
+	const physics_model_strategy *m = &ctx->physics_model;
+	unsigned int i;
+
+	for (i=0;i<sizeof(kernels)/sizeof(kernels[0]);i++)
+	{
+		const sim_kernel *k = &kernels[i];
+		if (k->gravity_model == m->gravity_model && k->drag_model == m->drag_model
+			&& k->thrust_model == m->thrust_model && k->integrator == ctx->integrator)
+			return k;
+	}
+	return NULL;
+}
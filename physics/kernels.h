@@ -0,0 +1,18 @@
+/**
+ * @brief Specialized integrator kernel
+ *
+ * A stepper and RHS compiled for one combination of models and integrator,
+ * with the RK vector size fixed at NEQ. Used in place of the runtime
+ * strategies when a context asks for exactly that combination.
+ */
+struct sim_kernel {
+	const char *name;
+	gravity gravity_model;                  ///< models it was compiled for
+	aero drag_model;
+	propulsion thrust_model;
+	const integration_strategy *integrator; ///< generic method it replaces
+	integration_strategy method;            ///< the same method, specialized
+	rk_derivs deriv;                        ///< deriv() for these models
+};
+
+const sim_kernel *kernel_find(const sim_context *ctx);
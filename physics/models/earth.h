@@ -32,6 +32,17 @@
  */
 #define RADIUS_EARTH 6367.445e3
 
+/**
+ * WGS-84 ellipsoid: equatorial radius in m and flattening
+ */
+#define WGS84_A 6378137.0
+#define WGS84_F (1.0 / 298.257223563)
+
+/**
+ * Reference radius of the EGM96 gravity field in m
+ */
+#define EGM96_RADIUS 6378136.3
+
 /** 
  * Standard Gravity (surface gravity)
  */
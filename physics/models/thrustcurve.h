@@ -1 +0,0 @@
-thrust_curve rocket_thrust;
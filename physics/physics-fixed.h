@@ -0,0 +1,65 @@
+/**
+ * @brief deriv() for one fixed combination of models
+ *
+ * A template, included once per instance after defining
+ *
+ *   PHYSICS_FIXED_NAME     name of the rk_derivs function to define (static)
+ *   PHYSICS_FIXED_GRAVITY  gravity model
+ *   PHYSICS_FIXED_DRAG     aero model, leave undefined for none
+ *   PHYSICS_FIXED_THRUST   propulsion model, leave undefined for none
+ *
+ * The models are called by name rather than through the
+ * physics_model_strategy pointers, and models that are not used are not
+ * tested for at all. Otherwise it is deriv() and physics() exactly, in the
+ * same order, so it gives bit for bit their result.
+ *
+ * Needs libsim_types.h, vector.h, coord.h, atmosphere.h and stats.h. The
+ * parameters are undefined again at the end.
+ */
+
+static void PHYSICS_FIXED_NAME(double *y, double *dydx, double t, void *ctx)
+{
+	const rk_state *s = RK_CSTATE(y);
+	rk_state *ds = RK_STATE(dydx);
+	vec f = {{0, 0, 0}};
+	double m_dot = 0;
+	sim_context *sim = ctx;
+
+	(void) t;
+	(void) sim;
+
+	STATS(sim->stats.derivs++);
+	STATS(double t0 = stats_now());
+	STATS(double t1);
+
+	// Calc gravity
+	PHYSICS_FIXED_GRAVITY(s, sim, &f);
+	STATS(t1 = stats_now(); sim->stats.t_gravity += t1 - t0; t0 = t1);
+
+#ifdef PHYSICS_FIXED_DRAG
+	// Calc drag
+	{
+		atmosphere air = atmosphere_at(earth_altitude(sim->earth, s->x));
+		PHYSICS_FIXED_DRAG(s, &air, sim, &f);
+		STATS(t1 = stats_now(); sim->stats.t_drag += t1 - t0; t0 = t1);
+	}
+#endif
+
+#ifdef PHYSICS_FIXED_THRUST
+	// Calc thrust
+	PHYSICS_FIXED_THRUST(s, t, sim, &f, &m_dot);
+	STATS(t1 = stats_now(); sim->stats.t_thrust += t1 - t0);
+#endif
+
+	// Velocity is single integration of acceleration
+	ds->x = s->v;
+	ds->v.v.i = (f.v.i) / s->m;
+	ds->v.v.j = (f.v.j) / s->m;
+	ds->v.v.k = (f.v.k) / s->m;
+	ds->m = -m_dot;
+}
+
+#undef PHYSICS_FIXED_NAME
+#undef PHYSICS_FIXED_GRAVITY
+#undef PHYSICS_FIXED_DRAG
+#undef PHYSICS_FIXED_THRUST
@@ -12,25 +12,54 @@
 #include "../libsim_types.h"
 #include "models/earth.h"
 #include "../utils/coord.h"
+#include "atmosphere.h"
+#include "../utils/stats.h"
 #include "physics.h"
 
 /**
  * Functions
  */
-state_change physics(state s, double t, physics_model_strategy strategy)
+/**
+ * @brief Equation of motion: derivative of the state, in place
+ *
+ * s is read where it lies in the RK vector and the derivative is written
+ * straight into ds, laid out the same way.
+ */
+void physics(const rk_state *s, double t, sim_context *ctx, rk_state *ds)
 {
-	// Return value
-	state_change model;
+	const physics_model_strategy *strategy = &ctx->physics_model;
+	vec f = {{0, 0, 0}};
+	double m_dot = 0;
+
+	STATS(double t0 = stats_now());
+	STATS(double t1);
 
 	// Calc gravity
-	vec g = strategy.gravity_model(s);
+	strategy->gravity_model(s, ctx, &f);
+	STATS(t1 = stats_now(); ctx->stats.t_gravity += t1 - t0; t0 = t1);
+
+	// Calc drag
+	if (strategy->drag_model)
+	{
+		// One lookup shared by every aero model
+		atmosphere air = atmosphere_at(earth_altitude(ctx->earth, s->x));
+		strategy->drag_model(s, &air, ctx, &f);
+		STATS(t1 = stats_now(); ctx->stats.t_drag += t1 - t0; t0 = t1);
+	}
 
-	model.acc.v.i = (g.v.i) / s.m;
-	model.acc.v.j = (g.v.j) / s.m;
-	model.acc.v.k = (g.v.k) / s.m;
-	model.m_dot = 0;
+	// Calc thrust
+	if (strategy->thrust_model)
+	{
+		strategy->thrust_model(s, t, ctx, &f, &m_dot);
+		STATS(t1 = stats_now(); ctx->stats.t_thrust += t1 - t0);
+	}
 
-	return model;
+	// Velocity is single integration of acceleration
+	ds->x = s->v;
+	ds->v.v.i = (f.v.i) / s->m;
+	ds->v.v.j = (f.v.j) / s->m;
+	ds->v.v.k = (f.v.k) / s->m;
+	ds->m = -m_dot;
 }
 
 bool underground(state s)
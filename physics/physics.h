@@ -1,7 +1,7 @@
 /**
  * equation of motion
  */
-state_change physics(state s, double t, physics_model_strategy strategy);
+void physics(const rk_state *s, double t, sim_context *ctx, rk_state *ds);
 
 // ground
 bool underground(state s);
@@ -0,0 +1,148 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Rigid body dynamics
+ *
+ * @section DESCRIPTION
+ *
+ * The 6-DOF counterpart of physics(), used when sim_context.rigid_body is
+ * set. The RK vector is then NEQ_6DOF long: the rk_state, integrated exactly
+ * as in 3-DOF, followed by an rk_attitude block holding the attitude
+ * quaternion and the body rates.
+ *
+ * The body_frame (direction cosines and inertia at the current mass) is
+ * built once at the top of every RHS call and handed to every body model.
+ * The attitude follows q' = q (0, omega) / 2, and the rates Euler's
+ * equations with the inertia changing as the propellant burns,
+ *
+ *   I omega' = M - omega x (I omega) - I' omega
+ *
+ * with I' = dI/dm m'. The integrator puts q back on unit length after each
+ * step.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include "../libsim_types.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "../utils/coord.h"
+#include "../utils/stats.h"
+#include "atmosphere.h"
+#include "rigid_body.h"
+
+/**
+ * @brief Principal moments of inertia at mass m, and their rate of change
+ * with mass
+ *
+ * Straight line between the empty and full inertia. A body with mass_full
+ * equal to mass_empty has a fixed inertia, inertia_full.
+ */
+void rigid_body_inertia(const rigid_body *body, double m, vec *inertia, vec *d_inertia)
+{
+	int i;
+	double span = body->mass_full - body->mass_empty;
+
+	if (span == 0)
+	{
+		*inertia = body->inertia_full;
+		*d_inertia = (vec) {{0, 0, 0}};
+		return;
+	}
+
+	for (i=0;i<3;i++)
+	{
+		d_inertia->component[i] = (body->inertia_full.component[i]
+			- body->inertia_empty.component[i]) / span;
+		inertia->component[i] = body->inertia_empty.component[i]
+			+ d_inertia->component[i] * (m - body->mass_empty);
+	}
+}
+
+/**
+ * @brief 6-DOF equation of motion: derivative of the state and attitude, in
+ * place
+ *
+ * Forces are summed in ECEF as in physics() and moments in body axes. Body
+ * models are used where set, otherwise the point mass models, which add no
+ * moment.
+ */
+void physics_rigid_body(const rk_state *s, const rk_attitude *a, double t, sim_context *ctx,
+	rk_state *ds, rk_attitude *da)
+{
+	const physics_model_strategy *strategy = &ctx->physics_model;
+	body_frame b;
+	vec f = {{0, 0, 0}};
+	vec moment = {{0, 0, 0}};
+	vec d_inertia, Iw, gyro;
+	double m_dot = 0;
+	quat w;
+	int i;
+
+	STATS(double t0 = stats_now());
+	STATS(double t1);
+
+	// Direction cosines once for every model
+	b.dcm = quat_to_dcm(a->q);
+	b.omega = a->omega;
+	rigid_body_inertia(&ctx->vehicle.body, s->m, &b.inertia, &d_inertia);
+
+	// Calc gravity
+	strategy->gravity_model(s, ctx, &f);
+	STATS(t1 = stats_now(); ctx->stats.t_gravity += t1 - t0; t0 = t1);
+
+	// Calc drag
+	if (strategy->body_drag_model || strategy->drag_model)
+	{
+		atmosphere air = atmosphere_at(earth_altitude(ctx->earth, s->x));
+		if (strategy->body_drag_model)
+			strategy->body_drag_model(s, &b, &air, ctx, &f, &moment);
+		else
+			strategy->drag_model(s, &air, ctx, &f);
+		STATS(t1 = stats_now(); ctx->stats.t_drag += t1 - t0; t0 = t1);
+	}
+
+	// Calc thrust
+	if (strategy->body_thrust_model || strategy->thrust_model)
+	{
+		if (strategy->body_thrust_model)
+			strategy->body_thrust_model(s, &b, t, ctx, &f, &moment, &m_dot);
+		else
+			strategy->thrust_model(s, t, ctx, &f, &m_dot);
+		STATS(t1 = stats_now(); ctx->stats.t_thrust += t1 - t0);
+	}
+
+	// Translation, as physics()
+	ds->x = s->v;
+	ds->v.v.i = (f.v.i) / s->m;
+	ds->v.v.j = (f.v.j) / s->m;
+	ds->v.v.k = (f.v.k) / s->m;
+	ds->m = -m_dot;
+
+	// Attitude rate, q' = q (0, omega) / 2
+	w = (quat) {{ 0, a->omega.v.i, a->omega.v.j, a->omega.v.k }};
+	da->q = quat_mult(a->q, w);
+	for (i=0;i<4;i++)
+		da->q.component[i] *= 0.5;
+
+	// Euler's equations, I' = dI/dm m'
+	for (i=0;i<3;i++)
+		Iw.component[i] = b.inertia.component[i] * a->omega.component[i];
+	gyro = cross_prod(a->omega, Iw);
+	for (i=0;i<3;i++)
+		da->omega.component[i] = (moment.component[i] - gyro.component[i]
+			+ d_inertia.component[i] * m_dot * a->omega.component[i]) / b.inertia.component[i];
+}
@@ -0,0 +1,6 @@
+/**
+ * 6-DOF equation of motion
+ */
+void physics_rigid_body(const rk_state *s, const rk_attitude *a, double t, sim_context *ctx,
+	rk_state *ds, rk_attitude *da);
+void rigid_body_inertia(const rigid_body *body, double m, vec *inertia, vec *d_inertia);
@@ -8,61 +8,125 @@
 #include <stdlib.h> 
 #include "../libsim_types.h"
 #include "../math/vector.h"
+#include "../math/table.h"
 #include "../utils/coord.h"
 #include "models/earth.h"
-#include "models/thrustcurve.h"
 #include "thrust.h"
 
 
 /**
  * Functions
  */
-static double get_thrust_curve_segment(double t);
 
 /**
-* Thrust
+* Thrust along the launch axis
 */
-vec thrust(state s, double t, double *mdot)
+void thrust(const rk_state *s, double t, sim_context *ctx, vec *f, double *mdot)
 {
   vec d;
+  const thrust_curve *curve = &ctx->vehicle.thrust;
   
-  (*mdot) = get_thrust_curve_segment(t);
-  
-  double calc_thrust = rocket_thrust.Isp * g_0 * (*mdot);
+  (void) s;
+
+  (*mdot) = get_thrust_curve_segment(ctx, t);
   
-  //printf("%f, %f, %f\n", t, thrust, *mdot);
-  d.v.i = calc_thrust;
-  d.v.j = 0;
-  d.v.k = 0;
+  double calc_thrust = curve->Isp * g_0 * (*mdot);
   
-  return d;
+  d = vec_scale(unit_vec(ctx->launch_axis), calc_thrust);
+  f->v.i += d.v.i;
+  f->v.j += d.v.j;
+  f->v.k += d.v.k;
+}
+
+/**
+ * Gravity turn: thrust along the launch axis at rest, turning towards the
+ * velocity vector as the rocket speeds up. The direction is that of
+ * launch_axis * TURN_SPEED + v, so it is smooth in v and is within a degree
+ * of the velocity vector above about 60 TURN_SPEED.
+ */
+void thrust_gravity_turn(const rk_state *s, double t, sim_context *ctx, vec *f, double *mdot)
+{
+  vec d, axis;
+  const thrust_curve *curve = &ctx->vehicle.thrust;
+
+  (*mdot) = get_thrust_curve_segment(ctx, t);
+
+  double calc_thrust = curve->Isp * g_0 * (*mdot);
+
+  axis = vec_scale(unit_vec(ctx->launch_axis), TURN_SPEED);
+  axis.v.i += s->v.v.i;
+  axis.v.j += s->v.v.j;
+  axis.v.k += s->v.v.k;
+
+  d = vec_scale(unit_vec(axis), calc_thrust);
+  f->v.i += d.v.i;
+  f->v.j += d.v.j;
+  f->v.k += d.v.k;
+}
+
+/**
+ * Thrust along the body axis, through the CG, for 6-DOF
+ */
+void thrust_body(const rk_state *s, const body_frame *b, double t, sim_context *ctx, vec *f,
+  vec *moment, double *mdot)
+{
+  const thrust_curve *curve = &ctx->vehicle.thrust;
+
+  (void) s;
+  (void) moment;
+
+  (*mdot) = get_thrust_curve_segment(ctx, t);
+
+  double calc_thrust = curve->Isp * g_0 * (*mdot);
+
+  // First column of the DCM is the body x axis in ECEF
+  f->v.i += b->dcm.component[0][0] * calc_thrust;
+  f->v.j += b->dcm.component[1][0] * calc_thrust;
+  f->v.k += b->dcm.component[2][0] * calc_thrust;
 }
 
-void set_thrust_curve(thrust_curve calc_thrust)
+void set_thrust_curve(sim_context *ctx, thrust_curve calc_thrust)
+{
+  ctx->vehicle.thrust = calc_thrust;
+}
+
+/**
+ * Build the m_dot table for the vehicle in ctx, call before each run. The
+ * curve is interpolated linearly between its length + 1 points.
+ *
+ * @returns 0, or -1 if the curve times are not increasing
+ */
+int thrust_init(sim_context *ctx)
 {
-  rocket_thrust = calc_thrust;
+  const thrust_curve *curve = &ctx->vehicle.thrust;
+
+  ctx->thrust_hint = 0;
+  return table1d_init(&ctx->thrust_table, curve->time, curve->m_dot, curve->length + 1,
+                      TABLE_LINEAR, NULL);
 }
 
-double get_thrust_curve_segment(double t)
+/**
+ * m_dot at time t from the table built by thrust_init()
+ */
+double get_thrust_curve_segment(sim_context *ctx, double t)
 {
-  if (t < 0)
-    return rocket_thrust.m_dot[0];
-  else if (t > rocket_thrust.time[rocket_thrust.length])
+  const table1d *table = &ctx->thrust_table;
+
+  if (t > table->x[table->n - 1])
     return 0;
-  
-  int i;
-  for (i=0;i<=rocket_thrust.length;i++)
-  {
-    if (rocket_thrust.time[i] >= t)
-    {
-      //printf("%d: %f - %f  %f\n", i, rocket_thrust.time[i], t, rocket_thrust.m_dot[i]);
-      break;
-    }
-  }
 
-  return rocket_thrust.m_dot[i];  
+  // Hold m_dot[0] before ignition
+  return table1d_eval(table, t, &ctx->thrust_hint);
 }
 
+/**
+ * Time of the last point of the thrust table, no thrust after this
+ */
+double thrust_burnout(const sim_context *ctx)
+{
+  const table1d *table = &ctx->thrust_table;
+  return table->x[table->n - 1];
+}
 
 void build_thrust_curve(double fuel, double isp, double avg_thrust, thrust_curve *t)
 {
@@ -74,8 +138,9 @@ void build_thrust_curve(double fuel, double isp, double avg_thrust, thrust_curve
 
   double burn_time = (fuel / mdot);
   
-  (*t).time = (double *) malloc(sizeof(double)*n);
-  (*t).m_dot = (double *) malloc(sizeof(double)*n);
+  // length + 1 points, the last at burnout
+  (*t).time = (double *) malloc(sizeof(double)*(n+1));
+  (*t).m_dot = (double *) malloc(sizeof(double)*(n+1));
   (*t).length = n;
   (*t).Isp = isp;
   int i;
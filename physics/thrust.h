@@ -1,3 +1,12 @@
-vec thrust(state s, double t, double *mdot);
-void set_thrust_curve(thrust_curve thrust);
+/** Speed at which the gravity turn is half way to the velocity vector [m/s] */
+#define TURN_SPEED 1.0
+
+void thrust(const rk_state *s, double t, sim_context *ctx, vec *f, double *mdot);
+void thrust_gravity_turn(const rk_state *s, double t, sim_context *ctx, vec *f, double *mdot);
+void thrust_body(const rk_state *s, const body_frame *b, double t, sim_context *ctx, vec *f,
+	vec *moment, double *mdot);
+int thrust_init(sim_context *ctx);
+double get_thrust_curve_segment(sim_context *ctx, double t);
+double thrust_burnout(const sim_context *ctx);
+void set_thrust_curve(sim_context *ctx, thrust_curve thrust);
 void build_thrust_curve(double fuel, double isp, double avg_thrust, thrust_curve *t);
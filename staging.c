@@ -0,0 +1,317 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Multi-stage flights
+ *
+ * @section DESCRIPTION
+ *
+ * The vehicle is flown one stage at a time, each segment watching for the
+ * next separation as a terminal event on top of the context's own events.
+ * At a separation the flight forks: every fragment is handed to the thread
+ * pool as an independent flight to the ground, and the vehicle flies on from
+ * the same state with the fragments' mass taken off, while the fragments are
+ * being flown on other cores. The histories are gathered into one
+ * flight_record once every task has finished.
+ *
+ * Each segment and fragment runs on its own clock from its separation, so
+ * thrust curves and events like boundary_condition_burnout() are timed from
+ * there; the record is shifted back to flight time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libsim_types.h"
+#include "libsim.h"
+#include "utils/boundary_conditions.h"
+#include "utils/threadpool.h"
+#include "staging.h"
+
+/**
+ * Fragments fall until they hit the ground
+ */
+static const event fragment_events[] = {
+	{ boundary_condition_ground, -1, 1 },
+};
+
+/**
+ * A fragment flown as its own task
+ */
+typedef struct {
+	sim_context ctx;
+	rocket r;
+	state ic;
+	double t0;                // separation time, start of the fragment's clock
+	state_history *out;
+} fragment_task;
+
+/**
+ * Watches one segment for its separation, and passes the context's own
+ * events on to its handler in flight time
+ */
+typedef struct {
+	int index;                // of the separation among the segment's events
+	int hit;
+	double t;                 // segment time of the separation
+	state s;
+	double t0;                // flight time the segment started at
+	const sim_context *ctx;
+} separation;
+
+static void on_segment_event(int index, double t, state s, void *user)
+{
+	separation *sep = user;
+
+	if (index == sep->index)
+	{
+		sep->hit = 1;
+		sep->t = t;
+		sep->s = s;
+		return;
+	}
+	if (sep->ctx->on_event)
+		sep->ctx->on_event(index, sep->t0 + t, s, sep->ctx->event_user);
+}
+
+static void shift_times(state_history *h, double t0)
+{
+	int i;
+	for (i=0;i<h->length;i++)
+		h->times[i] += t0;
+}
+
+/**
+ * Add src to the end of dst, which is malloc'd
+ *
+ * @returns 0, or -1 if out of memory
+ */
+static int append_history(state_history *dst, const state_history *src)
+{
+	int n = dst->length + src->length;
+	double *times = realloc(dst->times, sizeof(double) * n);
+	if (times == NULL)
+		return -1;
+	dst->times = times;
+
+	state *states = realloc(dst->states, sizeof(state) * n);
+	if (states == NULL)
+		return -1;
+	dst->states = states;
+
+	if (src->attitude)
+	{
+		state_attitude *attitude = realloc(dst->attitude, sizeof(state_attitude) * n);
+		if (attitude == NULL)
+			return -1;
+		dst->attitude = attitude;
+		memcpy(&dst->attitude[dst->length], src->attitude, sizeof(state_attitude) * src->length);
+	}
+
+	memcpy(&dst->times[dst->length], src->times, sizeof(double) * src->length);
+	memcpy(&dst->states[dst->length], src->states, sizeof(state) * src->length);
+	dst->length = n;
+	return 0;
+}
+
+static void fly_fragment(void *arg)
+{
+	fragment_task *f = arg;
+
+	*f->out = Integrate_Rocket_r(&f->ctx, f->r, f->ic);
+	shift_times(f->out, f->t0);
+}
+
+/**
+ * Set up a fragment's flight from the separation state s at flight time t0:
+ * the context's gravity and drag, no motor, 3-DOF, down to the ground.
+ */
+static void fragment_start(fragment_task *f, const sim_context *ctx, const fragment *frag,
+	state s, double t0)
+{
+	f->ctx = *ctx;
+	f->ctx.physics_model.thrust_model = NULL;
+	f->ctx.physics_model.body_drag_model = NULL;
+	f->ctx.physics_model.body_thrust_model = NULL;
+	f->ctx.rigid_body = 0;
+	f->ctx.duration = ctx->duration - t0;
+	f->ctx.events = fragment_events;
+	f->ctx.event_count = sizeof(fragment_events) / sizeof(fragment_events[0]);
+	f->ctx.on_event = NULL;
+	f->ctx.pool = NULL;
+
+	f->r = (rocket) { .area = frag->area, .Cd = frag->Cd };
+	f->ic = s;
+	f->ic.m = frag->mass;
+	f->ic.v.v.i += frag->dv.v.i;
+	f->ic.v.v.j += frag->dv.v.j;
+	f->ic.v.v.k += frag->dv.v.k;
+	f->t0 = t0;
+}
+
+/**
+ * @brief Fly a multi-stage vehicle and every fragment it sheds
+ *
+ * stages are watched for in order, each once the one before it has happened.
+ * The vehicle flies as r until stages[0], then as stages[0].vehicle until
+ * stages[1], and so on. Fragments are flown on a thread pool alongside the
+ * vehicle, with the context's gravity and drag models.
+ *
+ * @param ctx Models, tolerances and events for the whole flight; duration
+ * is from the launch. At most MAX_EVENTS - 1 events.
+ * @param r The vehicle at launch
+ * @param initial_conditions Launch state
+ * @param stages Separations, in the order they happen
+ * @param stage_count Number of stages
+ * @param nthreads Worker threads for the fragments, <= 0 uses every core
+ * @param record Filled in, release with flight_record_free()
+ *
+ * @returns 0 on success, -1 if out of memory, there is no room for the
+ * separation event, the fragments leave the vehicle no mass, or the vehicle
+ * or a fragment could not be flown (see Integrate_Rocket_r())
+ */
+int Integrate_Stages(const sim_context *ctx, rocket r, state initial_conditions,
+	const stage *stages, int stage_count, int nthreads, flight_record *record)
+{
+	int i, k, n, total = 0;
+	int ret = 0;
+	double shed = 0;
+	sim_context seg;
+	event events[MAX_EVENTS];
+	separation sep;
+	state s = initial_conditions;
+	state_attitude attitude = ctx->initial_attitude;
+	double t0 = 0;
+	fragment_task *tasks;
+	threadpool *pool;
+
+	memset(record, 0, sizeof(*record));
+	record->vehicle.owned = 1;
+	if (ctx->event_count >= MAX_EVENTS)
+		return -1;
+
+	for (k=0;k<stage_count;k++)
+	{
+		total += stages[k].fragment_count;
+		for (i=0;i<stages[k].fragment_count;i++)
+			shed += stages[k].fragments[i].mass;
+	}
+	// The vehicle never gets heavier, so this much is never left behind
+	if (shed >= initial_conditions.m)
+		return -1;
+
+	record->fragments = calloc(total + 1, sizeof(state_history));
+	record->stage_times = malloc(sizeof(double) * (stage_count + 1));
+	tasks = malloc(sizeof(fragment_task) * (total + 1));
+	if (record->fragments == NULL || record->stage_times == NULL || tasks == NULL)
+	{
+		free(tasks);
+		flight_record_free(record);
+		return -1;
+	}
+	for (k=0;k<stage_count;k++)
+		record->stage_times[k] = -1;
+
+	// Without workers the fragments are flown as they come off
+	pool = threadpool_create(nthreads);
+
+	for (k=0;k<=stage_count && t0 < ctx->duration;k++)
+	{
+		// This stage's segment: the context's events plus the next separation
+		seg = *ctx;
+		seg.pool = NULL;
+		seg.duration = ctx->duration - t0;
+		seg.initial_attitude = attitude;
+		n = ctx->event_count;
+		for (i=0;i<n;i++)
+			events[i] = ctx->events[i];
+		if (k < stage_count)
+			events[n++] = (event) { stages[k].g, stages[k].direction, 1 };
+		seg.events = events;
+		seg.event_count = n;
+		sep = (separation) { .index = ctx->event_count, .t0 = t0, .ctx = ctx };
+		seg.on_event = on_segment_event;
+		seg.event_user = &sep;
+
+		state_history h = Integrate_Rocket_r(&seg, k == 0 ? r : stages[k-1].vehicle, s);
+		shift_times(&h, t0);
+		if (h.length < 0 || append_history(&record->vehicle, &h) != 0)
+			ret = -1;
+		// A 6-DOF vehicle flies on from the attitude it separated at, the
+		// segment's last state
+		if (h.attitude && h.length > 0)
+			attitude = h.attitude[h.length-1];
+		state_history_free(&h);
+		if (!sep.hit || ret != 0)
+			break;
+
+		// Propellant burnt so far can still leave too little for the fragments
+		shed = 0;
+		for (i=0;i<stages[k].fragment_count;i++)
+			shed += stages[k].fragments[i].mass;
+		if (sep.s.m - shed <= 0)
+		{
+			ret = -1;
+			break;
+		}
+
+		// Fork: the fragments go to the pool, the rest flies on
+		t0 += sep.t;
+		s = sep.s;
+		record->stage_times[k] = t0;
+		record->stages_flown++;
+		for (i=0;i<stages[k].fragment_count;i++)
+		{
+			fragment_task *f = &tasks[record->fragment_count];
+
+			fragment_start(f, ctx, &stages[k].fragments[i], s, t0);
+			f->out = &record->fragments[record->fragment_count++];
+			if (pool == NULL || threadpool_submit(pool, fly_fragment, f) != 0)
+				fly_fragment(f);
+			s.m -= stages[k].fragments[i].mass;
+		}
+	}
+
+	if (pool)
+	{
+		threadpool_wait(pool);
+		threadpool_destroy(pool);
+	}
+	free(tasks);
+	for (i=0;i<record->fragment_count;i++)
+		if (record->fragments[i].length < 0)
+			ret = -1;
+
+	return ret;
+}
+
+/**
+ * Release everything in a flight_record
+ */
+void flight_record_free(flight_record *record)
+{
+	int i;
+
+	state_history_free(&record->vehicle);
+	if (record->fragments)
+		for (i=0;i<record->fragment_count;i++)
+			state_history_free(&record->fragments[i]);
+	free(record->fragments);
+	free(record->stage_times);
+	record->fragments = NULL;
+	record->stage_times = NULL;
+	record->fragment_count = 0;
+	record->stages_flown = 0;
+}
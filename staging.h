@@ -0,0 +1,34 @@
+/**
+ * @brief One separation in a multi-stage flight
+ *
+ * Happens where g crosses zero (in direction, as for an event) while the
+ * stage before it is flying. The flight forks there: every fragment leaves
+ * with its own mass and the vehicle's velocity plus its dv, and whatever
+ * mass is left flies on as vehicle.
+ */
+typedef struct {
+	event_function g;            ///< e.g. boundary_condition_burnout
+	int direction;
+	rocket vehicle;              ///< what flies on, its thrust curve timed from the separation
+	const fragment *fragments;   ///< bodies that come off
+	int fragment_count;
+} stage;
+
+/**
+ * @brief Every body of a multi-stage flight, gathered
+ *
+ * Times are flight times, from the launch. The vehicle's history runs through
+ * all its stages; a separation shows up as two states at the same time,
+ * before and after the fragments come off.
+ */
+typedef struct {
+	state_history vehicle;       ///< launch to the end of the flight
+	state_history *fragments;    ///< one per fragment, stage by stage in order
+	int fragment_count;          ///< fragments spawned
+	double *stage_times;         ///< time of each separation, -1 if it never happened
+	int stages_flown;            ///< separations that happened
+} flight_record;
+
+int Integrate_Stages(const sim_context *ctx, rocket r, state initial_conditions,
+	const stage *stages, int stage_count, int nthreads, flight_record *record);
+void flight_record_free(flight_record *record);
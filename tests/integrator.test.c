@@ -5,6 +5,20 @@
 #include "../libsim.h"
 #include "../physics/models/earth.h"
 #include "../utils/coord.h"
+#include "../utils/sink.h"
+#include "../utils/arena.h"
+#include "../utils/stats.h"
+#include "../physics/aero.h"
+#include "../physics/thrust.h"
+#include "../physics/gravity.h"
+#include "../math/runge-kutta.h"
+#include "../math/dormand-prince.h"
+#include "../math/dormand-prince-853.h"
+#include "../physics/kernels.h"
+#include "../utils/boundary_conditions.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "../physics/rigid_body.h"
 #include "test.h"
 #include "integrator.test.h"
 
@@ -73,3 +87,573 @@ char *OneDOF_balistic_test1(void)
 
 	return 0; // tests passed
 }
+
+/**
+ * @test Interpolates a coasting flight onto a 10 Hz grid and checks that grid
+ * samples agree with integrating exactly to those times.
+ */
+char *dense_output_test1(void)
+{
+	int k;
+	trajectory_sink sink;
+	memory_sink mem;
+	sim_context ctx;
+	arena pool;
+	static unsigned char buffer[1 << 20];
+
+	// The exact runs are kept in a fixed buffer, no malloc
+	arena_init_buffer(&pool, buffer, sizeof(buffer));
+
+	Init_Context(&ctx);
+	ctx.duration = 2;
+	ctx.output_dt = 0.1;
+
+	double t[2] = {0,1};
+	double m[2] = {0,0};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = vec_scale(unit_vec(position), 100),
+                                 .a = {.v={0,0,0}},
+                                 .m = 10
+                               };
+
+	sink_memory(&sink, &mem);
+	Integrate_Rocket_sink(&ctx, a_rocket, initial_conditions, &sink);
+
+	char * err = "\n  (-) Error: dense_output_test1()\n        (+) Interpolated state off the integrated one\n";
+
+	// 0, 0.1, ... 2.0
+	mu_assert(err, mem.history.length == 21);
+
+	for (k=1;k<mem.history.length;k+=4)
+	{
+		sim_context exact;
+		Init_Context(&exact);
+		exact.duration = mem.history.times[k];
+		exact.pool = &pool;
+		mu_assert(err, fabs(mem.history.times[k] - k*0.1) < 1e-12);
+
+		state_history h = Integrate_Rocket_r(&exact, a_rocket, initial_conditions);
+		state end = h.states[h.length-1];
+		state grid = mem.history.states[k];
+		mu_assert(err, fabs(altitude(end.x) - altitude(grid.x)) < 1e-4);
+		mu_assert(err, fabs(norm(end.v) - norm(grid.v)) < 1e-4);
+		mu_assert(err, !h.owned && pool.used > 0);
+		state_history_free(&h);
+		arena_reset(&pool);
+	}
+
+	state_history_free(&mem.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies an orbit for longer than MAXSTEPS steps allow, on an output grid
+ * with nothing on it after the start, and checks that the history still ends
+ * with the state the integrator gave up at. Then checks that flights which
+ * fail (a full arena, a bad thrust curve) come back with a length of -1.
+ */
+char *max_steps_test1(void)
+{
+	sim_context ctx;
+	double r = 7000e3;
+	double t[2] = {0,1};
+	double m[2] = {0,0};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	state initial_conditions = { .x = {.v={r, 0, 0}},
+                                 .v = {.v={0, sqrt(-G * MASS_EARTH / r), 0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 10
+                               };
+
+	Init_Context(&ctx);
+	ctx.duration = 1e9;
+	ctx.output_dt = 1e9;
+
+	state_history h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+
+	char * err = "\n  (-) Error: max_steps_test1()\n        (+) Last state lost at the step limit\n";
+
+	mu_assert(err, h.length == 2);
+	mu_assert(err, h.times[0] == 0 && h.times[1] > 0 && h.times[1] < ctx.duration);
+	mu_assert(err, fabs(norm(h.states[1].x) - r) < 1);
+	STATS(mu_assert(err, ctx.stats.accepted == MAXSTEPS));
+
+	state_history_free(&h);
+
+	// A flight that can't be kept whole comes back empty, not cut short
+	char buffer[64];
+	arena pool;
+	err = "\n  (-) Error: max_steps_test1()\n        (+) Failed flight not reported\n";
+	arena_init_buffer(&pool, buffer, sizeof(buffer));
+	ctx.pool = &pool;
+	h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	mu_assert(err, h.length == -1 && h.times == NULL && h.states == NULL);
+	state_history_free(&h);
+	ctx.pool = NULL;
+
+	ctx.physics_model.thrust_model = thrust;
+	t[1] = 0;
+	h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	mu_assert(err, h.length == -1 && h.times == NULL && h.states == NULL);
+
+	return 0; // tests passed
+}
+
+static double apogee_time = -1;
+static state apogee_state;
+
+static void record_apogee(int index, double t, state s, void *user)
+{
+	if (index == 1)
+	{
+		apogee_time = t;
+		apogee_state = s;
+	}
+}
+
+/**
+ * @test Throws a ball straight up and checks that apogee and ground impact
+ * are located exactly, not at the nearest step, on the sphere and on WGS-84.
+ */
+char *event_location_test1(void)
+{
+	sim_context ctx;
+	event events[2] = { { boundary_condition_ground, -1, 1 },
+                        { boundary_condition_max_alt, -1, 0 } };
+
+	Init_Context(&ctx);
+	ctx.duration = 100;
+	ctx.events = events;
+	ctx.event_count = 2;
+	ctx.on_event = record_apogee;
+
+	double t[2] = {0,1};
+	double m[2] = {0,0};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = vec_scale(unit_vec(position), 100),
+                                 .a = {.v={0,0,0}},
+                                 .m = 10
+                               };
+
+	state_history h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	state end = h.states[h.length-1];
+
+	char * err = "\n  (-) Error: event_location_test1()\n        (+) Event not located\n";
+
+	// About 10 s up, 10 s down and another ~9 s to fall to GROUND
+	mu_assert(err, apogee_time > 9 && apogee_time < 11);
+	mu_assert(err, fabs(vertical_velocity(apogee_state)) < 1e-6);
+	mu_assert(err, h.times[h.length-1] < 40);
+	mu_assert(err, fabs(altitude(end.x) - GROUND) < 1e-6);
+
+	state_history_free(&h);
+
+	// Again over the ellipsoid, where the ground is GROUND above WGS-84
+	ctx.earth = &earth_wgs84;
+	h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	end = h.states[h.length-1];
+	mu_assert(err, fabs(earth_altitude(&earth_wgs84, end.x) - GROUND) < 1e-6);
+	mu_assert(err, fabs(altitude(end.x) - GROUND) > 10);
+
+	state_history_free(&h);
+
+	// More events than a flight has room for are refused, not overrun
+	event many[MAX_EVENTS + 1];
+	trajectory_sink sink;
+	memory_sink mem;
+	int k;
+	for (k=0;k<MAX_EVENTS+1;k++)
+		many[k] = events[0];
+	ctx.events = many;
+	ctx.event_count = MAX_EVENTS + 1;
+	sink_memory(&sink, &mem);
+	mu_assert(err, Integrate_Rocket_sink(&ctx, a_rocket, initial_conditions, &sink) == -1);
+	mu_assert(err, mem.history.length == 0);
+	state_history_free(&mem.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies a powered rocket with statistics compiled in and checks that
+ * the counters add up: every Cash-Karp attempt costs five RHS calls and every
+ * accepted step one more, plus one at the start and one to size the first
+ * step.
+ */
+char *integrator_stats_test1(void)
+{
+	int i;
+	long binned = 0;
+	sim_context ctx;
+	sim_stats total;
+
+	Init_Context(&ctx);
+	ctx.physics_model.drag_model = drag;
+	ctx.physics_model.thrust_model = thrust;
+	ctx.duration = 20;
+
+	double t[2] = {0,2};
+	double m[2] = {0.5,0.5};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = {.v={0,0,0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 20
+                               };
+	ctx.launch_axis = position;
+
+	state_history h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	sim_stats *s = &ctx.stats;
+
+	char * err = "\n  (-) Error: integrator_stats_test1()\n        (+) Statistics do not add up\n";
+
+	mu_assert(err, s->accepted > 0);
+	mu_assert(err, s->derivs == 2 + ctx.integrator->stages*(s->accepted + s->rejected) + s->accepted);
+	mu_assert(err, s->h_min > 0 && s->h_min <= s->h_sum / s->accepted);
+	mu_assert(err, s->h_sum / s->accepted <= s->h_max);
+	mu_assert(err, fabs(s->h_sum - h.times[h.length-1]) < 1e-9);
+	for (i=0;i<STATS_BINS;i++)
+		binned += s->h_hist[i];
+	mu_assert(err, binned == s->accepted);
+	mu_assert(err, s->wall > 0 && s->t_thrust > 0 && s->t_drag > 0);
+
+	// A second run doubles a merged total
+	stats_reset(&total);
+	stats_merge(&total, s);
+	state_history_free(&h);
+	h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	stats_merge(&total, &ctx.stats);
+	mu_assert(err, total.accepted == 2*ctx.stats.accepted);
+	mu_assert(err, total.derivs == 2*ctx.stats.derivs);
+
+	state_history_free(&h);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies the same coast with Cash-Karp and Dormand-Prince and checks
+ * they agree, and that Dormand-Prince reuses its last stage: no RHS call
+ * outside the steps but the very first and the one sizing the first step.
+ */
+char *dopri5_test1(void)
+{
+	sim_context ck, dp;
+
+	Init_Context(&ck);
+	ck.physics_model.drag_model = drag;
+	ck.duration = 30;
+	dp = ck;
+	dp.integrator = &rk_dopri5;
+
+	double t[2] = {0,1};
+	double m[2] = {0,0};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = vec_scale(unit_vec(position), 300),
+                                 .a = {.v={0,0,0}},
+                                 .m = 10
+                               };
+
+	state_history a = Integrate_Rocket_r(&ck, a_rocket, initial_conditions);
+	state_history b = Integrate_Rocket_r(&dp, a_rocket, initial_conditions);
+	state end_a = a.states[a.length-1];
+	state end_b = b.states[b.length-1];
+	sim_stats *s = &dp.stats;
+
+	char * err = "\n  (-) Error: dopri5_test1()\n        (+) Dormand-Prince off Cash-Karp\n";
+
+	mu_assert(err, a.times[a.length-1] == b.times[b.length-1]);
+	mu_assert(err, fabs(altitude(end_a.x) - altitude(end_b.x)) < 1e-6);
+	mu_assert(err, fabs(norm(end_a.v) - norm(end_b.v)) < 1e-6);
+	mu_assert(err, s->derivs == 2 + rk_dopri5.stages*(s->accepted + s->rejected));
+
+	state_history_free(&a);
+	state_history_free(&b);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies a long coast at a tight tolerance with Cash-Karp and DOP853 on
+ * a 1 Hz grid and checks they agree at every grid point, both at the steps
+ * and on DOP853's own dense output, and that DOP853 takes far fewer steps.
+ */
+char *dop853_test1(void)
+{
+	int k;
+	trajectory_sink sink_a, sink_b;
+	memory_sink mem_a, mem_b;
+	sim_context ck, dp;
+
+	Init_Context(&ck);
+	ck.physics_model.drag_model = drag;
+	ck.duration = 60;
+	ck.eps = 1e-3;
+	ck.output_dt = 1;
+	dp = ck;
+	dp.integrator = &rk_dop853;
+
+	double t[2] = {0,1};
+	double m[2] = {0,0};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = vec_scale(unit_vec(position), 1000),
+                                 .a = {.v={0,0,0}},
+                                 .m = 10
+                               };
+
+	sink_memory(&sink_a, &mem_a);
+	sink_memory(&sink_b, &mem_b);
+	Integrate_Rocket_sink(&ck, a_rocket, initial_conditions, &sink_a);
+	Integrate_Rocket_sink(&dp, a_rocket, initial_conditions, &sink_b);
+
+	char * err = "\n  (-) Error: dop853_test1()\n        (+) DOP853 off Cash-Karp\n";
+
+	mu_assert(err, mem_a.history.length == 61 && mem_b.history.length == 61);
+	for (k=0;k<mem_a.history.length;k++)
+	{
+		state a = mem_a.history.states[k];
+		state b = mem_b.history.states[k];
+		mu_assert(err, mem_a.history.times[k] == mem_b.history.times[k]);
+		mu_assert(err, fabs(altitude(a.x) - altitude(b.x)) < 1e-6);
+		mu_assert(err, fabs(norm(a.v) - norm(b.v)) < 1e-6);
+	}
+	mu_assert(err, 3*dp.stats.accepted < ck.stats.accepted);
+
+	state_history_free(&mem_a.history);
+	state_history_free(&mem_b.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies a sounding rocket to about 1300 km with and without Kepler
+ * coasts above 100 km. Without drag the two must agree; the coasting run
+ * jumps to apogee and back down to 100 km and takes under half the steps,
+ * most of which are spent on the burn and the last 100 km.
+ */
+char *coast_test1(void)
+{
+	int k;
+	trajectory_sink sink_a, sink_b;
+	memory_sink mem_a, mem_b;
+	sim_context full, fast;
+
+	Init_Context(&full);
+	full.physics_model.thrust_model = thrust;
+	full.duration = 3000;
+	full.output_dt = 50;
+	full.eps = 1;
+
+	double t[2] = {0,20};
+	double m[2] = {2,2};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 300 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = {.v={0,0,0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 50
+                               };
+	full.launch_axis = position;
+	fast = full;
+	fast.coast_altitude = 100e3;
+
+	sink_memory(&sink_a, &mem_a);
+	sink_memory(&sink_b, &mem_b);
+	Integrate_Rocket_sink(&full, a_rocket, initial_conditions, &sink_a);
+	Integrate_Rocket_sink(&fast, a_rocket, initial_conditions, &sink_b);
+
+	char * err = "\n  (-) Error: coast_test1()\n        (+) Kepler coast off the integrated flight\n";
+
+	mu_assert(err, fast.stats.coasts == 2);
+	mu_assert(err, 2*fast.stats.accepted < full.stats.accepted);
+	mu_assert(err, mem_a.history.length == mem_b.history.length);
+
+	// Every grid point, then the ground
+	for (k=0;k<mem_a.history.length;k++)
+	{
+		state a = mem_a.history.states[k];
+		state b = mem_b.history.states[k];
+		mu_assert(err, fabs(mem_a.history.times[k] - mem_b.history.times[k]) < 1e-6);
+		mu_assert(err, fabs(altitude(a.x) - altitude(b.x)) < 1e-3);
+		mu_assert(err, fabs(norm(a.v) - norm(b.v)) < 1e-6);
+	}
+
+	state_history_free(&mem_a.history);
+	state_history_free(&mem_b.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * Spherical gravity that no kernel knows about
+ */
+static void gravity_sphere_wrapped(const rk_state *s, const sim_context *ctx, vec *f)
+{
+	gravity_sphere(s, ctx, f);
+}
+
+/**
+ * @test Flies a powered flight with drag through the compiled kernels and
+ * through the strategies, with Cash-Karp and Dormand-Prince and with
+ * spherical and J2 gravity, and checks the
+ * trajectories are bit for bit the same. Models no kernel was built for fall
+ * back to the strategies.
+ */
+char *kernel_test1(void)
+{
+	int k, j;
+	const integration_strategy *methods[2] = { &rk_cash_karp, &rk_dopri5 };
+	gravity models[2] = { gravity_sphere, gravity_j2 };
+	sim_context fixed, generic;
+
+	double t[3] = {0, 2, 4};
+	double m[3] = {1, 0.5, 0.5};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 2, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position,
+                                 .v = {.v={0,0,0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 20
+                               };
+
+	char * err = "\n  (-) Error: kernel_test1()\n        (+) Compiled kernel off the strategies\n";
+
+	for (j=0;j<4;j++)
+	{
+		Init_Context(&fixed);
+		fixed.physics_model.gravity_model = models[j / 2];
+		fixed.physics_model.drag_model = drag;
+		fixed.physics_model.thrust_model = thrust;
+		fixed.integrator = methods[j % 2];
+		fixed.launch_axis = position;
+		fixed.duration = 200;
+		fixed.eps = 1e-3;
+		generic = fixed;
+		generic.specialize = 0;
+
+		state_history a = Integrate_Rocket_r(&fixed, a_rocket, initial_conditions);
+		state_history b = Integrate_Rocket_r(&generic, a_rocket, initial_conditions);
+
+		mu_assert(err, fixed.kernel != NULL && fixed.kernel->integrator == methods[j % 2]);
+		mu_assert(err, generic.kernel == NULL);
+		mu_assert(err, a.length == b.length && a.length > 10);
+		for (k=0;k<a.length;k++)
+		{
+			mu_assert(err, a.times[k] == b.times[k]);
+			mu_assert(err, a.states[k].x.v.i == b.states[k].x.v.i);
+			mu_assert(err, a.states[k].x.v.j == b.states[k].x.v.j);
+			mu_assert(err, a.states[k].x.v.k == b.states[k].x.v.k);
+			mu_assert(err, a.states[k].v.v.i == b.states[k].v.v.i);
+			mu_assert(err, a.states[k].v.v.j == b.states[k].v.v.j);
+			mu_assert(err, a.states[k].v.v.k == b.states[k].v.v.k);
+			mu_assert(err, a.states[k].m == b.states[k].m);
+		}
+		mu_assert(err, fixed.stats.derivs == generic.stats.derivs);
+		mu_assert(err, fixed.stats.rejected == generic.stats.rejected);
+
+		state_history_free(&a);
+		state_history_free(&b);
+	}
+
+	// No kernel for these models, the strategies are used
+	fixed.physics_model.gravity_model = gravity_sphere_wrapped;
+	state_history c = Integrate_Rocket_r(&fixed, a_rocket, initial_conditions);
+	mu_assert(err, fixed.kernel == NULL && c.length > 10);
+	state_history_free(&c);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies a spinning rocket straight up in 6-DOF, nose along the local
+ * vertical, with body axis thrust and body aero. Nothing tips it over on the
+ * way up, so it must follow the 3-DOF flight until apogee (after which it
+ * weathercocks nose down, which 3-DOF cannot); the spin axis stays vertical,
+ * and with no moment about it Ixx wx holds while Ixx shrinks with the burning
+ * propellant.
+ */
+char *six_dof_test1(void)
+{
+	int k, i;
+	sim_context ctx3, ctx6;
+	vec I, dI;
+
+	double t[3] = {0, 2, 4};
+	double m[3] = {1, 0.5, 0.5};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 2, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5,
+	                    .body = { .inertia_full = {.v={0.05, 10, 10}},
+	                              .inertia_empty = {.v={0.03, 8, 8}},
+	                              .mass_full = 20, .mass_empty = 17.5,
+	                              .CN_alpha = 10, .cp = 0.3, .diameter = 0.1, .Cmq = -20 } };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	vec up = unit_vec(position);
+	// Body x onto up: half way between them
+	quat q = quat_normalize((quat) {{ 1 + up.v.i, 0, -up.v.k, up.v.j }});
+	state initial_conditions = { .x = position, .m = 20 };
+
+	char * err = "\n  (-) Error: six_dof_test1()\n        (+) 6-DOF off 3-DOF\n";
+
+	Init_Context(&ctx3);
+	ctx3.physics_model.drag_model = drag;
+	ctx3.physics_model.thrust_model = thrust;
+	ctx3.launch_axis = position;
+	ctx3.duration = 25;
+	ctx3.output_dt = 1;
+	ctx3.eps = 1e-3;
+
+	ctx6 = ctx3;
+	ctx6.rigid_body = 1;
+	ctx6.initial_attitude = (state_attitude) { q, {.v={2, 0, 0}} };
+	ctx6.physics_model.body_drag_model = drag_body;
+	ctx6.physics_model.body_thrust_model = thrust_body;
+
+	state_history a = Integrate_Rocket_r(&ctx3, a_rocket, initial_conditions);
+	state_history b = Integrate_Rocket_r(&ctx6, a_rocket, initial_conditions);
+
+	mu_assert(err, ctx6.kernel == NULL && ctx6.neq == NEQ_6DOF && ctx3.neq == NEQ);
+	mu_assert(err, a.length == b.length && a.length > 20);
+	mu_assert(err, a.attitude == NULL && b.attitude[0].q.q.w == q.q.w);
+	for (k=0;k<a.length;k++)
+	{
+		const state *s = &b.states[k];
+		vec axis = quat_rotate(b.attitude[k].q, (vec) {{1, 0, 0}});
+
+		mu_assert(err, a.times[k] == b.times[k]);
+		for (i=0;i<3;i++)
+		{
+			mu_assert(err, fabs(a.states[k].x.component[i] - s->x.component[i]) < 1e-6);
+			mu_assert(err, fabs(a.states[k].v.component[i] - s->v.component[i]) < 1e-8);
+		}
+		mu_assert(err, fabs(a.states[k].m - s->m) < 1e-9);
+
+		mu_assert(err, norm(cross_prod(axis, up)) < 1e-12);
+		rigid_body_inertia(&a_rocket.body, s->m, &I, &dI);
+		mu_assert(err, fabs(I.v.i * b.attitude[k].omega.v.i - 0.05 * 2) < 1e-12);
+	}
+	// It spun up as Ixx went down
+	mu_assert(err, b.attitude[b.length-1].omega.v.i > 2 * 0.05 / 0.031);
+
+	state_history_free(&a);
+	state_history_free(&b);
+
+	return 0; // tests passed
+}
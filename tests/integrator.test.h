@@ -1 +1,10 @@
 char *OneDOF_balistic_test1(void);
+char *dense_output_test1(void);
+char *max_steps_test1(void);
+char *event_location_test1(void);
+char *integrator_stats_test1(void);
+char *dopri5_test1(void);
+char *dop853_test1(void);
+char *coast_test1(void);
+char *kernel_test1(void);
+char *six_dof_test1(void);
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../math/table.h"
+#include "../math/interpolation.h"
+#include "../math/runge-kutta.h"
+#include "../math/dormand-prince.h"
+#include "../math/dormand-prince-853.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "../math/trig.h"
+#include "test.h"
+#include "math.test.h"
+
+/**
+ * @test Builds a table in each mode and checks it against known answers: the
+ * natural spline against spline()/splint(), linear against a straight line,
+ * and monotone against a step it must not overshoot. Lookups with a hint must
+ * match lookups without one.
+ */
+char *table1d_test1(void)
+{
+	int i, hint = 0;
+	double x[6] = {0, 1, 2.5, 3, 5, 6};
+	double y[6], line[6], step[6] = {0, 0, 0, 1, 1, 1};
+	double y2[6], coef[TABLE_COEF_SIZE(6)];
+	table1d t;
+
+	for (i=0;i<6;i++)
+	{
+		y[i] = sin(x[i]);
+		line[i] = 2*x[i] + 1;
+	}
+
+	char * err = "\n  (-) Error: table1d_test1()\n        (+) Table lookup wrong\n";
+
+	// Natural spline
+	mu_assert(err, table1d_init(&t, x, y, 6, TABLE_SPLINE, coef) == 0);
+	mu_assert(err, !t.uniform);
+	spline(x, y, 6, 1e30, 1e30, y2);
+	for (i=0;i<=120;i++)
+	{
+		double xi = i*0.05, ys;
+		mu_assert(err, splint(x, y, y2, 6, xi, &ys) == 0);
+		mu_assert(err, fabs(table1d_eval(&t, xi, NULL) - ys) < 1e-12);
+		mu_assert(err, table1d_eval(&t, xi, &hint) == table1d_eval(&t, xi, NULL));
+	}
+
+	// Linear, held outside the table
+	mu_assert(err, table1d_init(&t, x, line, 6, TABLE_LINEAR, NULL) == 0);
+	mu_assert(err, fabs(table1d_eval(&t, 4.2, NULL) - 9.4) < 1e-12);
+	mu_assert(err, table1d_eval(&t, -1, NULL) == 1);
+	mu_assert(err, table1d_eval(&t, 7, NULL) == 13);
+
+	// Monotone
+	mu_assert(err, table1d_init(&t, x, step, 6, TABLE_MONOTONE, coef) == 0);
+	double last = 0;
+	for (i=0;i<=120;i++)
+	{
+		double v = table1d_eval(&t, i*0.05, &hint);
+		mu_assert(err, v >= last && v <= 1);
+		last = v;
+	}
+
+	// Evenly spaced tables find their segment directly
+	double u[5] = {0, 0.5, 1, 1.5, 2};
+	mu_assert(err, table1d_init(&t, u, step, 5, TABLE_SPLINE, coef) == 0);
+	mu_assert(err, t.uniform);
+	mu_assert(err, table1d_find(&t, 1.2, NULL) == 2);
+
+	// Bad breakpoints
+	mu_assert(err, table1d_init(&t, step, y, 6, TABLE_LINEAR, NULL) == -1);
+	mu_assert(err, table1d_init(&t, x, y, 6, TABLE_SPLINE, NULL) == -1);
+
+	return 0; // tests passed
+}
+
+/**
+ * Restricted three body problem, the Arenstorf orbit: a closed orbit whose
+ * step size swings over orders of magnitude near the moon
+ */
+static const double arenstorf_mu = 0.012277471;
+static long arenstorf_calls;
+
+static void arenstorf(double y[], double f[], double x, void *ctx)
+{
+	double mu = arenstorf_mu, mup = 1 - arenstorf_mu;
+	double d1 = pow((y[0]+mu)*(y[0]+mu) + y[1]*y[1], 1.5);
+	double d2 = pow((y[0]-mup)*(y[0]-mup) + y[1]*y[1], 1.5);
+
+	arenstorf_calls++;
+	f[0] = y[2];
+	f[1] = y[3];
+	f[2] = y[0] + 2*y[3] - mup*(y[0]+mu)/d1 - mu*(y[0]-mup)/d2;
+	f[3] = y[1] - 2*y[2] - mup*y[1]/d1 - mu*y[1]/d2;
+}
+
+/**
+ * One period of the Arenstorf orbit with rkqc(), returns the rejected attempts
+ */
+static long arenstorf_orbit(rk_control *ctl, double *miss)
+{
+	const double period = 17.0652165601579625588917206249;
+	double y[4] = {0.994, 0, 0, -2.00158510637908252240537862224};
+	double f[4], scale[4] = {1e-7, 1e-7, 1e-7, 1e-7};
+	double work[RK_WORK_SIZE(4)];
+	double x = 0, h, hdid, hnext;
+	long rejected = 0;
+
+	arenstorf(y, f, x, NULL);
+	h = rk_first_step(y, f, x, period, 1.0, scale, 5, 4, work, arenstorf, NULL);
+	while (x < period)
+	{
+		if (x + h > period)
+			h = period - x;
+		arenstorf_calls = 0;
+		rkqc(y, f, &x, h, 1.0, scale, &hdid, &hnext, ctl, 4, work, arenstorf, NULL);
+		rejected += arenstorf_calls / 5 - 1;
+		arenstorf(y, f, x, NULL);
+		h = hnext;
+	}
+
+	*miss = fabs(y[0] - 0.994) + fabs(y[1]);
+	return rejected;
+}
+
+/**
+ * @test Flies the Arenstorf orbit with the classic and the PI step size
+ * controller. Both must close the orbit; the PI controller must throw away
+ * far fewer attempts. Then asks every stepper for a tolerance no step can
+ * meet: each must give up with -1 and leave the state where it was.
+ */
+char *rk_control_test1(void)
+{
+	int i, k;
+	rk_control ctl;
+	double miss_classic, miss_pi;
+	long rejected_classic, rejected_pi;
+	const integration_strategy *methods[3] = { &rk_cash_karp, &rk_dopri5, &rk_dop853 };
+
+	rejected_classic = arenstorf_orbit(NULL, &miss_classic);
+	rk_control_init(&ctl);
+	rejected_pi = arenstorf_orbit(&ctl, &miss_pi);
+
+	char * err = "\n  (-) Error: rk_control_test1()\n        (+) PI controller no better than the classic one\n";
+
+	mu_assert(err, miss_classic < 1e-4 && miss_pi < 1e-4);
+	mu_assert(err, 3*rejected_pi < 2*rejected_classic);
+
+	err = "\n  (-) Error: rk_control_test1()\n        (+) Stepsize underflow not reported\n";
+	for (k=0;k<6;k++)
+	{
+		double y0[4] = {0.994, 0, 0, -2.00158510637908252240537862224};
+		double y[4], f[4], none[4] = {0, 0, 0, 0};
+		double work[RK_WORK_SIZE(4)];
+		double x = 0, hdid = -1, hnext = -1;
+
+		for (i=0;i<4;i++)
+			y[i] = y0[i];
+		arenstorf(y, f, x, NULL);
+		rk_control_init(&ctl);
+		mu_assert(err, methods[k/2]->step(y, f, &x, 0.01, 1.0, none, &hdid, &hnext,
+			(k & 1) ? &ctl : NULL, 4, work, arenstorf, NULL) == -1);
+		mu_assert(err, x == 0 && hdid == -1);
+		for (i=0;i<4;i++)
+			mu_assert(err, y[i] == y0[i]);
+	}
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Checks quaternion rotations against axis_angle_to_rotation_matrix():
+ * one rotation, two composed with quat_mult(), and a quaternion off unit
+ * length, which quat_to_dcm() must still turn into the same rotation.
+ */
+char *quaternion_test1(void)
+{
+	int i, j;
+	vec a = {.v={0.3, -1.2, 0.7}};
+	vec b = {.v={-0.5, 0.1, 2.0}};
+	vec p = {.v={1.5, -2.0, 0.25}};
+	quat qa = quat_from_axis_angle(a);
+	quat qb = quat_from_axis_angle(b);
+	quat big = qa;
+	mat3 Ma = axis_angle_to_rotation_matrix(a);
+	mat3 Mb = axis_angle_to_rotation_matrix(b);
+	mat3 C = quat_to_dcm(qa);
+	mat3 Cab = quat_to_dcm(quat_mult(qa, qb));
+	vec pa, pab, back;
+
+	char * err = "\n  (-) Error: quaternion_test1()\n        (+) Quaternion rotation off\n";
+
+	for (i=0;i<4;i++)
+		big.component[i] *= 1.001;
+	mat3 Cbig = quat_to_dcm(big);
+
+	for (i=0;i<3;i++)
+		for (j=0;j<3;j++)
+		{
+			mu_assert(err, fabs(C.component[i][j] - Ma.component[i][j]) < 1e-15);
+			mu_assert(err, fabs(Cbig.component[i][j] - Ma.component[i][j]) < 1e-15);
+		}
+
+	// a b rotates by b first
+	pab = matrix_mult(Ma, matrix_mult(Mb, p));
+	pa = matrix_mult(Cab, p);
+	for (i=0;i<3;i++)
+		mu_assert(err, fabs(pa.component[i] - pab.component[i]) < 1e-14);
+
+	// The transpose undoes it
+	back = matrix_mult_transpose(C, quat_rotate(qa, p));
+	for (i=0;i<3;i++)
+		mu_assert(err, fabs(back.component[i] - p.component[i]) < 1e-14);
+
+	mu_assert(err, fabs(norm(quat_rotate(qa, p)) - norm(p)) < 1e-14);
+	mu_assert(err, quat_normalize((quat) {{0, 0, 0, 0}}).q.w == 1);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Checks trig_sincos() and trig_atan2() against the C library over
+ * dense grids, to the error bounds trig.h states, and atan2's zeros and
+ * axes.
+ */
+char *trig_test1(void)
+{
+	int i, j;
+	double s, c, es = 0, ec = 0, ea = 0;
+
+	char * err = "\n  (-) Error: trig_test1()\n        (+) Approximation outside its error bound\n";
+
+	for (i=-300000;i<=300000;i++)
+	{
+		double x = i * 0.333333e-3 * ((i & 7) + 1);
+		trig_sincos(x, &s, &c);
+		es = fmax(es, fabs(s - sin(x)));
+		ec = fmax(ec, fabs(c - cos(x)));
+	}
+	mu_assert(err, es < 4e-16 && ec < 4e-16);
+
+	for (i=-500;i<=500;i++)
+	{
+		for (j=-500;j<=500;j++)
+		{
+			double y = i * 1.37e-3 * ((i % 5) + 1), x = j * 0.91e-3 * ((j % 7) + 1);
+			ea = fmax(ea, fabs(trig_atan2(y, x) - atan2(y, x)));
+		}
+	}
+	mu_assert(err, ea < 5e-16);
+
+	mu_assert(err, trig_atan2(0, 0) == 0 && trig_atan2(0, -1) == PI);
+	mu_assert(err, trig_atan2(-0.0, -1) == -PI && trig_atan2(1, 0) == PI / 2);
+	mu_assert(err, trig_atan2(-1, 1) == -PI / 4 && trig_atan2(1e-300, 1e300) == 0);
+
+	return 0; // tests passed
+}
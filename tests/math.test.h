@@ -0,0 +1,4 @@
+char *table1d_test1(void);
+char *rk_control_test1(void);
+char *quaternion_test1(void);
+char *trig_test1(void);
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../libsim.h"
+#include "../physics/thrust.h"
+#include "../physics/aero.h"
+#include "../montecarlo.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "../physics/models/earth.h"
+#include "../utils/coord.h"
+#include "test.h"
+#include "montecarlo.test.h"
+
+/**
+ * @test Flies a small dispersed batch on a thread pool and checks every sample
+ * against the same sample flown on its own. Results must not depend on which
+ * thread flew what.
+ */
+char *Monte_Carlo_repeatable_test(void)
+{
+	int i;
+	const int samples = 12;
+	mc_result batch[12];
+	mc_result single;
+
+	sim_context nominal;
+	Init_Context(&nominal);
+	nominal.physics_model.drag_model = drag;
+	nominal.physics_model.thrust_model = thrust;
+	nominal.duration = 2;
+
+	double t[2] = {0,1};
+	double m[2] = {0.1,0.1};
+	thrust_curve motor = { .time = t,
+                           .m_dot = m,
+                           .length = 1,
+                           .Isp = 200
+                         };
+	rocket a_rocket = { .thrust = motor,
+                        .area = 0.01,
+                        .Cd = 0.5
+                      };
+	state initial_conditions = { .x = {.v={-2414.59e3, -3771.092e3, 4528.117e3}},
+                                 .v = {.v={0,0,0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 20
+                               };
+	nominal.launch_axis = initial_conditions.x;
+
+	// Body x along the launch axis, the dispersion must keep it there
+	vec body_x = {.v={1, 0, 0}};
+	vec up = unit_vec(nominal.launch_axis);
+	nominal.initial_attitude.q = quat_from_axis_angle(vec_scale(unit_vec(cross_prod(body_x, up)),
+		acos(dot_prod(body_x, up))));
+
+	dispersion disp = { .mass_sigma = 0.02,
+                        .Cd_sigma = 0.05,
+                        .thrust_sigma = 0.03,
+                        .elevation_sigma = 0.01,
+                        .azimuth_sigma = 0.05,
+                        .wind_sigma = 3,
+                        .seed = 1234
+                      };
+
+	char * err = "\n  (-) Error: Monte_Carlo_repeatable_test()\n        (+) Batch and single runs disagree\n";
+
+	mu_assert(err, Monte_Carlo(&nominal, a_rocket, initial_conditions, &disp, samples, 4, batch) == 0);
+
+	for (i=0;i<samples;i++)
+	{
+		Monte_Carlo_Sample(&nominal, a_rocket, initial_conditions, &disp, i, &single);
+		mu_assert(err, batch[i].steps == single.steps);
+		mu_assert(err, batch[i].apogee == single.apogee);
+		mu_assert(err, batch[i].mass == single.mass);
+		mu_assert(err, batch[i].stats.accepted == single.stats.accepted);
+		mu_assert(err, batch[i].stats.rejected == single.stats.rejected);
+		mu_assert(err, batch[i].stats.derivs == single.stats.derivs);
+		mu_assert(err, batch[i].apogee > 0);
+
+		vec nose = quat_rotate(batch[i].attitude, body_x);
+		vec axis = unit_vec(batch[i].launch_axis);
+		mu_assert(err, batch[i].attitude.q.w == single.attitude.q.w);
+		mu_assert(err, fabs(nose.v.i - axis.v.i) < 1e-12 && fabs(nose.v.j - axis.v.j) < 1e-12
+			&& fabs(nose.v.k - axis.v.k) < 1e-12);
+	}
+
+	// Different samples really are dispersed
+	mu_assert(err, batch[0].mass != batch[1].mass);
+	mu_assert(err, batch[0].attitude.q.x != batch[1].attitude.q.x);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Flies a dispersed batch all the way down and checks that every sample
+ * lands, and that the impacts are spread out by the dispersion but stay
+ * around the nominal one.
+ */
+char *Monte_Carlo_landing_test(void)
+{
+	int i;
+	const int samples = 16;
+	mc_result batch[16];
+	mc_result nominal_result;
+	double spread = 0;
+
+	sim_context nominal;
+	Init_Context(&nominal);
+	nominal.physics_model.drag_model = drag;
+	nominal.physics_model.thrust_model = thrust;
+	nominal.duration = 300;
+
+	double t[2] = {0,2};
+	double m[2] = {1,1};
+	thrust_curve motor = { .time = t,
+                           .m_dot = m,
+                           .length = 1,
+                           .Isp = 200
+                         };
+	rocket a_rocket = { .thrust = motor,
+                        .area = 0.01,
+                        .Cd = 0.5
+                      };
+	state initial_conditions = { .x = {.v={-2414.59e3, -3771.092e3, 4528.117e3}},
+                                 .v = {.v={0,0,0}},
+                                 .a = {.v={0,0,0}},
+                                 .m = 20
+                               };
+	nominal.launch_axis = initial_conditions.x;
+
+	dispersion disp = { .Cd_sigma = 0.05,
+                        .elevation_sigma = 0.02,
+                        .azimuth_sigma = 0.05,
+                        .wind_sigma = 3,
+                        .seed = 99
+                      };
+	dispersion none = { .seed = 99 };
+
+	char * err = "\n  (-) Error: Monte_Carlo_landing_test()\n        (+) Dispersed flights did not land as expected\n";
+
+	Monte_Carlo_Sample(&nominal, a_rocket, initial_conditions, &none, 0, &nominal_result);
+	mu_assert(err, nominal_result.landed);
+
+	mu_assert(err, Monte_Carlo(&nominal, a_rocket, initial_conditions, &disp, samples, 4, batch) == 0);
+
+	for (i=0;i<samples;i++)
+	{
+		vec d = {{batch[i].impact.v.i - nominal_result.impact.v.i,
+		          batch[i].impact.v.j - nominal_result.impact.v.j,
+		          batch[i].impact.v.k - nominal_result.impact.v.k}};
+		double miss = norm(d);
+		mu_assert(err, !batch[i].failed && batch[i].landed);
+		mu_assert(err, fabs(earth_altitude(&earth_sphere, batch[i].impact) - GROUND) < 1e-6);
+		mu_assert(err, batch[i].impact_time > batch[i].apogee_time && batch[i].impact_time < nominal.duration);
+		spread += miss*miss;
+	}
+	spread = sqrt(spread / samples);
+
+	// 0.02 rad off vertical on a ~2.4 km apogee flight is a few hundred metres
+	mu_assert(err, spread > 50 && spread < 1000);
+
+	// Cut short in the air is not landed
+	nominal.duration = 20;
+	Monte_Carlo_Sample(&nominal, a_rocket, initial_conditions, &disp, 0, &batch[0]);
+	mu_assert(err, !batch[0].landed && batch[0].impact_time == 20);
+
+	// A context no flight can start from fails every sample, none landed
+	event many[MAX_EVENTS + 1];
+	for (i=0;i<MAX_EVENTS+1;i++)
+		many[i] = nominal.events[0];
+	nominal.events = many;
+	nominal.event_count = MAX_EVENTS + 1;
+	mu_assert(err, Monte_Carlo_Sample(&nominal, a_rocket, initial_conditions, &disp, 0, &batch[0]) == -1);
+	mu_assert(err, Monte_Carlo(&nominal, a_rocket, initial_conditions, &disp, samples, 4, batch) == -1);
+	for (i=0;i<samples;i++)
+		mu_assert(err, batch[i].failed && !batch[i].landed && batch[i].steps == 0 && batch[i].mass > 0);
+
+	return 0; // tests passed
+}
@@ -0,0 +1,2 @@
+char *Monte_Carlo_repeatable_test(void);
+char *Monte_Carlo_landing_test(void);
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../libsim.h"
+#include "../physics/atmosphere.h"
+#include "../physics/kepler.h"
+#include "../physics/gravity.h"
+#include "../physics/aero.h"
+#include "../physics/rigid_body.h"
+#include "../physics/thrust.h"
+#include "../physics/models/earth.h"
+#include "../math/vector.h"
+#include "../math/quaternion.h"
+#include "test.h"
+#include "physics.test.h"
+
+/**
+ * @test Checks the standard atmosphere against published 1976 values and the
+ * tables against the model they were built from.
+ */
+char *atmosphere_test1(void)
+{
+	int i;
+	// altitude, temperature, pressure, density from the 1976 tables
+	const double known[5][4] = {
+		{     0, 288.150, 101325.0, 1.22500    },
+		{ 10000, 223.252,  26499.9, 0.413510   },
+		{ 20000, 216.650,  5529.31, 0.0889097  },
+		{ 30000, 226.509,  1197.03, 0.0184101  },
+		{ 50000, 270.650,  79.7787, 0.00102688 },
+	};
+
+	atmosphere_init();
+
+	char * err = "\n  (-) Error: atmosphere_test1()\n        (+) Atmosphere off the standard\n";
+
+	for (i=0;i<5;i++)
+	{
+		atmosphere air = atmosphere_us76(known[i][0]);
+		mu_assert(err, fabs(air.temperature - known[i][1]) < 1e-3);
+		mu_assert(err, fabs(air.pressure / known[i][2] - 1) < 1e-5);
+		mu_assert(err, fabs(air.density / known[i][3] - 1) < 1e-5);
+	}
+
+	for (i=0;i<=9000;i++)
+	{
+		double h = -4900 + i*10.1;
+		atmosphere exact = atmosphere_us76(h);
+		atmosphere air = atmosphere_at(h);
+		mu_assert(err, fabs(air.temperature / exact.temperature - 1) < 1e-9);
+		mu_assert(err, fabs(air.density / exact.density - 1) < 1e-5);
+		mu_assert(err, fabs(air.speed_of_sound / exact.speed_of_sound - 1) < 1e-9);
+	}
+
+	// Thins out smoothly above the tables
+	atmosphere edge = atmosphere_at(86136);
+	atmosphere above = atmosphere_at(100000);
+	mu_assert(err, above.density < edge.density && above.density > 0);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Propagates a suborbital ellipse with kepler_at() and checks energy and
+ * angular momentum are kept, that a round trip comes back to the start, and
+ * that apoapsis and the crossing of a radius are where they are said to be.
+ */
+char *kepler_test1(void)
+{
+	const double mu = 3.986e14;
+	kepler_orbit k, back;
+	vec r, v, r2, v2;
+	double dt;
+
+	// 3 km/s, 45 degrees up, from the surface
+	vec r0 = {.v={6371e3, 0, 0}};
+	vec v0 = {.v={2121.32, 2121.32, 0}};
+	kepler_init(&k, r0, v0, 10, mu);
+
+	char * err = "\n  (-) Error: kepler_test1()\n        (+) Kepler coast off\n";
+
+	mu_assert(err, kepler_at(&k, 310, &r, &v) == 0);
+	double e0 = 0.5*dot_prod(v0, v0) - mu/norm(r0);
+	double e1 = 0.5*dot_prod(v, v) - mu/norm(r);
+	vec h0 = cross_prod(r0, v0);
+	vec h1 = cross_prod(r, v);
+	mu_assert(err, fabs(e1 - e0) < 1e-9*fabs(e0));
+	mu_assert(err, norm((vec){.v={h1.v.i-h0.v.i, h1.v.j-h0.v.j, h1.v.k-h0.v.k}}) < 1e-9*norm(h0));
+
+	kepler_init(&back, r, v, 310, mu);
+	mu_assert(err, kepler_at(&back, 10, &r2, &v2) == 0);
+	mu_assert(err, fabs(r2.v.i - r0.v.i) < 1e-6 && fabs(r2.v.j - r0.v.j) < 1e-6);
+	mu_assert(err, fabs(v2.v.i - v0.v.i) < 1e-9 && fabs(v2.v.j - v0.v.j) < 1e-9);
+
+	dt = kepler_time_to_apoapsis(&k);
+	mu_assert(err, dt > 0);
+	kepler_at(&k, 10 + dt, &r, &v);
+	mu_assert(err, fabs(dot_prod(r, v)) / norm(r) < 1e-6);
+
+	dt = kepler_time_to_radius(&k, 6371e3 + 100e3);
+	mu_assert(err, dt > kepler_time_to_apoapsis(&k));
+	kepler_at(&k, 10 + dt, &r, &v);
+	mu_assert(err, fabs(norm(r) - (6371e3 + 100e3)) < 1e-6);
+	mu_assert(err, dot_prod(r, v) < 0);
+
+	// Out of reach, or already below and falling
+	mu_assert(err, kepler_time_to_radius(&k, 10000e3) == -1);
+	kepler_init(&back, r, v, 0, mu);
+	mu_assert(err, kepler_time_to_radius(&back, 6371e3 + 200e3) == 0);
+	mu_assert(err, kepler_time_to_apoapsis(&back) == -1);
+
+	return 0; // tests passed
+}
+
+/**
+ * Potential of a field to degree N, summed term by term with the normalized
+ * Legendre functions built from their textbook definition
+ */
+static double potential(const gravity_field *g, int N, vec p, int from)
+{
+	double r = norm(p);
+	double t = p.v.k / r;                     // sin lat
+	double u = sqrt(1 - t*t);                 // cos lat
+	double lon = atan2(p.v.j, p.v.i);
+	double P[GRAVITY_SIZE(8)];
+	double U = 0;
+	int n, m, i;
+
+	for (m=0;m<=N;m++)
+	{
+		double pmm = 1;
+		for (i=1;i<=m;i++)
+			pmm *= (2*i - 1) * u;
+		P[GRAVITY_INDEX(m, m)] = pmm;
+		if (m + 1 <= N)
+			P[GRAVITY_INDEX(m+1, m)] = (2*m + 1) * t * pmm;
+		for (n=m+2;n<=N;n++)
+			P[GRAVITY_INDEX(n, m)] = ((2*n - 1) * t * P[GRAVITY_INDEX(n-1, m)]
+				- (n + m - 1) * P[GRAVITY_INDEX(n-2, m)]) / (n - m);
+	}
+
+	for (n=from;n<=N;n++)
+	{
+		for (m=0;m<=n;m++)
+		{
+			// Normalization sqrt((2 - d(m, 0)) (2n + 1) (n - m)! / (n + m)!)
+			double ratio = 1;
+			for (i=n-m+1;i<=n+m;i++)
+				ratio /= i;
+			double Nnm = sqrt((m ? 2.0 : 1.0) * (2*n + 1) * ratio);
+			int k = GRAVITY_INDEX(n, m);
+			U += pow(g->radius / r, n) * Nnm * P[k] * (g->C[k]*cos(m*lon) + g->S[k]*sin(m*lon));
+		}
+	}
+	return g->mu / r * U;
+}
+
+/**
+ * @test Checks the spherical harmonic gravity: degree 0 is gravity_sphere(),
+ * a J2 only field is gravity_j2(), EGM96 to degree 4 is the gradient of its
+ * potential, and far out the higher degrees are dropped.
+ */
+char *gravity_test1(void)
+{
+	sim_context ctx;
+	gravity_field j2;
+	double C[GRAVITY_SIZE(2)] = {0}, S[GRAVITY_SIZE(2)] = {0};
+	vec a, b;
+	int k;
+
+	Init_Context(&ctx);
+	const gravity_field *g = ctx.gravity_field;
+	rk_state s = { .x = {.v={-2414.59e3, -3771.092e3, 4528.117e3}}, .v = {.v={0, 0, 0}}, .m = 2 };
+	double a0 = g->mu * s.m / dot_prod(s.x, s.x);
+
+	char * err = "\n  (-) Error: gravity_test1()\n        (+) Harmonic gravity off\n";
+
+	mu_assert(err, g->degree == 4);
+
+	// Degree 0
+	a = b = (vec) {{0, 0, 0}};
+	ctx.gravity_degree = 0;
+	gravity_harmonic(&s, &ctx, &a);
+	gravity_sphere(&s, &ctx, &b);
+	for (k=0;k<3;k++)
+		mu_assert(err, fabs(a.component[k] - b.component[k]) < 1e-14 * a0);
+
+	// J2 alone
+	C[GRAVITY_INDEX(0, 0)] = 1;
+	C[GRAVITY_INDEX(2, 0)] = g->C[GRAVITY_INDEX(2, 0)];
+	mu_assert(err, gravity_field_init(&j2, 2, g->mu, g->radius, C, S) == 0);
+	ctx.gravity_field = &j2;
+	ctx.gravity_degree = 2;
+	a = b = (vec) {{0, 0, 0}};
+	gravity_harmonic(&s, &ctx, &a);
+	gravity_j2(&s, &ctx, &b);
+	for (k=0;k<3;k++)
+		mu_assert(err, fabs(a.component[k] - b.component[k]) < 1e-13 * a0);
+	mu_assert(err, fabs(a.v.k - a0 * s.x.v.k / norm(s.x)) > 1e-4 * a0);
+
+	// EGM96 to degree 4 against the potential, the point mass taken off both
+	ctx.gravity_field = g;
+	ctx.gravity_degree = 4;
+	a = b = (vec) {{0, 0, 0}};
+	gravity_harmonic(&s, &ctx, &a);
+	gravity_sphere(&s, &ctx, &b);
+	for (k=0;k<3;k++)
+	{
+		double h = 10;
+		vec p = s.x, q = s.x;
+		p.component[k] += h;
+		q.component[k] -= h;
+		double dU = (potential(g, 4, p, 2) - potential(g, 4, q, 2)) / (2*h);
+		mu_assert(err, fabs((a.component[k] - b.component[k]) / s.m - dU) < 1e-10 * a0 / s.m);
+	}
+
+	// Far out only the largest terms are kept
+	mu_assert(err, gravity_degree_at(&ctx, g->radius) == 4);
+	mu_assert(err, gravity_degree_at(&ctx, 100 * g->radius) == 2);
+	ctx.gravity_tol = 0;
+	mu_assert(err, gravity_degree_at(&ctx, 100 * g->radius) == 4);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Tumbles an asymmetric body, spun mostly about its unstable middle
+ * axis, with no moments on it and checks that its angular momentum (in ECEF)
+ * and rotational energy hold and the attitude stays a unit quaternion. Then
+ * checks that drag_body() turns a stable rocket into the wind.
+ */
+char *rigid_body_test1(void)
+{
+	int k, i;
+	sim_context ctx;
+	rocket body = { .body = { .inertia_full = {.v={1, 2, 3}}, .mass_full = 10, .mass_empty = 10,
+	                          .CN_alpha = 10, .cp = 0.3, .diameter = 0.1, .Cmq = -20 } };
+	state ic = { .x = {.v={6371e3 + 500e3, 0, 0}}, .m = 10 };
+	vec H0, H, Iw;
+	double T0, T, flipped = 0;
+
+	char * err = "\n  (-) Error: rigid_body_test1()\n        (+) Torque free body off\n";
+
+	Init_Context(&ctx);
+	ctx.rigid_body = 1;
+	ctx.initial_attitude = (state_attitude) { {{ .w = 1 }}, {.v={0.05, 2.0, 0.05}} };
+	ctx.duration = 20;
+	Set_Tolerances(&ctx, 1e-10, 1e-6, 1e-9, 1e-9);
+	Set_Attitude_Tolerances(&ctx, 1e-12, 1e-12);
+	state_history h = Integrate_Rocket_r(&ctx, body, ic);
+	mu_assert(err, h.length > 10 && h.times[h.length-1] > 19.99);
+
+	for (k=0;k<h.length;k++)
+	{
+		const state_attitude *s = &h.attitude[k];
+		for (i=0;i<3;i++)
+			Iw.component[i] = body.body.inertia_full.component[i] * s->omega.component[i];
+		H = quat_rotate(s->q, Iw);
+		T = 0.5 * dot_prod(s->omega, Iw);
+		if (k == 0)
+		{
+			H0 = H;
+			T0 = T;
+		}
+		mu_assert(err, fabs(H.v.i - H0.v.i) < 1e-8 && fabs(H.v.j - H0.v.j) < 1e-8
+			&& fabs(H.v.k - H0.v.k) < 1e-8);
+		mu_assert(err, fabs(T - T0) < 1e-8);
+		mu_assert(err, fabs(s->q.q.w*s->q.q.w + s->q.q.x*s->q.q.x + s->q.q.y*s->q.q.y
+			+ s->q.q.z*s->q.q.z - 1) < 1e-14);
+		flipped = fmin(flipped, s->omega.v.j);
+	}
+	// It did flip over, the middle axis is unstable
+	mu_assert(err, flipped < -1.9);
+	state_history_free(&h);
+
+	// Nose pointing below the airflow: the moment pitches it up into the wind
+	atmosphere air = atmosphere_at(0);
+	rk_state s = { .v = {.v={100, 0, 10}}, .m = 10 };
+	body_frame b = { .dcm = quat_to_dcm((quat) {{ .w = 1 }}) };
+	vec f = {{0, 0, 0}}, moment = {{0, 0, 0}}, f3 = {{0, 0, 0}};
+	ctx.vehicle = body;
+	ctx.vehicle.area = 0.01;
+	ctx.vehicle.Cd = 0.5;
+	drag_body(&s, &b, &air, &ctx, &f, &moment);
+	mu_assert(err, moment.v.j < 0 && moment.v.i == 0 && moment.v.k == 0);
+	mu_assert(err, f.v.k < 0 && f.v.i < 0);
+
+	// Straight into the wind it is drag()
+	s.v = (vec) {{100, 0, 0}};
+	f = (vec) {{0, 0, 0}};
+	moment = f;
+	drag_body(&s, &b, &air, &ctx, &f, &moment);
+	drag(&s, &air, &ctx, &f3);
+	mu_assert(err, f.v.i == f3.v.i && f.v.j == 0 && f.v.k == 0 && moment.v.j == 0);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Checks thrust() stays on the launch axis and thrust_gravity_turn()
+ * turns from it onto the velocity vector without a jump.
+ */
+char *thrust_test1(void)
+{
+	int i;
+	sim_context ctx;
+	double t[2] = {0,2};
+	double m[2] = {0.5,0.5};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 1, .Isp = 200 };
+	double F = 200 * g_0 * 0.5, mdot, turn, last = 0;
+	rk_state s = { .v = {.v={1000, 0, 0}}, .m = 20 };
+	vec f;
+
+	char * err = "\n  (-) Error: thrust_test1()\n        (+) Thrust direction off\n";
+
+	Init_Context(&ctx);
+	ctx.vehicle.thrust = motor;
+	ctx.launch_axis = (vec) {{0, 0, 2}};
+	mu_assert(err, thrust_init(&ctx) == 0);
+
+	// Fixed along the launch axis whatever the velocity
+	f = (vec) {{0, 0, 0}};
+	thrust(&s, 1, &ctx, &f, &mdot);
+	mu_assert(err, mdot == 0.5 && f.v.i == 0 && f.v.j == 0 && fabs(f.v.k - F) < 1e-12);
+
+	// Along the velocity vector once fast, within a degree
+	f = (vec) {{0, 0, 0}};
+	thrust_gravity_turn(&s, 1, &ctx, &f, &mdot);
+	mu_assert(err, fabs(norm(f) - F) < 1e-9 && f.v.i / F > cos(PI / 180));
+
+	// At rest on the launch axis, then turning smoothly through TURN_SPEED
+	for (i=0;i<=2000;i++)
+	{
+		s.v = (vec) {{i * 1e-3 * TURN_SPEED, 0, 0}};
+		f = (vec) {{0, 0, 0}};
+		thrust_gravity_turn(&s, 1, &ctx, &f, &mdot);
+		turn = atan2(f.v.i, f.v.k);
+		if (i == 0)
+			mu_assert(err, f.v.i == 0 && f.v.j == 0 && fabs(f.v.k - F) < 1e-12);
+		if (i == 1000)
+			mu_assert(err, fabs(turn - PI / 4) < 1e-12);
+		mu_assert(err, fabs(norm(f) - F) < 1e-9 && turn >= last && turn - last < 2e-3);
+		last = turn;
+	}
+
+	return 0; // tests passed
+}
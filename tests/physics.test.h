@@ -0,0 +1,5 @@
+char *atmosphere_test1(void);
+char *kepler_test1(void);
+char *gravity_test1(void);
+char *rigid_body_test1(void);
+char *thrust_test1(void);
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../libsim.h"
+#include "../physics/thrust.h"
+#include "../physics/aero.h"
+#include "../physics/models/earth.h"
+#include "../utils/coord.h"
+#include "../utils/boundary_conditions.h"
+#include "../math/vector.h"
+#include "../staging.h"
+#include "test.h"
+#include "staging.test.h"
+
+/**
+ * @test Flies a two stage rocket that drops its booster and an interstage at
+ * first burnout and its nose cone at second, with the fragments on a thread
+ * pool. Checks that the vehicle loses their mass at each separation, that
+ * every fragment starts from the vehicle's state there and falls to the
+ * ground, and that the record is the same however many workers flew it.
+ */
+char *staging_test1(void)
+{
+	int i, j, k;
+	flight_record a, b;
+	sim_context ctx;
+
+	double t1[2] = {0, 2}, m1[2] = {1, 1};
+	double t2[2] = {0, 2}, m2[2] = {0.5, 0.5};
+	double t3[2] = {0, 1}, m3[2] = {0, 0};
+	thrust_curve booster = { .time = t1, .m_dot = m1, .length = 1, .Isp = 200 };
+	thrust_curve sustainer = { .time = t2, .m_dot = m2, .length = 1, .Isp = 200 };
+	thrust_curve none = { .time = t3, .m_dot = m3, .length = 1, .Isp = 200 };
+	rocket first = { .thrust = booster, .area = 0.01, .Cd = 0.5 };
+	rocket second = { .thrust = sustainer, .area = 0.005, .Cd = 0.4 };
+	rocket coasting = { .thrust = none, .area = 0.005, .Cd = 0.6 };
+
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	vec east = unit_vec(cross_prod((vec) {.v={0, 0, 1}}, position));
+	fragment drop1[2] = { { .area = 0.02, .Cd = 1.0, .mass = 4 },
+	                      { .area = 0.005, .Cd = 1.2, .mass = 0.5, .dv = vec_scale(east, 5) } };
+	fragment drop2[1] = { { .area = 0.002, .Cd = 0.8, .mass = 0.2, .dv = vec_scale(east, -2) } };
+	stage stages[2] = { { boundary_condition_burnout, 1, second, drop1, 2 },
+	                    { boundary_condition_burnout, 1, coasting, drop2, 1 } };
+	state initial_conditions = { .x = position, .m = 20 };
+
+	char * err = "\n  (-) Error: staging_test1()\n        (+) Stages or fragments off\n";
+
+	Init_Context(&ctx);
+	ctx.physics_model.drag_model = drag;
+	ctx.physics_model.thrust_model = thrust;
+	ctx.launch_axis = position;
+	ctx.duration = 300;
+	ctx.eps = 1e-3;
+
+	mu_assert(err, Integrate_Stages(&ctx, first, initial_conditions, stages, 2, 4, &a) == 0);
+	mu_assert(err, Integrate_Stages(&ctx, first, initial_conditions, stages, 2, 1, &b) == 0);
+
+	mu_assert(err, a.stages_flown == 2 && a.fragment_count == 3);
+	mu_assert(err, fabs(a.stage_times[0] - 2) < 1e-6 && fabs(a.stage_times[1] - 4) < 1e-6);
+
+	// Two states at each separation, the second without the fragments
+	int seps = 0;
+	for (k=1;k<a.vehicle.length;k++)
+	{
+		mu_assert(err, a.vehicle.times[k] >= a.vehicle.times[k-1]);
+		if (a.vehicle.times[k] != a.vehicle.times[k-1])
+			continue;
+		const double dropped[2] = {4.5, 0.2};
+		mu_assert(err, a.vehicle.times[k] == a.stage_times[seps]);
+		mu_assert(err, fabs(a.vehicle.states[k-1].m - a.vehicle.states[k].m - dropped[seps]) < 1e-12);
+		seps++;
+	}
+	mu_assert(err, seps == 2);
+	mu_assert(err, fabs(altitude(a.vehicle.states[a.vehicle.length-1].x) - GROUND) < 1e-6);
+	mu_assert(err, fabs(a.vehicle.states[a.vehicle.length-1].m - (20 - 2 - 4.5 - 1 - 0.2)) < 1e-9);
+
+	for (i=0;i<a.fragment_count;i++)
+	{
+		const state_history *f = &a.fragments[i];
+		const fragment *frag = (i < 2) ? &drop1[i] : &drop2[0];
+		state start = f->states[0];
+		mu_assert(err, f->length > 2 && f->times[0] == a.stage_times[i < 2 ? 0 : 1]);
+		mu_assert(err, start.m == frag->mass);
+
+		// Where the vehicle was as it let go, plus the push
+		for (j=0;a.vehicle.times[j] != f->times[0];j++)
+			;
+		for (k=0;k<3;k++)
+		{
+			mu_assert(err, start.x.component[k] == a.vehicle.states[j].x.component[k]);
+			mu_assert(err, start.v.component[k] == a.vehicle.states[j].v.component[k]
+				+ frag->dv.component[k]);
+		}
+		mu_assert(err, fabs(altitude(f->states[f->length-1].x) - GROUND) < 1e-6);
+
+		// The same however it was scheduled
+		mu_assert(err, f->length == b.fragments[i].length);
+		for (k=0;k<f->length;k++)
+			mu_assert(err, f->times[k] == b.fragments[i].times[k]
+				&& f->states[k].x.v.i == b.fragments[i].states[k].x.v.i);
+	}
+	mu_assert(err, a.vehicle.length == b.vehicle.length);
+
+	flight_record_free(&a);
+	flight_record_free(&b);
+
+	// Fragments heavier than the vehicle, at launch and after the first burn
+	state light = initial_conditions;
+	light.m = 4;
+	mu_assert(err, Integrate_Stages(&ctx, first, light, stages, 2, 1, &a) == -1);
+	flight_record_free(&a);
+	light.m = 6.4;
+	mu_assert(err, Integrate_Stages(&ctx, first, light, stages, 2, 1, &a) == -1);
+	mu_assert(err, a.stages_flown == 0 && a.fragment_count == 0);
+	flight_record_free(&a);
+
+	return 0; // tests passed
+}
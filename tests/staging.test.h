@@ -0,0 +1 @@
+char *staging_test1(void);
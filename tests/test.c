@@ -24,7 +24,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "utils.test.h"
+#include "math.test.h"
+#include "physics.test.h"
 #include "integrator.test.h"
+#include "montecarlo.test.h"
+#include "staging.test.h"
 #include "test.h"
 
 int tests_run = 0;
@@ -33,8 +37,43 @@ static char * all_tests(void) {
 
 	// Run utils tests:
 	mu_run_test(ECEF2GEO_test);
+	mu_run_test(sink_decimate_test);
+	mu_run_test(trajfile_test1);
+	mu_run_test(packed_test1);
+	mu_run_test(columns_test1);
+	mu_run_test(coord_columns_test1);
+	mu_run_test(geodetic_test1);
+
+	// Run math tests:
+	mu_run_test(table1d_test1);
+	mu_run_test(rk_control_test1);
+	mu_run_test(quaternion_test1);
+	mu_run_test(trig_test1);
+
+	// Run physics tests:
+	mu_run_test(atmosphere_test1);
+	mu_run_test(kepler_test1);
+	mu_run_test(gravity_test1);
+	mu_run_test(rigid_body_test1);
+	mu_run_test(thrust_test1);
+
+	// Run Monte Carlo tests:
+	mu_run_test(Monte_Carlo_repeatable_test);
+	mu_run_test(Monte_Carlo_landing_test);
+
+	// Run staging tests:
+	mu_run_test(staging_test1);
 
 	// Run Integrator Tests:
+	mu_run_test(dense_output_test1);
+	mu_run_test(max_steps_test1);
+	mu_run_test(event_location_test1);
+	mu_run_test(integrator_stats_test1);
+	mu_run_test(dopri5_test1);
+	mu_run_test(dop853_test1);
+	mu_run_test(coast_test1);
+	mu_run_test(kernel_test1);
+	mu_run_test(six_dof_test1);
 	mu_run_test(OneDOF_balistic_test1);
 
 	return 0;
@@ -1,8 +1,20 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdint.h>
 #include "../libsim_types.h"
+#include "../libsim.h"
 #include "test.h"
 #include "../utils/coord.h"
+#include "../utils/sink.h"
+#include "../utils/trajfile.h"
+#include "../utils/packed.h"
+#include "../utils/columns.h"
+#include "../physics/aero.h"
+#include "../physics/thrust.h"
+#include "../math/quaternion.h"
+#include "../math/vector.h"
 #include "../physics/models/earth.h"
 #include "utils.test.h"
 
@@ -27,3 +39,436 @@ char *ECEF2GEO_test(void)
 
 	return 0; // tests passed
 }
+
+/**
+ * @test Pushes more than a chunk of states through a decimator into memory
+ * and checks that every n-th state plus the last one come out the other end.
+ */
+char *sink_decimate_test(void)
+{
+	int i;
+	trajectory_sink mem_sink, dec_sink;
+	memory_sink mem;
+	decimator dec;
+	state s = {.x = {.v={0,0,0}}, .v = {.v={0,0,0}}, .a = {.v={0,0,0}}, .m = 1};
+
+	sink_memory(&mem_sink, &mem);
+	sink_decimate(&dec_sink, &dec, 10, &mem_sink);
+
+	for (i=0;i<1000;i++)
+	{
+		s.m = i;
+		sink_push(&dec_sink, i*0.1, s, NULL);
+	}
+	sink_finish(&dec_sink);
+
+	char * err = "\n  (-) Error: sink_decimate_test()\n        (+) Wrong states kept\n";
+	mu_assert(err, mem.history.length == 101);
+	mu_assert(err, mem.history.states[1].m == 10);
+	mu_assert(err, mem.history.states[99].m == 990);
+	mu_assert(err, mem.history.states[100].m == 999);
+	mu_assert(err, mem.history.attitude == NULL);
+
+	state_history_free(&mem.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Writes a 6-DOF run of a few chunks to a trajectory file and reads it
+ * back next to a memory sink that saw the same states: every value must come
+ * back bit for bit, by block and by row. A truncated copy must be rejected.
+ */
+char *trajfile_test1(void)
+{
+	int i;
+	long n = 3*SINK_CHUNK + 17, rows, block, offset;
+	const char *path = "./build/tests/trajfile_test1.traj";
+	const char *cut = "./build/tests/trajfile_test1_cut.traj";
+	trajectory_sink file_sink, mem_sink;
+	traj_writer writer;
+	memory_sink mem;
+	traj_file file;
+	sim_context ctx;
+	state s = {.x = {.v={0,0,0}}, .v = {.v={0,0,0}}, .a = {.v={0,0,0}}, .m = 1};
+	state_attitude a = { {{ .w = 1 }}, {{0, 0, 0}} };
+	FILE *f;
+
+	char * err = "\n  (-) Error: trajfile_test1()\n        (+) Trajectory file does not match what was written\n";
+
+	Init_Context(&ctx);
+	ctx.rigid_body = 1;
+
+	f = fopen(path, "wb");
+	mu_assert(err, f != NULL);
+	mu_assert(err, sink_trajfile(&file_sink, &writer, f, &ctx, "trajfile_test1") == 0);
+	sink_memory(&mem_sink, &mem);
+
+	for (i=0;i<n;i++)
+	{
+		double t = i*0.01;
+		s.x.v.i = 6378137.0 + sin(t);
+		s.x.v.j = cos(t) / 3.0;
+		s.x.v.k = t*t;
+		s.v.v.i = cos(t);
+		s.a.v.k = -9.81 + t;
+		s.m = 100.0 - t;
+		a.q.q.w = cos(t/2);
+		a.q.q.x = sin(t/2);
+		a.omega.v.i = 1.0/(1.0 + t);
+		sink_push(&file_sink, t, s, &a);
+		sink_push(&mem_sink, t, s, &a);
+	}
+	sink_finish(&file_sink);
+	sink_finish(&mem_sink);
+	mu_assert(err, fclose(f) == 0);
+
+	mu_assert(err, traj_open(&file, path) == 0);
+	mu_assert(err, file.header->columns == TRAJ_COLUMNS_6DOF);
+	mu_assert(err, file.header->rows == (uint64_t) n && file.rows == n);
+	mu_assert(err, file.blocks == 4);
+
+	// Whole columns of the second block
+	const double *x = traj_column(&file, 1, TRAJ_X, &rows);
+	const double *qx = traj_column(&file, 1, TRAJ_QX, &rows);
+	mu_assert(err, rows == SINK_CHUNK);
+	for (i=0;i<rows;i++)
+	{
+		mu_assert(err, x[i] == mem.history.states[SINK_CHUNK + i].x.v.i);
+		mu_assert(err, qx[i] == mem.history.attitude[SINK_CHUNK + i].q.q.x);
+	}
+
+	// Every row, by row number
+	for (i=0;i<n;i++)
+	{
+		const state *m = &mem.history.states[i];
+		mu_assert(err, traj_value(&file, i, TRAJ_T) == mem.history.times[i]);
+		mu_assert(err, traj_value(&file, i, TRAJ_Y) == m->x.v.j);
+		mu_assert(err, traj_value(&file, i, TRAJ_AZ) == m->a.v.k);
+		mu_assert(err, traj_value(&file, i, TRAJ_M) == m->m);
+		mu_assert(err, traj_value(&file, i, TRAJ_QW) == mem.history.attitude[i].q.q.w);
+		mu_assert(err, traj_value(&file, i, TRAJ_WX) == mem.history.attitude[i].omega.v.i);
+	}
+	mu_assert(err, traj_find_row(&file, n - 1, &block, &offset) == 0);
+	mu_assert(err, block == 3 && offset == 16);
+	mu_assert(err, isnan(traj_value(&file, n, TRAJ_T)));
+
+	// Drop the end of the last block
+	f = fopen(cut, "wb");
+	mu_assert(err, f != NULL);
+	fwrite(file.base, 1, file.size - 8, f);
+	fclose(f);
+	traj_close(&file);
+
+	mu_assert(err, traj_open(&file, cut) != 0);
+
+	state_history_free(&mem.history);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Packs a flight with the default tolerances and unpacks it: every
+ * value must be within half its tolerance and the history at least 7 times
+ * smaller. Single states, by number and by time, must decode the same as
+ * the whole. With no tolerance at all it must come back exactly.
+ */
+char *packed_test1(void)
+{
+	int i, c;
+	long k;
+	sim_context ctx;
+	packed_history p;
+	state_history u;
+	pack_tolerance exact = {0, 0, 0, 0, 0, 0, 0};
+	double ti;
+	state s;
+	state_attitude att;
+
+	double t[3] = {0, 2, 4};
+	double m[3] = {1, 0.5, 0.5};
+	thrust_curve motor = { .time = t, .m_dot = m, .length = 2, .Isp = 200 };
+	rocket a_rocket = { .thrust = motor, .area = 0.01, .Cd = 0.5 };
+	vec position = {.v={-2414.59e3, -3771.092e3, 4528.117e3}};
+	state initial_conditions = { .x = position, .m = 20 };
+
+	char * err = "\n  (-) Error: packed_test1()\n        (+) Packed history does not match\n";
+
+	Init_Context(&ctx);
+	ctx.physics_model.drag_model = drag;
+	ctx.physics_model.thrust_model = thrust;
+	ctx.launch_axis = position;
+	ctx.duration = 200;
+	ctx.eps = 1e-6;
+
+	state_history h = Integrate_Rocket_r(&ctx, a_rocket, initial_conditions);
+	mu_assert(err, h.length > 1000);
+
+	mu_assert(err, packed_history_pack(&p, &h, NULL, 0) == 0);
+	mu_assert(err, h.attitude == NULL && p.length == h.length && p.attitude == 0);
+	mu_assert(err, p.size * 7 < h.length * (sizeof(double) + sizeof(state)));
+
+	mu_assert(err, packed_history_unpack(&p, &u) == 0);
+	mu_assert(err, u.length == h.length && u.attitude == NULL);
+	for (i=0;i<h.length;i++)
+	{
+		const state *a = &h.states[i], *b = &u.states[i];
+		mu_assert(err, fabs(h.times[i] - u.times[i]) <= 0.5e-6 + 1e-12);
+		for (c=0;c<3;c++)
+		{
+			mu_assert(err, fabs(a->x.component[c] - b->x.component[c]) <= 0.5e-3 + 1e-8);
+			mu_assert(err, fabs(a->v.component[c] - b->v.component[c]) <= 0.5e-4 + 1e-10);
+			mu_assert(err, fabs(a->a.component[c] - b->a.component[c]) <= 0.5e-3 + 1e-10);
+		}
+		mu_assert(err, fabs(a->m - b->m) <= 0.5e-4 + 1e-12);
+	}
+
+	// Random access
+	for (k=0;k<h.length;k+=97)
+	{
+		mu_assert(err, packed_history_get(&p, k, &ti, &s, &att) == 0);
+		mu_assert(err, ti == u.times[k] && s.x.v.j == u.states[k].x.v.j && s.m == u.states[k].m);
+		mu_assert(err, att.q.q.w == 1 && att.omega.v.i == 0);
+		mu_assert(err, packed_history_at(&p, 0.5*(u.times[k] + u.times[k+1]), &ti, &s, NULL) == k);
+		mu_assert(err, ti == u.times[k] && s.v.v.k == u.states[k].v.v.k);
+	}
+	mu_assert(err, packed_history_at(&p, u.times[u.length-1] + 1, &ti, &s, NULL) == u.length - 1);
+	mu_assert(err, packed_history_at(&p, -1, &ti, &s, NULL) == -1);
+	mu_assert(err, packed_history_get(&p, h.length, &ti, &s, NULL) == -1);
+
+	// Attitude can't change in a 3-DOF history
+	att.omega.v.i = 1;
+	mu_assert(err, packed_history_push(&p, ti + 1, &s, &att) == -1);
+
+	state_history_free(&u);
+	packed_history_free(&p);
+
+	// Exact, and spinning
+	h.attitude = malloc(sizeof(state_attitude) * h.length);
+	mu_assert(err, h.attitude != NULL);
+	for (i=0;i<h.length;i++)
+	{
+		h.attitude[i].q = quat_from_axis_angle((vec) {{0, 0, h.times[i]}});
+		h.attitude[i].omega = (vec) {{0, 0, 1}};
+	}
+	mu_assert(err, packed_history_pack(&p, &h, &exact, 50) == 0);
+	mu_assert(err, p.attitude == 1);
+	mu_assert(err, packed_history_unpack(&p, &u) == 0);
+	mu_assert(err, memcmp(h.times, u.times, sizeof(double) * h.length) == 0);
+	mu_assert(err, memcmp(h.states, u.states, sizeof(state) * h.length) == 0);
+	mu_assert(err, memcmp(h.attitude, u.attitude, sizeof(state_attitude) * h.length) == 0);
+
+	state_history_free(&u);
+	packed_history_free(&p);
+	state_history_free(&h);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Copies two histories into one set of columns and checks the column
+ * helpers against the functions they stand for, bit for bit, and that the
+ * histories come back out unchanged.
+ */
+char *columns_test1(void)
+{
+	int i, k;
+	state_history h[2];
+	state_columns c;
+	long first[3];
+	double alt[300], v_vel[300], range[300];
+	vec origin = {.v={RADIUS_EARTH, 0, 0}};
+
+	char * err = "\n  (-) Error: columns_test1()\n        (+) Columns do not match the history\n";
+
+	for (k=0;k<2;k++)
+	{
+		h[k].length = 100 + 100*k;
+		h[k].owned = 1;
+		h[k].times = malloc(sizeof(double) * h[k].length);
+		h[k].states = malloc(sizeof(state) * h[k].length);
+		h[k].attitude = malloc(sizeof(state_attitude) * h[k].length);
+		for (i=0;i<h[k].length;i++)
+		{
+			double a = i * 0.01;
+			h[k].times[i] = i * 0.1;
+			h[k].states[i] = (state) {
+				.x = {.v={(RADIUS_EARTH + 100*i) * cos(a), (RADIUS_EARTH + 100*i) * sin(a), k*1e3}},
+				.v = {.v={-sin(a) + k, cos(a), 3}},
+				.a = {.v={-9.81 + a, 0, 1}},
+				.m = 10 - a };
+			h[k].attitude[i] = (state_attitude) {
+				.q = quat_from_axis_angle((vec) {{0, 0, a}}),
+				.omega = {.v={0, 0, 1}} };
+		}
+	}
+	// Nothing at all is a point too
+	h[1].states[0].x = (vec) {{0, 0, 0}};
+
+	mu_assert(err, state_columns_from_histories(&c, h, 2, 1, first) == 0);
+	mu_assert(err, c.length == 300 && first[0] == 0 && first[1] == 100 && first[2] == 300);
+
+	altitude_columns(c.x, c.y, c.z, c.length, alt);
+	vertical_velocity_columns(c.x, c.y, c.z, c.vx, c.vy, c.vz, c.length, v_vel);
+	downrange_columns(c.x, c.y, c.z, c.length, origin, range);
+	for (k=0;k<2;k++)
+	{
+		for (i=0;i<h[k].length;i++)
+		{
+			mu_assert(err, alt[first[k] + i] == altitude(h[k].states[i].x));
+			mu_assert(err, v_vel[first[k] + i] == vertical_velocity(h[k].states[i]));
+		}
+	}
+	mu_assert(err, range[0] == 0);
+	mu_assert(err, fabs(range[99] - RADIUS_EARTH * 0.99) < 1e-6);
+
+	for (k=0;k<2;k++)
+	{
+		state_history back;
+		mu_assert(err, state_columns_to_history(&c, first[k], first[k+1] - first[k], &back) == 0);
+		mu_assert(err, back.length == h[k].length);
+		mu_assert(err, memcmp(back.times, h[k].times, sizeof(double) * back.length) == 0);
+		mu_assert(err, memcmp(back.states, h[k].states, sizeof(state) * back.length) == 0);
+		mu_assert(err, memcmp(back.attitude, h[k].attitude, sizeof(state_attitude) * back.length) == 0);
+		state_history_free(&back);
+		state_history_free(&h[k]);
+	}
+	state_columns_free(&c);
+	mu_assert(err, c.t == NULL && c.length == 0);
+
+	return 0; // tests passed
+}
+
+/**
+ * @test Runs the array transforms over points from the centre of the Earth
+ * to orbit and checks them against the one point versions: angles to the
+ * trig.h bounds (of the exact angle), rotations to the bit. ENU and back, and ENU2ECEF() after
+ * ECEF2ENU(), must give the points back.
+ */
+char *coord_columns_test1(void)
+{
+	enum {N = 203};
+	double x[N], y[N], z[N], lon[N], lat[N], alt[N], e[N], n[N], u[N], bx[N], by[N], bz[N];
+	double site_lon = -2.14031, site_lat = 0.79412;
+	mat3 T = ENU_matrix(site_lon, site_lat);
+	vec zero = {{0, 0, 0}};
+	vec site = GEO2ECEF((vec) {{site_lon, PI/2 - site_lat, 0}});
+	int i;
+
+	char * err = "\n  (-) Error: coord_columns_test1()\n        (+) Array transform off the one point version\n";
+
+	for (i=0;i<N;i++)
+	{
+		double r = (i == 0) ? 0 : RADIUS_EARTH + (i % 10) * 1e5;
+		x[i] = r * cos(i * 0.7) * sin(i * 0.3);
+		y[i] = r * sin(i * 0.7) * sin(i * 0.3);
+		z[i] = r * cos(i * 0.3);
+	}
+	x[1] = 0;   // on an axis
+	y[2] = 0;
+
+	ECEF2GEO_columns(x, y, z, N, lon, lat, alt);
+	for (i=0;i<N;i++)
+	{
+		vec geo = ECEF2GEO((vec) {{x[i], y[i], z[i]}});
+		// acos(z/r) in ECEF2GEO() loses digits near the poles, hence two checks
+		double colat = atan2(sqrt(x[i]*x[i] + y[i]*y[i]), z[i]);
+		mu_assert(err, fabs(lon[i] - geo.v.i) < 5e-16 && fabs(lat[i] - colat) < 5e-16);
+		mu_assert(err, fabs(lat[i] - geo.v.j) < 1e-13 && alt[i] == geo.v.k);
+	}
+
+	GEO2ECEF_columns(lon, lat, alt, N, bx, by, bz);
+	for (i=0;i<N;i++)
+	{
+		vec p = GEO2ECEF((vec) {{lon[i], lat[i], alt[i]}});
+		mu_assert(err, fabs(bx[i] - p.v.i) < 4e-9 && fabs(by[i] - p.v.j) < 4e-9
+		            && fabs(bz[i] - p.v.k) < 4e-9);
+	}
+
+	// Directions, the same as ECEF2ENU()
+	ECEF2ENU_columns(&T, zero, x, y, z, N, e, n, u);
+	for (i=0;i<N;i++)
+	{
+		vec enu = ECEF2ENU((vec) {{x[i], y[i], z[i]}}, site_lon, site_lat);
+		vec back = ENU2ECEF(enu, site_lon, site_lat);
+		mu_assert(err, e[i] == enu.v.i && n[i] == enu.v.j && u[i] == enu.v.k);
+		mu_assert(err, fabs(back.v.i - x[i]) < 1e-8 && fabs(back.v.j - y[i]) < 1e-8
+		            && fabs(back.v.k - z[i]) < 1e-8);
+	}
+
+	// Positions seen from the site
+	ECEF2ENU_columns(&T, site, x, y, z, N, e, n, u);
+	ENU2ECEF_columns(&T, site, e, n, u, N, bx, by, bz);
+	for (i=0;i<N;i++)
+		mu_assert(err, fabs(bx[i] - x[i]) < 1e-8 && fabs(by[i] - y[i]) < 1e-8
+		            && fabs(bz[i] - z[i]) < 1e-8);
+
+	// 1 km above the site is straight up
+	vec above = vec_scale(site, 1 + 1e3 / RADIUS_EARTH);
+	ECEF2ENU_columns(&T, site, &above.v.i, &above.v.j, &above.v.k, 1, e, n, u);
+	mu_assert(err, fabs(e[0]) < 1e-9 && fabs(n[0]) < 1e-9 && fabs(u[0] - 1e3) < 1e-9);
+
+	return 0; // tests passed
+}
+
+char *geodetic_test1(void)
+{
+	enum {N = 157};
+	double x[N], y[N], z[N], lon[N], lat[N], h[N], bx[N], by[N], bz[N];
+	const earth_shape *e = &earth_wgs84;
+	double b = e->a * (1 - e->f);
+	int i;
+
+	char * err = "\n  (-) Error: geodetic_test1()\n        (+) Geodetic conversion off\n";
+
+	// The sphere is altitude(), exactly
+	for (i=0;i<N;i++)
+	{
+		vec p = {{(i - 80) * 1e5, RADIUS_EARTH + i * 1e3, -3e6}};
+		mu_assert(err, earth_altitude(&earth_sphere, p) == altitude(p));
+		mu_assert(err, dot_prod(earth_up(&earth_sphere, p), unit_vec(p)) > 1 - 1e-15);
+	}
+
+	// Surface points of the ellipsoid
+	mu_assert(err, fabs(earth_altitude(e, (vec) {{e->a, 0, 0}})) < 1e-8);
+	mu_assert(err, fabs(earth_altitude(e, (vec) {{0, -e->a, 0}})) < 1e-8);
+	mu_assert(err, fabs(earth_altitude(e, (vec) {{0, 0, b}})) < 1e-8);
+	mu_assert(err, fabs(earth_altitude(e, (vec) {{0, 0, -b - 100}}) - 100) < 1e-8);
+
+	// Round trips, from below the ground to beyond geostationary orbit
+	for (i=0;i<N;i++)
+	{
+		vec geo = {{-PI + i * 0.04, -PI/2 + i * (PI / (N - 1)), -1e4 + (i % 13) * 4e6}};
+		vec p = geodetic2ECEF(e, geo);
+		vec back = ECEF2geodetic(e, p);
+		double s = sin(geo.v.j), c = cos(geo.v.j);
+		vec normal = {{c * cos(geo.v.i), c * sin(geo.v.i), s}};
+
+		double tol = 1e-8 * (1 + fabs(geo.v.k) / e->a);   // heights go out to 7 radii
+		mu_assert(err, fabs(back.v.j - geo.v.j) < 1e-14 && fabs(back.v.k - geo.v.k) < tol);
+		if (fabs(geo.v.j) < PI/2)
+			mu_assert(err, fabs(remainder(back.v.i - geo.v.i, 2*PI)) < 1e-14);
+		mu_assert(err, earth_altitude(e, p) == back.v.k);
+		mu_assert(err, norm(cross_prod(earth_up(e, p), normal)) < 1e-14
+		            && dot_prod(earth_up(e, p), normal) > 0);
+
+		x[i] = p.v.i;
+		y[i] = p.v.j;
+		z[i] = p.v.k;
+	}
+
+	// The columns agree with the one point version
+	ECEF2geodetic_columns(e, x, y, z, N, lon, lat, h);
+	geodetic2ECEF_columns(e, lon, lat, h, N, bx, by, bz);
+	for (i=0;i<N;i++)
+	{
+		vec geo = ECEF2geodetic(e, (vec) {{x[i], y[i], z[i]}});
+		mu_assert(err, fabs(lon[i] - geo.v.i) < 5e-16 && fabs(lat[i] - geo.v.j) < 1e-14);
+		double tol = 1e-8 * (1 + fabs(geo.v.k) / e->a);
+		mu_assert(err, fabs(h[i] - geo.v.k) < tol);
+		mu_assert(err, fabs(bx[i] - x[i]) < tol && fabs(by[i] - y[i]) < tol
+		            && fabs(bz[i] - z[i]) < tol);
+	}
+
+	return 0; // tests passed
+}
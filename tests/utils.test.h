@@ -1 +1,7 @@
 char *ECEF2GEO_test(void);
+char *sink_decimate_test(void);
+char *trajfile_test1(void);
+char *packed_test1(void);
+char *columns_test1(void);
+char *coord_columns_test1(void);
+char *geodetic_test1(void);
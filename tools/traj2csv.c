@@ -0,0 +1,93 @@
+/**
+ * Trajectory file to CSV
+ *
+ * Usage: traj2csv [-n] [-i] file.traj [column ...]
+ *   -n       no header line
+ *   -i       print the file's metadata to stderr
+ *   column   only these columns, by name (t x y z vx vy vz ax ay az m, and
+ *            qw qx qy qz wx wy wz for 6-DOF runs), in this order
+ *
+ * Values are printed with enough digits to read back exactly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../libsim_types.h"
+#include "../utils/sink.h"
+#include "../utils/trajfile.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: traj2csv [-n] [-i] file.traj [column ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	traj_file file;
+	const traj_header *h;
+	int header = 1, info = 0;
+	int select[TRAJ_COLUMNS_MAX];
+	int i, c, n = 0;
+	long b, r, rows;
+
+	for (i=1;i<argc && argv[i][0] == '-';i++)
+	{
+		if (strcmp(argv[i], "-n") == 0)
+			header = 0;
+		else if (strcmp(argv[i], "-i") == 0)
+			info = 1;
+		else
+			usage();
+	}
+	if (i >= argc)
+		usage();
+
+	if (traj_open(&file, argv[i]) != 0)
+	{
+		fprintf(stderr, "traj2csv: %s is not a readable trajectory file\n", argv[i]);
+		return 1;
+	}
+	h = file.header;
+
+	// Columns by name, or all of them
+	for (i++;i<argc;i++)
+	{
+		for (c=0;c<(int) h->columns;c++)
+			if (strncmp(argv[i], h->info[c].name, sizeof(h->info[c].name)) == 0)
+				break;
+		if (c == (int) h->columns || n == TRAJ_COLUMNS_MAX)
+		{
+			fprintf(stderr, "traj2csv: no column %s\n", argv[i]);
+			traj_close(&file);
+			return 1;
+		}
+		select[n++] = c;
+	}
+	if (n == 0)
+		for (c=0;c<(int) h->columns;c++)
+			select[n++] = c;
+
+	if (info)
+		fprintf(stderr, "label: %.64s\nintegrator: %.16s\neps: %g\nduration: %g s\nrows: %ld\n",
+			h->label, h->integrator, h->eps, h->duration, file.rows);
+
+	if (header)
+		for (c=0;c<n;c++)
+			printf("%.8s [%.8s]%c", h->info[select[c]].name, h->info[select[c]].unit,
+				(c == n-1) ? '\n' : ',');
+
+	for (b=0;b<file.blocks;b++)
+	{
+		const double *col[TRAJ_COLUMNS_MAX];
+		for (c=0;c<n;c++)
+			col[c] = traj_column(&file, b, select[c], &rows);
+		for (r=0;r<rows;r++)
+			for (c=0;c<n;c++)
+				printf("%.17g%c", col[c][r], (c == n-1) ? '\n' : ',');
+	}
+
+	traj_close(&file);
+	return ferror(stdout) ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Arena allocation
+ *
+ * @section DESCRIPTION
+ *
+ * A batch job flying millions of trajectories should not be calling malloc
+ * and free for every one of them. Give the context an arena instead, let each
+ * run allocate its history out of it, and reset the arena between runs: the
+ * same block is reused for every flight and the heap never fragments.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../libsim_types.h"
+#include "arena.h"
+
+/// Every allocation is aligned to this
+#define ARENA_ALIGN 16
+
+/**
+ * @brief Set up an arena with a malloc'd block
+ *
+ * @returns 0 on success, -1 if the block could not be allocated
+ */
+int arena_init(arena *a, size_t size)
+{
+	arena_init_buffer(a, malloc(size), size);
+	if (a->base == NULL)
+	{
+		a->size = 0;
+		return -1;
+	}
+	a->owned = 1;
+	return 0;
+}
+
+/**
+ * @brief Set up an arena on a caller supplied buffer
+ *
+ * The buffer must outlive the arena. Nothing is ever malloc'd or freed.
+ */
+void arena_init_buffer(arena *a, void *buffer, size_t size)
+{
+	a->base = buffer;
+	a->size = size;
+	a->used = 0;
+	a->high_water = 0;
+	a->owned = 0;
+}
+
+/**
+ * @brief Allocate from the arena
+ *
+ * @returns The memory, or NULL if the arena is full
+ */
+void *arena_alloc(arena *a, size_t bytes)
+{
+	// Align relative to the real address so caller buffers need not be aligned
+	size_t addr = (size_t) (a->base + a->used);
+	size_t pad = (ARENA_ALIGN - addr % ARENA_ALIGN) % ARENA_ALIGN;
+	void *p;
+
+	if (a->base == NULL || bytes > a->size - a->used || pad > a->size - a->used - bytes)
+		return NULL;
+
+	p = a->base + a->used + pad;
+	a->used += pad + bytes;
+	if (a->used > a->high_water)
+		a->high_water = a->used;
+
+	return p;
+}
+
+/**
+ * @brief Give back everything allocated so far
+ */
+void arena_reset(arena *a)
+{
+	a->used = 0;
+}
+
+/**
+ * @brief Release the arena's block, if it owns one
+ */
+void arena_free(arena *a)
+{
+	if (a->owned)
+		free(a->base);
+	a->base = NULL;
+	a->size = 0;
+	a->used = 0;
+	a->owned = 0;
+}
@@ -0,0 +1,20 @@
+/**
+ * @brief Bump allocator
+ *
+ * Memory is handed out from one block and only given back all at once with
+ * arena_reset(). The block is either malloc'd (arena_init()) or supplied by
+ * the caller (arena_init_buffer()), in which case nothing is ever malloc'd.
+ */
+struct arena {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+	size_t high_water;   ///< most ever used, for sizing buffers
+	int owned;           ///< base came from malloc
+};
+
+int arena_init(arena *a, size_t size);
+void arena_init_buffer(arena *a, void *buffer, size_t size);
+void *arena_alloc(arena *a, size_t bytes);
+void arena_reset(arena *a);
+void arena_free(arena *a);
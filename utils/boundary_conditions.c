@@ -22,70 +22,71 @@
  *
  * The integration is asked to run between a beginning time and an ending time
  * however sometimes we would like to stop the integration at some in between 
- * point based on some condition, for example hitting the gound.
+ * point based on some condition, for example hitting the gound, or just know
+ * exactly when something happened, like apogee.
  *
- * astraea() takes a pointer to a function to find the boundary contitions for 
- * the integration. This file contains common usefull and reusable conditons in 
- * the required format.
+ * Conditions are written as event functions that cross zero where the event
+ * happens. The integrator evaluates them after every step and, when one
+ * changes sign, finds the crossing on the step's dense output, so the event
+ * time is exact to the event tolerance no matter how big the step was.
+ *
+ * This file contains common usefull and reusable conditons in the required
+ * format.
  */
 #include <stdio.h>
 #include <math.h>
 #include "../libsim_types.h"
-#include "../math/interpolation.h"
+#include "../physics/models/earth.h"
 #include "coord.h"
 #include "boundary_conditions.h"
 
 /**
  * @brief Ground impact condition
  * 
- * Use this condition for when you want to stop the integration when the vehicle 
- * hits the ground.
+ * Use this condition (falling, terminal) for when you want to stop the
+ * integration when the vehicle hits the ground.
  *
- * @param history An array of the last few states
- * @param x_history A corisponding array of the last few times
- * @param point_history Number of elements in the arrays
- * @param x2 The current guess for boundary condition time
+ * @param s Current state
+ * @param t Current time
+ * @param ctx Simulation context
  *
- * @returns A guess for the boundary condition time 
+ * @returns Height above the ground
  */
-double boundary_condition_ground(state *history, double *x_history, int point_history, double x2)
+double boundary_condition_ground(state s, double t, const sim_context *ctx)
 {
-    double current_altitude = altitude(history[0].x);
-
-    // Condition
-    if (current_altitude < 0)
-    {
-      double last_alt = altitude(history[1].x);
-      x2 = linear_interpolate(last_alt, x_history[1], current_altitude, x_history[0], 0.0);
-    }
-
-    return x2;
+    return earth_altitude(ctx->earth, s.x) - GROUND;
 }
 
 /**
  * @brief Maximum height condition
  * 
- * Use this condition for when you have a simple balistic trajectory that reaches
- * a maximum height and then falls. It will allow the simulation to break at the 
- * maximum height.
+ * Use this condition (falling) to find the apogee of a trajectory. Made
+ * terminal it will allow the simulation to break at the maximum height.
  *
- * @param history An array of the last few states
- * @param x_history A corisponding array of the last few times
- * @param point_history Number of elements in the arrays
- * @param x2 The current guess for boundary condition time
+ * @param s Current state
+ * @param t Current time
+ * @param ctx Simulation context
  *
- * @returns A guess for the boundary condition time 
+ * @returns Vertical velocity
  */ 
-double boundary_condition_max_alt(state *history, double *x_history, int point_history, double x2)
+double boundary_condition_max_alt(state s, double t, const sim_context *ctx)
 {
-    double current_velocity = vertical_velocity(history[0]);
-
-    // Condition
-    if (current_velocity < 0)
-    {
-      double last_vel = vertical_velocity(history[1]);
-      x2 = linear_interpolate(last_vel, x_history[1], current_velocity, x_history[0], 0.0);
-    }
+    return vertical_velocity(s);
+}
 
-    return x2;
+/**
+ * @brief Motor burnout condition
+ * 
+ * Use this condition (rising) to find the end of the thrust curve.
+ *
+ * @param s Current state
+ * @param t Current time
+ * @param ctx Simulation context
+ *
+ * @returns Time since burnout
+ */ 
+double boundary_condition_burnout(state s, double t, const sim_context *ctx)
+{
+    const thrust_curve *curve = &ctx->vehicle.thrust;
+    return t - curve->time[curve->length];
 }
@@ -1,2 +1,3 @@
-double boundary_condition_ground(state *history, double *x_history, int point_history, double x2);
-double boundary_condition_max_alt(state *history, double *x_history, int point_history, double x2);
+double boundary_condition_ground(state s, double t, const sim_context *ctx);
+double boundary_condition_max_alt(state s, double t, const sim_context *ctx);
+double boundary_condition_burnout(state s, double t, const sim_context *ctx);
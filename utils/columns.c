@@ -0,0 +1,183 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Column histories
+ *
+ * @section DESCRIPTION
+ *
+ * A state_history is an array of states, so a loop over one value of every
+ * state steps 120 bytes at a time. state_columns keeps each value in its
+ * own array instead; the *_columns() helpers in coord.c work on those.
+ *
+ * Histories are copied in once, possibly many of them one after the other,
+ * e.g. every flight of a Monte Carlo run, with first[] saying where each
+ * one starts.
+ */
+#include <stdlib.h>
+#include "../libsim_types.h"
+#include "../libsim.h"
+#include "columns.h"
+
+#define COLUMNS_3DOF 11
+#define COLUMNS_6DOF 18
+
+/**
+ * Point the column pointers into one block of length rows
+ */
+static void columns_assign(state_columns *c, double *block, long length, int attitude)
+{
+	double **col[COLUMNS_6DOF] = {
+		&c->t, &c->x, &c->y, &c->z, &c->vx, &c->vy, &c->vz, &c->ax, &c->ay, &c->az, &c->m,
+		&c->qw, &c->qx, &c->qy, &c->qz, &c->wx, &c->wy, &c->wz
+	};
+	int i;
+
+	for (i=0;i<COLUMNS_6DOF;i++)
+		*col[i] = (block && (i < COLUMNS_3DOF || attitude)) ? block + i*length : NULL;
+	c->length = length;
+}
+
+/**
+ * @brief Copy a history into columns
+ *
+ * @param attitude Also copy q and omega, the identity and no rotation for a
+ *                 history without attitude
+ *
+ * @returns 0, or -1 if out of memory
+ */
+int state_columns_from_history(state_columns *c, const state_history *h, int attitude)
+{
+	return state_columns_from_histories(c, h, 1, attitude, NULL);
+}
+
+/**
+ * @brief Copy count histories into columns, one after the other
+ *
+ * @param first If not NULL, count + 1 entries: the row each history starts
+ *              at, then the total
+ *
+ * @returns 0, or -1 if out of memory
+ */
+int state_columns_from_histories(state_columns *c, const state_history *h, int count,
+	int attitude, long *first)
+{
+	static const state_attitude level = { {{ .w = 1 }}, {{0, 0, 0}} };
+	long length = 0, row = 0;
+	double *block;
+	int k, i;
+
+	for (k=0;k<count;k++)
+		length += h[k].length;
+
+	block = malloc(sizeof(double) * (attitude ? COLUMNS_6DOF : COLUMNS_3DOF)
+		* (length ? length : 1));
+	if (block == NULL)
+		return -1;
+	columns_assign(c, block, length, attitude);
+
+	for (k=0;k<count;k++)
+	{
+		if (first)
+			first[k] = row;
+		for (i=0;i<h[k].length;i++, row++)
+		{
+			const state *s = &h[k].states[i];
+			c->t[row] = h[k].times[i];
+			c->x[row] = s->x.v.i;
+			c->y[row] = s->x.v.j;
+			c->z[row] = s->x.v.k;
+			c->vx[row] = s->v.v.i;
+			c->vy[row] = s->v.v.j;
+			c->vz[row] = s->v.v.k;
+			c->ax[row] = s->a.v.i;
+			c->ay[row] = s->a.v.j;
+			c->az[row] = s->a.v.k;
+			c->m[row] = s->m;
+			if (attitude)
+			{
+				const state_attitude *a = h[k].attitude ? &h[k].attitude[i] : &level;
+				c->qw[row] = a->q.q.w;
+				c->qx[row] = a->q.q.x;
+				c->qy[row] = a->q.q.y;
+				c->qz[row] = a->q.q.z;
+				c->wx[row] = a->omega.v.i;
+				c->wy[row] = a->omega.v.j;
+				c->wz[row] = a->omega.v.k;
+			}
+		}
+	}
+	if (first)
+		first[count] = row;
+
+	return 0;
+}
+
+/**
+ * @brief Copy rows first to first + length - 1 back into a new history
+ *
+ * The history has attitude only if the columns do. It is released with
+ * state_history_free().
+ *
+ * @returns 0, or -1 if out of memory or the rows are not there
+ */
+int state_columns_to_history(const state_columns *c, long first, long length, state_history *h)
+{
+	long i;
+
+	h->length = 0;
+	h->owned = 1;
+	h->times = NULL;
+	h->states = NULL;
+	h->attitude = NULL;
+	if (first < 0 || length < 0 || first + length > c->length)
+		return -1;
+
+	h->times = malloc(sizeof(double) * (length ? length : 1));
+	h->states = malloc(sizeof(state) * (length ? length : 1));
+	if (c->qw)
+		h->attitude = malloc(sizeof(state_attitude) * (length ? length : 1));
+	if (h->times == NULL || h->states == NULL || (c->qw && h->attitude == NULL))
+	{
+		state_history_free(h);
+		return -1;
+	}
+
+	for (i=0;i<length;i++)
+	{
+		long r = first + i;
+		state *s = &h->states[i];
+		h->times[i] = c->t[r];
+		s->x = (vec) {{c->x[r], c->y[r], c->z[r]}};
+		s->v = (vec) {{c->vx[r], c->vy[r], c->vz[r]}};
+		s->a = (vec) {{c->ax[r], c->ay[r], c->az[r]}};
+		s->m = c->m[r];
+		if (c->qw)
+		{
+			h->attitude[i].q = (quat) {{c->qw[r], c->qx[r], c->qy[r], c->qz[r]}};
+			h->attitude[i].omega = (vec) {{c->wx[r], c->wy[r], c->wz[r]}};
+		}
+	}
+	h->length = (int) length;
+
+	return 0;
+}
+
+void state_columns_free(state_columns *c)
+{
+	free(c->t);
+	columns_assign(c, NULL, 0, 0);
+}
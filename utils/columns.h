@@ -0,0 +1,8 @@
+/**
+ * Column (structure of arrays) histories, see columns.c
+ */
+int state_columns_from_history(state_columns *c, const state_history *h, int attitude);
+int state_columns_from_histories(state_columns *c, const state_history *h, int count,
+	int attitude, long *first);
+int state_columns_to_history(const state_columns *c, long first, long length, state_history *h);
+void state_columns_free(state_columns *c);
@@ -2,8 +2,19 @@
 #include "../libsim_types.h"
 #include "../physics/models/earth.h"
 #include "../math/vector.h"
+#include "../math/trig.h"
 #include "coord.h"
 
+/**
+ * Points the array transforms work on at a time. Each block is copied into
+ * local arrays, so that the loop over it has a fixed count and nothing
+ * aliases: the compiler vectorizes it even at -O2.
+ */
+#define COORD_BLOCK 8
+
+const earth_shape earth_sphere = {"sphere", RADIUS_EARTH, 0, 0};
+const earth_shape earth_wgs84 = {"wgs84", WGS84_A, WGS84_F, WGS84_F * (2 - WGS84_F)};
+
 vec ECEF2GEO(vec v)
 {
 	double r   = 0;
@@ -58,18 +69,9 @@ vec GEO2ECEF(vec v)
  */
 vec ECEF2ENU(vec v, double lon, double lat)
 {
-  mat3 T;
-  double slon = sin(lon);
-  double clon = cos(lon);
-  double slat = sin(lat);
-  double clat = cos(lat);
-  
+  mat3 T = ENU_matrix(lon, lat);
   vec enu;
   
-  T.m.x1 =   -slon;    T.m.y1 =    clon;    T.m.z1 =   0;
-  T.m.x2 = -slat*clon; T.m.y2 = -slat*slon; T.m.z2 = clat;
-  T.m.x3 =  clat*clon; T.m.y3 =  clat*slon; T.m.z3 = slat;
-  
   enu = matrix_mult(T, v);
   return enu;
 }
@@ -85,20 +87,34 @@ vec ECEF2ENU(vec v, double lon, double lat)
  */
 vec ENU2ECEF(vec enu, double lon, double lat)
 {
-	double slon = sin(lon);
-	double clon = cos(lon);
-	double slat = sin(lat);
-	double clat = cos(lat);
-
-	mat3 R = { .m={ .x1=-slon,  .x2=-clon*slat,  .x3=clon*clat,
-                    .y1=clon,   .y2=-slon*slat,  .y3=slon*clat,
-                    .z1=0,      .z2=clat,        .z3=slat,      }};
+	mat3 T = ENU_matrix(lon, lat);
 
-	// Rotate
-	vec ecef = matrix_mult(R, enu);
+	// Rotate back, the inverse of a rotation is its transpose
+	vec ecef = matrix_mult_transpose(T, enu);
 	return ecef;
 }
 
+/**
+ * Rotation from ECEF to ENU at a place, the matrix ECEF2ENU() uses
+ *
+ * @param lon   longitude
+ * @param lat   latitude
+ */
+mat3 ENU_matrix(double lon, double lat)
+{
+  mat3 T;
+  double slon = sin(lon);
+  double clon = cos(lon);
+  double slat = sin(lat);
+  double clat = cos(lat);
+  
+  T.m.x1 =   -slon;    T.m.y1 =    clon;    T.m.z1 =   0;
+  T.m.x2 = -slat*clon; T.m.y2 = -slat*slon; T.m.z2 = clat;
+  T.m.x3 =  clat*clon; T.m.y3 =  clat*slon; T.m.z3 = slat;
+
+  return T;
+}
+
 double altitude(vec ecef)
 {
 	return norm(ecef) - RADIUS_EARTH;
@@ -119,3 +135,384 @@ double vertical_acceleration_gee(vec a)
 	double acc = a.v.i;
 	return acc / g_0;
 }
+
+/**
+ * Column versions
+ *
+ * The same as the functions above over n points at once, from the columns
+ * of a state_columns (or any arrays). Results come out in an array of n.
+ */
+
+/**
+ * altitude() of every point
+ */
+void altitude_columns(const double *x, const double *y, const double *z, long n, double *alt)
+{
+	long i;
+	for (i=0;i<n;i++)
+		alt[i] = sqrt(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]) - RADIUS_EARTH;
+}
+
+/**
+ * vertical_velocity() of every point, velocity along the radius
+ */
+void vertical_velocity_columns(const double *x, const double *y, const double *z,
+	const double *vx, const double *vy, const double *vz, long n, double *v_vel)
+{
+	long i;
+	for (i=0;i<n;i++)
+	{
+		double r = sqrt(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+		if (r == 0)
+			r = 1;     // 0, like unit_vec()
+		v_vel[i] = (x[i]/r)*vx[i] + (y[i]/r)*vy[i] + (z[i]/r)*vz[i];
+	}
+}
+
+/**
+ * vertical_acceleration_gee() of every point
+ */
+void vertical_acceleration_gee_columns(const double *ax, long n, double *gee)
+{
+	long i;
+	for (i=0;i<n;i++)
+		gee[i] = ax[i] / g_0;
+}
+
+/**
+ * Distance along the surface from the point below origin to the point below
+ * each position, on the sphere of RADIUS_EARTH
+ */
+void downrange_columns(const double *x, const double *y, const double *z, long n, vec origin,
+	double *range)
+{
+	vec o = unit_vec(origin);
+	long i;
+	for (i=0;i<n;i++)
+	{
+		double cx = o.v.j*z[i] - o.v.k*y[i];
+		double cy = o.v.k*x[i] - o.v.i*z[i];
+		double cz = o.v.i*y[i] - o.v.j*x[i];
+		double d = o.v.i*x[i] + o.v.j*y[i] + o.v.k*z[i];
+		range[i] = RADIUS_EARTH * atan2(sqrt(cx*cx + cy*cy + cz*cz), d);
+	}
+}
+
+/**
+ * Copy up to COORD_BLOCK points from row i on into a block, zeros after the
+ * end. Returns how many there were.
+ */
+static int block_load(const double *a, const double *b, const double *c, long i, long n,
+	double *ba, double *bb, double *bc)
+{
+	int j, m = (n - i < COORD_BLOCK) ? (int) (n - i) : COORD_BLOCK;
+	for (j=0;j<m;j++)
+	{
+		ba[j] = a[i+j];
+		bb[j] = b[i+j];
+		bc[j] = c[i+j];
+	}
+	for (;j<COORD_BLOCK;j++)
+		ba[j] = bb[j] = bc[j] = 0;
+	return m;
+}
+
+static void block_store(const double *ba, const double *bb, const double *bc, long i, int m,
+	double *a, double *b, double *c)
+{
+	int j;
+	for (j=0;j<m;j++)
+	{
+		a[i+j] = ba[j];
+		b[i+j] = bb[j];
+		c[i+j] = bc[j];
+	}
+}
+
+/**
+ * ECEF2GEO() of every point
+ *
+ * The angles come from trig_atan2(), colatitude as atan2 of the distance
+ * from the axis and z rather than acos(z/r): they are within 5e-16 rad of
+ * exact, where ECEF2GEO()'s colatitude can be 1e-14 off near the poles. The
+ * altitude is the same.
+ */
+void ECEF2GEO_columns(const double *x, const double *y, const double *z, long n,
+	double *lon, double *lat, double *alt)
+{
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	double blon[COORD_BLOCK], blat[COORD_BLOCK], balt[COORD_BLOCK];
+	long i;
+	int j, m;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(x, y, z, i, n, bx, by, bz);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			double rho2 = bx[j]*bx[j] + by[j]*by[j];
+			double l = trig_atan2(by[j], bx[j]);
+			blon[j] = ((bx[j] != 0.0) & (by[j] != 0.0)) ? l : 0;
+			blat[j] = trig_atan2(sqrt(rho2), bz[j]);
+			balt[j] = sqrt(rho2 + bz[j]*bz[j]) - RADIUS_EARTH;
+		}
+		block_store(blon, blat, balt, i, m, lon, lat, alt);
+	}
+}
+
+/**
+ * GEO2ECEF() of every point, with trig_sincos(): within a few 1e-16 of it
+ * relative
+ */
+void GEO2ECEF_columns(const double *lon, const double *lat, const double *alt, long n,
+	double *x, double *y, double *z)
+{
+	double blon[COORD_BLOCK], blat[COORD_BLOCK], balt[COORD_BLOCK];
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	long i;
+	int j, m;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(lon, lat, alt, i, n, blon, blat, balt);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			double si, ci, sj, cj;
+			double r = balt[j] + RADIUS_EARTH;
+			trig_sincos(blon[j], &si, &ci);
+			trig_sincos(blat[j], &sj, &cj);
+			bx[j] = r * ci * sj;
+			by[j] = r * si * sj;
+			bz[j] = r * cj;
+		}
+		block_store(bx, by, bz, i, m, x, y, z);
+	}
+}
+
+/**
+ * ECEF points to ENU about a reference point
+ *
+ * Every point less origin is rotated by T, from ENU_matrix() at the
+ * reference. With origin zero this is ECEF2ENU() of every vector, to the
+ * bit; with the ECEF position of e.g. a ground station, the ENU position of
+ * every point as seen from it.
+ */
+void ECEF2ENU_columns(const mat3 *T, vec origin, const double *x, const double *y,
+	const double *z, long n, double *e, double *north, double *u)
+{
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	double be[COORD_BLOCK], bn[COORD_BLOCK], bu[COORD_BLOCK];
+	mat3 R = *T;
+	long i;
+	int j, m;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(x, y, z, i, n, bx, by, bz);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			double dx = bx[j] - origin.v.i, dy = by[j] - origin.v.j, dz = bz[j] - origin.v.k;
+			be[j] = R.m.x1*dx + R.m.y1*dy + R.m.z1*dz;
+			bn[j] = R.m.x2*dx + R.m.y2*dy + R.m.z2*dz;
+			bu[j] = R.m.x3*dx + R.m.y3*dy + R.m.z3*dz;
+		}
+		block_store(be, bn, bu, i, m, e, north, u);
+	}
+}
+
+/**
+ * ENU points about a reference point back to ECEF, the inverse of
+ * ECEF2ENU_columns(): rotated by the transpose of T, then origin added
+ */
+void ENU2ECEF_columns(const mat3 *T, vec origin, const double *e, const double *north,
+	const double *u, long n, double *x, double *y, double *z)
+{
+	double be[COORD_BLOCK], bn[COORD_BLOCK], bu[COORD_BLOCK];
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	mat3 R = *T;
+	long i;
+	int j, m;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(e, north, u, i, n, be, bn, bu);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			bx[j] = (R.m.x1*be[j] + R.m.x2*bn[j] + R.m.x3*bu[j]) + origin.v.i;
+			by[j] = (R.m.y1*be[j] + R.m.y2*bn[j] + R.m.y3*bu[j]) + origin.v.j;
+			bz[j] = (R.m.z1*be[j] + R.m.z2*bn[j] + R.m.z3*bu[j]) + origin.v.k;
+		}
+		block_store(bx, by, bz, i, m, x, y, z);
+	}
+}
+
+/**
+ * Geodetic coordinates
+ *
+ * Longitude, geodetic latitude (of the surface normal, not the colatitude
+ * ECEF2GEO() gives) and height above the surface of an earth_shape. On
+ * earth_sphere latitude is geocentric and height is altitude().
+ *
+ * ECEF to geodetic is Vermeille's closed form (J Geodesy 76, 2002): a cube
+ * root and a few square roots, no iteration and no branches. It holds
+ * everywhere but within about e2 a (43 km for WGS-84) of the centre.
+ */
+
+/**
+ * Vermeille's k for a point, and D, its distance from the axis scaled onto
+ * the normal: tan(lat) = z / D and h = (k + e2 - 1) / k * sqrt(D^2 + z^2)
+ */
+static double vermeille(const earth_shape *e, vec ecef, double *D)
+{
+	double e4 = e->e2 * e->e2;
+	double rho2 = ecef.v.i*ecef.v.i + ecef.v.j*ecef.v.j;
+	double p = rho2 / (e->a * e->a);
+	double q = (1 - e->e2) * ecef.v.k*ecef.v.k / (e->a * e->a);
+	double r = (p + q - e4) / 6;
+	double s = e4 * p * q / (4 * r*r*r);
+	double t = cbrt(1 + s + sqrt(s * (2 + s)));
+	double u = r * (1 + t + 1/t);
+	double v = sqrt(u*u + e4 * q);
+	double w = e->e2 * (u + v - q) / (2 * v);
+	double k = sqrt(u + v + w*w) - w;
+
+	*D = k * sqrt(rho2) / (k + e->e2);
+	return k;
+}
+
+/**
+ * @brief Height above the surface
+ *
+ * On a sphere it is altitude(), bit for bit, with e->a for RADIUS_EARTH.
+ */
+double earth_altitude(const earth_shape *e, vec ecef)
+{
+	double D, k;
+
+	if (e->e2 == 0)
+		return norm(ecef) - e->a;
+
+	k = vermeille(e, ecef, &D);
+	return (k + e->e2 - 1) / k * sqrt(D*D + ecef.v.k*ecef.v.k);
+}
+
+/**
+ * @brief Local vertical, the unit normal to the surface under a point
+ */
+vec earth_up(const earth_shape *e, vec ecef)
+{
+	double D, k;
+
+	if (e->e2 == 0)
+		return unit_vec(ecef);
+
+	// The normal is (x D / rho, y D / rho, z), and D / rho = k / (k + e2)
+	k = vermeille(e, ecef, &D);
+	return unit_vec((vec) {{ecef.v.i * k / (k + e->e2), ecef.v.j * k / (k + e->e2), ecef.v.k}});
+}
+
+/**
+ * @brief ECEF to (longitude, latitude, height)
+ */
+vec ECEF2geodetic(const earth_shape *e, vec ecef)
+{
+	double D, k = vermeille(e, ecef, &D);
+	vec geo;
+
+	geo.v.i = atan2(ecef.v.j, ecef.v.i);
+	geo.v.j = atan2(ecef.v.k, D);
+	geo.v.k = (k + e->e2 - 1) / k * sqrt(D*D + ecef.v.k*ecef.v.k);
+	return geo;
+}
+
+/**
+ * @brief (longitude, latitude, height) to ECEF
+ */
+vec geodetic2ECEF(const earth_shape *e, vec geo)
+{
+	double slat = sin(geo.v.j), clat = cos(geo.v.j);
+	double N = e->a / sqrt(1 - e->e2 * slat*slat);   // radius of curvature in the prime vertical
+	vec ecef;
+
+	ecef.v.i = (N + geo.v.k) * clat * cos(geo.v.i);
+	ecef.v.j = (N + geo.v.k) * clat * sin(geo.v.i);
+	ecef.v.k = (N * (1 - e->e2) + geo.v.k) * slat;
+	return ecef;
+}
+
+/**
+ * ECEF2geodetic() of every point
+ *
+ * Bowring's method with two fixed iterations instead, with the sines and
+ * cosines of the latitudes taken from the ratios they come from, so that
+ * the only trig is trig_atan2() for the answers and the loop vectorizes.
+ * From 10 km below the surface to beyond geostationary orbit it agrees with
+ * ECEF2geodetic() to 1e-14 rad and 1e-8 m.
+ */
+void ECEF2geodetic_columns(const earth_shape *e, const double *x, const double *y,
+	const double *z, long n, double *lon, double *lat, double *h)
+{
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	double blon[COORD_BLOCK], blat[COORD_BLOCK], bh[COORD_BLOCK];
+	double a = e->a, e2 = e->e2, b = e->a * (1 - e->f);
+	double ep2b = e2 / (1 - e2) * b, e2a = e2 * a;
+	long i;
+	int j, m, it;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(x, y, z, i, n, bx, by, bz);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			double rho = sqrt(bx[j]*bx[j] + by[j]*by[j]);
+			double Y = bz[j], X = rho, sl, cl, d;
+
+			// Parametric latitude from tan(beta) = (1 - f) tan(lat), then
+			// the latitude from it
+			for (it=0;it<2;it++)
+			{
+				double u = (1 - e->f) * Y, v = X;
+				double dd = sqrt(u*u + v*v);
+				double sb = u / dd, cb = v / dd;
+				Y = bz[j] + ep2b * sb*sb*sb;
+				X = rho - e2a * cb*cb*cb;
+			}
+
+			d = sqrt(X*X + Y*Y);
+			sl = Y / d;
+			cl = X / d;
+			blon[j] = trig_atan2(by[j], bx[j]);
+			blat[j] = trig_atan2(Y, X);
+			bh[j] = rho * cl + bz[j] * sl - a * sqrt(1 - e2 * sl*sl);
+		}
+		block_store(blon, blat, bh, i, m, lon, lat, h);
+	}
+}
+
+/**
+ * geodetic2ECEF() of every point, with trig_sincos()
+ */
+void geodetic2ECEF_columns(const earth_shape *e, const double *lon, const double *lat,
+	const double *h, long n, double *x, double *y, double *z)
+{
+	double blon[COORD_BLOCK], blat[COORD_BLOCK], bh[COORD_BLOCK];
+	double bx[COORD_BLOCK], by[COORD_BLOCK], bz[COORD_BLOCK];
+	long i;
+	int j, m;
+
+	for (i=0;i<n;i+=COORD_BLOCK)
+	{
+		m = block_load(lon, lat, h, i, n, blon, blat, bh);
+		for (j=0;j<COORD_BLOCK;j++)
+		{
+			double slon, clon, slat, clat, N;
+			trig_sincos(blon[j], &slon, &clon);
+			trig_sincos(blat[j], &slat, &clat);
+			N = e->a / sqrt(1 - e->e2 * slat*slat);
+			bx[j] = (N + bh[j]) * clat * clon;
+			by[j] = (N + bh[j]) * clat * slon;
+			bz[j] = (N * (1 - e->e2) + bh[j]) * slat;
+		}
+		block_store(bx, by, bz, i, m, x, y, z);
+	}
+}
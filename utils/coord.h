@@ -1,7 +1,49 @@
+/**
+ * @brief Shape of the Earth
+ *
+ * The surface altitudes and latitudes are measured from: an ellipsoid of
+ * revolution about z, or a sphere when f is 0. Picked per run with
+ * sim_context.earth, like the integrator.
+ */
+struct earth_shape {
+	const char *name;
+	double a;          ///< equatorial radius, m
+	double f;          ///< flattening, 0 for a sphere
+	double e2;         ///< eccentricity squared, f (2 - f)
+};
+
+extern const earth_shape earth_sphere;   ///< radius RADIUS_EARTH, what altitude() uses
+extern const earth_shape earth_wgs84;
+
 vec ECEF2GEO(vec v);
 vec GEO2ECEF(vec v);
 vec ECEF2ENU(vec v, double lon, double lat);
 vec ENU2ECEF(vec enu, double lon, double lat);
+mat3 ENU_matrix(double lon, double lat);
 double altitude(vec ecef);
 double vertical_velocity(state r);
 double vertical_acceleration_gee(vec a);
+
+void altitude_columns(const double *x, const double *y, const double *z, long n, double *alt);
+void vertical_velocity_columns(const double *x, const double *y, const double *z,
+	const double *vx, const double *vy, const double *vz, long n, double *v_vel);
+void vertical_acceleration_gee_columns(const double *ax, long n, double *gee);
+void downrange_columns(const double *x, const double *y, const double *z, long n, vec origin,
+	double *range);
+void ECEF2GEO_columns(const double *x, const double *y, const double *z, long n,
+	double *lon, double *lat, double *alt);
+void GEO2ECEF_columns(const double *lon, const double *lat, const double *alt, long n,
+	double *x, double *y, double *z);
+void ECEF2ENU_columns(const mat3 *T, vec origin, const double *x, const double *y,
+	const double *z, long n, double *e, double *north, double *u);
+void ENU2ECEF_columns(const mat3 *T, vec origin, const double *e, const double *north,
+	const double *u, long n, double *x, double *y, double *z);
+
+double earth_altitude(const earth_shape *e, vec ecef);
+vec earth_up(const earth_shape *e, vec ecef);
+vec ECEF2geodetic(const earth_shape *e, vec ecef);
+vec geodetic2ECEF(const earth_shape *e, vec geo);
+void ECEF2geodetic_columns(const earth_shape *e, const double *x, const double *y,
+	const double *z, long n, double *lon, double *lat, double *h);
+void geodetic2ECEF_columns(const earth_shape *e, const double *lon, const double *lat,
+	const double *h, long n, double *x, double *y, double *z);
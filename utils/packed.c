@@ -0,0 +1,541 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Compressed state histories
+ *
+ * @section DESCRIPTION
+ *
+ * Every every-th state is a keyframe, all its values as raw doubles. The
+ * states between are stored as the difference from a prediction made out of
+ * the states before them, as the decoder sees them:
+ *
+ *   t, a, m, q, omega   extrapolated from the last two states
+ *   v                   last v + h (last a + this a) / 2
+ *   x                   last x + h (last v + this v) / 2
+ *
+ * which is why a, then v, then x are stored. Along a trajectory the
+ * prediction is off by little more than the tolerance, so most differences
+ * are a single byte.
+ *
+ * A part with a tolerance is quantized: the difference is rounded to a
+ * multiple of the tolerance and written as a zigzag varint, plus one so that
+ * 0 can mean "raw double follows" for values that don't fit (non-finite, or
+ * too far off the prediction). The error stays within half the tolerance
+ * and does not build up, since predictions are made from decoded values. A
+ * part with no tolerance is exact: the bits of the value XOR the bits of the
+ * prediction, as a byte count and that many low bytes.
+ *
+ * Without attitude (3-DOF) a state has 11 values, q and omega are not
+ * stored at all.
+ *
+ * A state is found through the keyframe index, by number or by time, then
+ * decoded from its keyframe, so reading one costs at most every states.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "../libsim_types.h"
+#include "sink.h"
+#include "packed.h"
+
+/**
+ * Field numbers
+ */
+enum {P_T = 0, P_X = 1, P_V = 4, P_A = 7, P_M = 10, P_Q = 11, P_W = 15};
+
+/**
+ * Order the fields are stored in, the attitude ones are last
+ */
+static const int order[PACK_FIELDS] = {
+	P_T, P_A, P_A+1, P_A+2, P_M, P_V, P_V+1, P_V+2, P_X, P_X+1, P_X+2,
+	P_Q, P_Q+1, P_Q+2, P_Q+3, P_W, P_W+1, P_W+2
+};
+#define PACK_FIELDS_3DOF 11
+
+/**
+ * Most bytes one state can take: a varint or XOR code and a raw double
+ */
+#define PACK_MAX_BYTES (PACK_FIELDS * 10)
+
+/**
+ * Differences this many quanta or more go raw
+ */
+#define PACK_LIMIT 4503599627370496.0   // 2^52
+
+/**
+ * A state without attitude is stored level with ECEF
+ */
+static const state_attitude level = { {{ .w = 1 }}, {{0, 0, 0}} };
+
+static void to_attitude_fields(const state_attitude *a, double *f)
+{
+	int i;
+	for (i=0;i<3;i++)
+		f[P_W+i] = a->omega.component[i];
+	for (i=0;i<4;i++)
+		f[P_Q+i] = a->q.component[i];
+}
+
+static void to_fields(double t, const state *s, const state_attitude *a, double *f)
+{
+	int i;
+	f[P_T] = t;
+	for (i=0;i<3;i++)
+	{
+		f[P_X+i] = s->x.component[i];
+		f[P_V+i] = s->v.component[i];
+		f[P_A+i] = s->a.component[i];
+	}
+	f[P_M] = s->m;
+	to_attitude_fields(a ? a : &level, f);
+}
+
+static void from_fields(const double *f, double *t, state *s, state_attitude *a)
+{
+	int i;
+	*t = f[P_T];
+	for (i=0;i<3;i++)
+	{
+		s->x.component[i] = f[P_X+i];
+		s->v.component[i] = f[P_V+i];
+		s->a.component[i] = f[P_A+i];
+	}
+	s->m = f[P_M];
+	if (a == NULL)
+		return;
+	for (i=0;i<3;i++)
+		a->omega.component[i] = f[P_W+i];
+	for (i=0;i<4;i++)
+		a->q.component[i] = f[P_Q+i];
+}
+
+/**
+ * Prediction of field i from the last two decoded states (p1 only if
+ * have > 1) and the fields of this one decoded so far
+ */
+static double predict(int i, const double *p0, const double *p1, int have, const double *cur)
+{
+	double h, h1;
+
+	if (i == P_T)
+		return (have > 1) ? p0[P_T] + (p0[P_T] - p1[P_T]) : p0[P_T];
+
+	h = cur[P_T] - p0[P_T];
+	if (i < P_A)
+		return p0[i] + 0.5*h*(p0[i+3] + cur[i+3]);
+
+	if (have < 2)
+		return p0[i];
+	h1 = p0[P_T] - p1[P_T];
+	if (h1 != 0)
+		return p0[i] + (p0[i] - p1[i])*(h/h1);
+	return p0[i];
+}
+
+static unsigned char *put_varint(unsigned char *b, uint64_t u)
+{
+	while (u >= 0x80)
+	{
+		*b++ = (unsigned char) (u | 0x80);
+		u >>= 7;
+	}
+	*b++ = (unsigned char) u;
+	return b;
+}
+
+static const unsigned char *get_varint(const unsigned char *b, uint64_t *u)
+{
+	int shift = 0;
+	*u = 0;
+	while (*b & 0x80)
+	{
+		*u |= (uint64_t) (*b++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*u |= (uint64_t) *b++ << shift;
+	return b;
+}
+
+static uint64_t bits_of(double d)
+{
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	return u;
+}
+
+/**
+ * Writes value given its prediction, returns the end of what was written
+ * and the value as it will decode in *out
+ */
+static unsigned char *put_field(unsigned char *b, double value, double pred, double step,
+	double *out)
+{
+	int n;
+
+	if (step > 0)
+	{
+		double r = (value - pred) / step;
+		if (fabs(r) < PACK_LIMIT)        // false for NaN too
+		{
+			int64_t k = (int64_t) llround(r);
+			uint64_t zz = ((uint64_t) k << 1) ^ (uint64_t) -(k < 0);
+			*out = pred + (double) k * step;
+			return put_varint(b, zz + 1);
+		}
+		*b++ = 0;
+		memcpy(b, &value, sizeof(value));
+		*out = value;
+		return b + sizeof(value);
+	}
+
+	// Exact
+	uint64_t x = bits_of(value) ^ bits_of(pred);
+	for (n=0;n<8 && x>>(8*n);n++)
+		;
+	*b++ = (unsigned char) n;
+	for (;n>0;n--, x>>=8)
+		*b++ = (unsigned char) x;
+	*out = value;
+	return b;
+}
+
+static const unsigned char *get_field(const unsigned char *b, double pred, double step,
+	double *out)
+{
+	if (step > 0)
+	{
+		uint64_t zz;
+		b = get_varint(b, &zz);
+		if (zz == 0)
+		{
+			memcpy(out, b, sizeof(*out));
+			return b + sizeof(*out);
+		}
+		zz--;
+		int64_t k = (int64_t) (zz >> 1) ^ -(int64_t) (zz & 1);
+		*out = pred + (double) k * step;
+		return b;
+	}
+
+	int i, n = *b++;
+	uint64_t x = 0;
+	for (i=0;i<n;i++)
+		x |= (uint64_t) *b++ << (8*i);
+	x ^= bits_of(pred);
+	memcpy(out, &x, sizeof(*out));
+	return b;
+}
+
+/**
+ * Decodes one state at b into f, given the last two and how many of them
+ * there are (0 at a keyframe)
+ */
+static const unsigned char *decode(const packed_history *p, const unsigned char *b,
+	double last[2][PACK_FIELDS], int have, double *f)
+{
+	int i, n = p->attitude ? PACK_FIELDS : PACK_FIELDS_3DOF;
+
+	if (have == 0)
+	{
+		memcpy(f, b, sizeof(double) * n);
+		b += sizeof(double) * n;
+		if (!p->attitude)
+			to_attitude_fields(&level, f);
+	}
+	else
+	{
+		for (i=0;i<n;i++)
+			b = get_field(b, predict(order[i], last[0], last[1], have, f), p->step[order[i]], &f[order[i]]);
+		for (;i<PACK_FIELDS;i++)
+			f[order[i]] = last[0][order[i]];
+	}
+
+	// A keyframe starts the history over, last[0] is not a state yet
+	if (have)
+		memcpy(last[1], last[0], sizeof(last[0]));
+	memcpy(last[0], f, sizeof(last[0]));
+	return b;
+}
+
+/**
+ * @brief Start an empty history
+ *
+ * @param tol Error allowed, NULL for 1 us, 1 mm, 0.1 mm/s, 1 mm/s^2, 0.1 g,
+ *            1e-7 and 1 urad/s
+ * @param every States per keyframe, 0 for PACK_EVERY
+ * @param attitude Store q and omega for every state; otherwise they must be
+ *                 level (or not given) and are not stored
+ */
+void packed_history_init(packed_history *p, const pack_tolerance *tol, int every, int attitude)
+{
+	static const pack_tolerance def = {1e-6, 1e-3, 1e-4, 1e-3, 1e-4, 1e-7, 1e-6};
+	int i;
+
+	if (tol == NULL)
+		tol = &def;
+
+	memset(p, 0, sizeof(*p));
+	p->every = (every > 0) ? every : PACK_EVERY;
+	p->attitude = attitude;
+	to_attitude_fields(&level, p->last[0]);
+
+	p->step[P_T] = tol->t;
+	for (i=0;i<3;i++)
+	{
+		p->step[P_X+i] = tol->x;
+		p->step[P_V+i] = tol->v;
+		p->step[P_A+i] = tol->a;
+		p->step[P_W+i] = tol->omega;
+	}
+	p->step[P_M] = tol->m;
+	for (i=0;i<4;i++)
+		p->step[P_Q+i] = tol->q;
+}
+
+/**
+ * @brief Add a state at the end
+ *
+ * @param a Its attitude, NULL for level with no rotation
+ *
+ * @returns 0, or -1 if out of memory or, without attitude, a is not level
+ */
+int packed_history_push(packed_history *p, double t, const state *s, const state_attitude *a)
+{
+	double f[PACK_FIELDS], out[PACK_FIELDS];
+	int i, n = p->attitude ? PACK_FIELDS : PACK_FIELDS_3DOF;
+	int have = (int) (p->length % p->every ? (p->length % p->every > 1 ? 2 : 1) : 0);
+	unsigned char *b;
+
+	to_fields(t, s, a, f);
+
+	if (!p->attitude)
+		for (i=P_Q;i<PACK_FIELDS;i++)
+			if (f[i] != p->last[0][i])
+				return -1;
+
+	if (p->size + PACK_MAX_BYTES > p->capacity)
+	{
+		size_t capacity = p->capacity ? 2*p->capacity : 64*PACK_MAX_BYTES;
+		unsigned char *data = realloc(p->data, capacity);
+		if (data == NULL)
+			return -1;
+		p->data = data;
+		p->capacity = capacity;
+	}
+	b = p->data + p->size;
+
+	if (have == 0)
+	{
+		if (p->key_count % 64 == 0)
+		{
+			pack_key *keys = realloc(p->keys, sizeof(pack_key) * (p->key_count + 64));
+			if (keys == NULL)
+				return -1;
+			p->keys = keys;
+		}
+		p->keys[p->key_count].offset = p->size;
+		p->keys[p->key_count].t = t;
+		p->key_count++;
+
+		memcpy(b, f, sizeof(double) * n);
+		memcpy(out, f, sizeof(f));
+		b += sizeof(double) * n;
+	}
+	else
+	{
+		for (i=0;i<n;i++)
+			b = put_field(b, f[order[i]], predict(order[i], p->last[0], p->last[1], have, out),
+				p->step[order[i]], &out[order[i]]);
+		for (;i<PACK_FIELDS;i++)
+			out[order[i]] = p->last[0][order[i]];
+	}
+
+	memcpy(p->last[1], p->last[0], sizeof(p->last[0]));
+	memcpy(p->last[0], out, sizeof(out));
+	p->size = (size_t) (b - p->data);
+	p->length++;
+	return 0;
+}
+
+/**
+ * @brief Pack a whole history
+ *
+ * Attitude is stored if the history has it.
+ *
+ * @returns 0, or -1 if out of memory
+ */
+int packed_history_pack(packed_history *p, const state_history *h, const pack_tolerance *tol,
+	int every)
+{
+	int i;
+
+	packed_history_init(p, tol, every, h->attitude != NULL);
+	for (i=0;i<h->length;i++)
+	{
+		if (packed_history_push(p, h->times[i], &h->states[i],
+				h->attitude ? &h->attitude[i] : NULL) != 0)
+		{
+			packed_history_free(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief State number i
+ *
+ * @param a Its attitude, may be NULL
+ *
+ * @returns 0, or -1 if there is no such state
+ */
+int packed_history_get(const packed_history *p, long i, double *t, state *s, state_attitude *a)
+{
+	double last[2][PACK_FIELDS], f[PACK_FIELDS];
+	const unsigned char *b;
+	long j, first;
+
+	if (i < 0 || i >= p->length)
+		return -1;
+
+	first = i - i % p->every;
+	b = p->data + p->keys[i / p->every].offset;
+	for (j=first;j<=i;j++)
+		b = decode(p, b, last, (int) (j - first > 1 ? 2 : j - first), f);
+
+	from_fields(f, t, s, a);
+	return 0;
+}
+
+/**
+ * @brief The last state at or before time t
+ *
+ * @param ti Its time
+ * @param a Its attitude, may be NULL
+ *
+ * @returns its number, or -1 if t is before the first state
+ */
+long packed_history_at(const packed_history *p, double t, double *ti, state *s, state_attitude *a)
+{
+	double last[2][PACK_FIELDS], f[PACK_FIELDS], next[PACK_FIELDS];
+	const unsigned char *b;
+	long lo = 0, hi = p->key_count, j, first, end;
+
+	if (p->length == 0 || t < p->keys[0].t)
+		return -1;
+
+	// Last keyframe at or before t
+	while (hi - lo > 1)
+	{
+		long mid = (lo + hi) / 2;
+		if (p->keys[mid].t <= t)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	first = lo * p->every;
+	end = first + p->every < p->length ? first + p->every : p->length;
+	b = p->data + p->keys[lo].offset;
+	b = decode(p, b, last, 0, f);
+	for (j=first+1;j<end;j++)
+	{
+		b = decode(p, b, last, (int) (j - first > 1 ? 2 : 1), next);
+		if (next[P_T] > t)
+			break;
+		memcpy(f, next, sizeof(f));
+	}
+
+	from_fields(f, ti, s, a);
+	return j - 1;
+}
+
+/**
+ * @brief Decode everything into a new state_history
+ *
+ * The history has attitude if it was stored. It is released with
+ * state_history_free().
+ *
+ * @returns 0, or -1 if out of memory
+ */
+int packed_history_unpack(const packed_history *p, state_history *h)
+{
+	double last[2][PACK_FIELDS], f[PACK_FIELDS];
+	const unsigned char *b = p->data;
+	long i;
+
+	h->length = 0;
+	h->owned = 1;
+	h->times = malloc(sizeof(double) * (p->length ? p->length : 1));
+	h->states = malloc(sizeof(state) * (p->length ? p->length : 1));
+	h->attitude = NULL;
+	if (p->attitude)
+		h->attitude = malloc(sizeof(state_attitude) * (p->length ? p->length : 1));
+	if (h->times == NULL || h->states == NULL || (p->attitude && h->attitude == NULL))
+	{
+		free(h->times);
+		free(h->states);
+		free(h->attitude);
+		h->times = NULL;
+		h->states = NULL;
+		h->attitude = NULL;
+		return -1;
+	}
+
+	for (i=0;i<p->length;i++)
+	{
+		long k = i % p->every;
+		b = decode(p, b, last, (int) (k > 1 ? 2 : k), f);
+		from_fields(f, &h->times[i], &h->states[i], h->attitude ? &h->attitude[i] : NULL);
+	}
+	h->length = (int) p->length;
+	return 0;
+}
+
+void packed_history_free(packed_history *p)
+{
+	free(p->data);
+	free(p->keys);
+	p->data = NULL;
+	p->keys = NULL;
+	p->size = p->capacity = 0;
+	p->key_count = p->length = 0;
+}
+
+/**
+ * Sink
+ */
+static int packed_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	int i;
+	for (i=0;i<count;i++)
+		if (packed_history_push(sink->user, times[i], &states[i], attitude ? &attitude[i] : NULL) != 0)
+			return -1;
+	return 0;
+}
+
+/**
+ * @brief Pack states as they come into a history started with
+ * packed_history_init()
+ */
+void sink_packed(trajectory_sink *sink, packed_history *p)
+{
+	sink_init(sink, packed_write, NULL, p);
+}
@@ -0,0 +1,69 @@
+/**
+ * Compressed state histories, see packed.c. Needs stdio.h and sink.h.
+ */
+
+/**
+ * Values per stored state: time, x, v, a, m, q, omega
+ */
+#define PACK_FIELDS 18
+
+/**
+ * Keyframe spacing used when 0 is asked for
+ */
+#define PACK_EVERY 128
+
+/**
+ * @brief Largest error allowed in each part of a state
+ *
+ * Absolute, in the units of the state (s, m, m/s, m/s^2, kg, rad/s); the
+ * quaternion bound is per component. 0 stores that part exactly.
+ */
+typedef struct {
+	double t;
+	double x;
+	double v;
+	double a;
+	double m;
+	double q;
+	double omega;
+} pack_tolerance;
+
+/**
+ * One keyframe: where it starts in data and its time
+ */
+typedef struct {
+	size_t offset;
+	double t;
+} pack_key;
+
+/**
+ * @brief A state history stored as keyframes and predicted residuals
+ *
+ * data is a byte stream in the host's byte order. States are added with
+ * packed_history_push() (or all at once with packed_history_pack()) and
+ * read back one at a time, or all together with packed_history_unpack().
+ */
+typedef struct {
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+	pack_key *keys;              ///< one per keyframe, in time order
+	long key_count;
+	long length;                 ///< states stored
+	int every;                   ///< a keyframe every this many states
+	int attitude;                ///< quaternion and body rates change and are stored
+	double step[PACK_FIELDS];    ///< quantum of each field, 0 for exact
+	double last[2][PACK_FIELDS]; ///< the last two states as they decode
+} packed_history;
+
+void packed_history_init(packed_history *p, const pack_tolerance *tol, int every, int attitude);
+int packed_history_push(packed_history *p, double t, const state *s, const state_attitude *a);
+int packed_history_pack(packed_history *p, const state_history *h, const pack_tolerance *tol,
+	int every);
+int packed_history_get(const packed_history *p, long i, double *t, state *s, state_attitude *a);
+long packed_history_at(const packed_history *p, double t, double *ti, state *s,
+	state_attitude *a);
+int packed_history_unpack(const packed_history *p, state_history *h);
+void packed_history_free(packed_history *p);
+
+void sink_packed(trajectory_sink *sink, packed_history *p);
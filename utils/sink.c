@@ -0,0 +1,345 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Trajectory sinks
+ *
+ * @section DESCRIPTION
+ *
+ * The integrator does not know where its output goes. It pushes every
+ * accepted state into a trajectory_sink which collects them in a fixed size
+ * chunk and hands full chunks to a writer. Memory used by the integration is
+ * then constant however long the flight is; only a writer that chooses to keep
+ * everything (sink_memory()) grows.
+ *
+ * Writers provided here:
+ *  - sink_memory()   growable state_history, malloc'd or in an arena
+ *  - sink_file()     text, one state per line
+ *  - sink_summary()  apogee, max speed and final state only
+ *  - sink_decimate() every n-th state on to another sink
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../libsim_types.h"
+#include "../math/vector.h"
+#include "coord.h"
+#include "arena.h"
+#include "sink.h"
+
+/**
+ * @brief Set up an empty sink
+ *
+ * @param sink The sink
+ * @param write Called with each chunk
+ * @param close Called after the last chunk, may be NULL
+ * @param user Stored in sink->user for the writer
+ */
+void sink_init(trajectory_sink *sink, sink_write write, sink_close close, void *user)
+{
+	sink->write = write;
+	sink->close = close;
+	sink->user = user;
+	sink->has_attitude = 0;
+	sink->count = 0;
+	sink->total = 0;
+	sink->error = 0;
+}
+
+/**
+ * @brief Add one state, writing out the chunk if it is full
+ *
+ * @param a Attitude of a 6-DOF state, NULL for 3-DOF. Either every state of
+ *          a flight has one or none does.
+ *
+ * @returns 0, or the error from the writer
+ */
+int sink_push(trajectory_sink *sink, double t, state s, const state_attitude *a)
+{
+	sink->times[sink->count] = t;
+	sink->states[sink->count] = s;
+	sink->has_attitude = (a != NULL);
+	if (a)
+		sink->attitude[sink->count] = *a;
+	sink->count++;
+	sink->total++;
+
+	if (sink->count == SINK_CHUNK)
+		return sink_flush(sink);
+	return sink->error;
+}
+
+/**
+ * @brief Hand whatever is buffered to the writer
+ */
+int sink_flush(trajectory_sink *sink)
+{
+	if (sink->count > 0 && sink->error == 0)
+		sink->error = sink->write(sink, sink->times, sink->states,
+			sink->has_attitude ? sink->attitude : NULL, sink->count);
+	sink->count = 0;
+	return sink->error;
+}
+
+/**
+ * @brief Flush and close, call once at the end of the trajectory
+ */
+int sink_finish(trajectory_sink *sink)
+{
+	sink_flush(sink);
+	if (sink->close)
+		sink->close(sink);
+	return sink->error;
+}
+
+/**
+ * Memory
+ */
+static int memory_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	memory_sink *mem = sink->user;
+	state_history *h = &mem->history;
+	int i;
+
+	if (h->length + count > mem->capacity)
+	{
+		int capacity = mem->capacity ? mem->capacity : SINK_CHUNK;
+		while (capacity < h->length + count)
+			capacity *= 2;
+
+		if (mem->pool)
+		{
+			// Move to bigger arrays, the old ones go back with the arena
+			double *t = arena_alloc(mem->pool, sizeof(double) * capacity);
+			state *s = arena_alloc(mem->pool, sizeof(state) * capacity);
+			state_attitude *a = NULL;
+			if (attitude)
+				a = arena_alloc(mem->pool, sizeof(state_attitude) * capacity);
+			if (t == NULL || s == NULL || (attitude && a == NULL))
+				return -1;
+			for (i=0;i<h->length;i++)
+			{
+				t[i] = h->times[i];
+				s[i] = h->states[i];
+				if (a)
+					a[i] = h->attitude[i];
+			}
+			h->times = t;
+			h->states = s;
+			h->attitude = a;
+		}
+		else
+		{
+			double *t = realloc(h->times, sizeof(double) * capacity);
+			if (t == NULL)
+				return -1;
+			h->times = t;
+			state *s = realloc(h->states, sizeof(state) * capacity);
+			if (s == NULL)
+				return -1;
+			h->states = s;
+			if (attitude)
+			{
+				state_attitude *a = realloc(h->attitude, sizeof(state_attitude) * capacity);
+				if (a == NULL)
+					return -1;
+				h->attitude = a;
+			}
+		}
+		mem->capacity = capacity;
+	}
+
+	for (i=0;i<count;i++)
+	{
+		h->times[h->length + i] = times[i];
+		h->states[h->length + i] = states[i];
+		if (attitude)
+			h->attitude[h->length + i] = attitude[i];
+	}
+	h->length += count;
+
+	return 0;
+}
+
+/**
+ * @brief Keep everything in a state_history that grows as needed
+ *
+ * The history is released with state_history_free().
+ */
+void sink_memory(trajectory_sink *sink, memory_sink *mem)
+{
+	sink_memory_arena(sink, mem, NULL);
+}
+
+/**
+ * @brief Keep everything in a state_history allocated from an arena
+ *
+ * Nothing is malloc'd. The history lives until the arena is reset; if the
+ * arena fills up the sink reports an error and the history stops there.
+ */
+void sink_memory_arena(trajectory_sink *sink, memory_sink *mem, arena *pool)
+{
+	mem->history.times = NULL;
+	mem->history.states = NULL;
+	mem->history.attitude = NULL;
+	mem->history.length = 0;
+	mem->history.owned = (pool == NULL);
+	mem->capacity = 0;
+	mem->pool = pool;
+	sink_init(sink, memory_write, NULL, mem);
+}
+
+/**
+ * File
+ */
+static int file_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	FILE *f = sink->user;
+	int i;
+
+	(void) attitude;
+
+	for (i=0;i<count;i++)
+	{
+		const state *s = &states[i];
+		if (fprintf(f, "%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+				times[i],
+				s->x.v.i, s->x.v.j, s->x.v.k,
+				s->v.v.i, s->v.v.j, s->v.v.k,
+				s->a.v.i, s->a.v.j, s->a.v.k,
+				s->m) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Write states to an open file as text, one per line:
+ * t, x, y, z, vx, vy, vz, ax, ay, az, m
+ *
+ * Doubles are printed with enough digits to read back exactly. The file is
+ * not closed.
+ */
+void sink_file(trajectory_sink *sink, FILE *f)
+{
+	sink_init(sink, file_write, NULL, f);
+}
+
+/**
+ * Summary
+ */
+static int summary_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	trajectory_summary *sum = sink->user;
+	int i;
+
+	(void) attitude;
+
+	for (i=0;i<count;i++)
+	{
+		double alt = earth_altitude(sum->earth, states[i].x);
+		double speed = norm(states[i].v);
+		if (alt > sum->apogee)
+		{
+			sum->apogee = alt;
+			sum->apogee_time = times[i];
+		}
+		if (speed > sum->max_speed)
+			sum->max_speed = speed;
+	}
+
+	sum->count += count;
+	sum->last_time = times[count-1];
+	sum->last = states[count-1];
+
+	return 0;
+}
+
+/**
+ * @brief Keep only a running summary of the trajectory
+ */
+void sink_summary(trajectory_sink *sink, trajectory_summary *summary)
+{
+	summary->count = 0;
+	summary->earth = &earth_sphere;
+	summary->apogee = -HUGE_VAL;
+	summary->apogee_time = 0;
+	summary->max_speed = 0;
+	summary->last_time = 0;
+	sink_init(sink, summary_write, NULL, summary);
+}
+
+/**
+ * Decimation
+ */
+static int decimate_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	decimator *d = sink->user;
+	int i;
+
+	for (i=0;i<count;i++)
+	{
+		if (d->seen % d->every == 0)
+		{
+			if (sink_push(d->next, times[i], states[i], attitude ? &attitude[i] : NULL) != 0)
+				return d->next->error;
+			d->unsent = 0;
+		}
+		else
+		{
+			d->unsent = 1;
+			d->last_time = times[i];
+			d->last = states[i];
+			d->last_has_attitude = (attitude != NULL);
+			if (attitude)
+				d->last_attitude = attitude[i];
+		}
+		d->seen++;
+	}
+
+	return 0;
+}
+
+static void decimate_close(trajectory_sink *sink)
+{
+	decimator *d = sink->user;
+
+	// Always end on the real last state
+	if (d->unsent)
+		sink_push(d->next, d->last_time, d->last, d->last_has_attitude ? &d->last_attitude : NULL);
+	if (sink_finish(d->next) != 0 && sink->error == 0)
+		sink->error = d->next->error;
+}
+
+/**
+ * @brief Forward the first and every n-th state after it, plus the last
+ *
+ * Finishing this sink also finishes next.
+ */
+void sink_decimate(trajectory_sink *sink, decimator *d, int every, trajectory_sink *next)
+{
+	d->next = next;
+	d->every = (every > 0) ? every : 1;
+	d->seen = 0;
+	d->unsent = 0;
+	d->last_has_attitude = 0;
+	sink_init(sink, decimate_write, decimate_close, d);
+}
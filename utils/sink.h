@@ -0,0 +1,84 @@
+/**
+ * Number of states a sink buffers before handing them on
+ */
+#define SINK_CHUNK 256
+
+/**
+ * Called with every full chunk (and the partial last one). attitude is NULL
+ * unless the states came with one (6-DOF). Returns 0 on success, anything
+ * else stops the integration.
+ */
+typedef int (*sink_write)(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count);
+
+/**
+ * Called once after the last chunk, may be NULL
+ */
+typedef void (*sink_close)(trajectory_sink *sink);
+
+/**
+ * @brief Destination for accepted integrator steps
+ *
+ * The integrator pushes one state at a time; they are collected here and
+ * handed to write() SINK_CHUNK at a time.
+ */
+struct trajectory_sink {
+	sink_write write;
+	sink_close close;
+	void *user;                   ///< whatever the writer needs
+
+	double times[SINK_CHUNK];
+	state states[SINK_CHUNK];
+	state_attitude attitude[SINK_CHUNK];
+	int has_attitude;             ///< the states in the chunk came with an attitude
+	int count;                    ///< states waiting in the chunk
+	long total;                   ///< states pushed so far
+	int error;                    ///< first non-zero write() result
+};
+
+/**
+ * Growable in-memory storage
+ */
+typedef struct {
+	state_history history;
+	int capacity;
+	arena *pool;                  ///< grow here instead of with realloc, may be NULL
+} memory_sink;
+
+/**
+ * Running summary of a trajectory, nothing else is kept
+ */
+typedef struct {
+	long count;
+	const earth_shape *earth;     ///< altitudes are above this, earth_sphere unless set
+	double apogee;                ///< maximum altitude, m
+	double apogee_time;
+	double max_speed;             ///< m/s
+	double last_time;
+	state last;
+} trajectory_summary;
+
+/**
+ * Forwards every n-th state (and always the last one) to another sink
+ */
+typedef struct {
+	trajectory_sink *next;
+	int every;
+	long seen;
+	int unsent;                   ///< last state seen was not forwarded
+	double last_time;
+	state last;
+	state_attitude last_attitude;
+	int last_has_attitude;
+} decimator;
+
+void sink_init(trajectory_sink *sink, sink_write write, sink_close close, void *user);
+int sink_push(trajectory_sink *sink, double t, state s, const state_attitude *a);
+int sink_flush(trajectory_sink *sink);
+int sink_finish(trajectory_sink *sink);
+
+void sink_memory(trajectory_sink *sink, memory_sink *mem);
+void sink_memory_arena(trajectory_sink *sink, memory_sink *mem, arena *pool);
+void sink_file(trajectory_sink *sink, FILE *f);
+void sink_summary(trajectory_sink *sink, trajectory_summary *summary);
+void sink_decimate(trajectory_sink *sink, decimator *d, int every, trajectory_sink *next);
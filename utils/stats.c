@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Integrator statistics
+ *
+ * @section DESCRIPTION
+ *
+ * Counters kept in sim_context.stats while a flight runs, for finding out
+ * where the time went: rejected steps, a collapsing step size, an expensive
+ * physics model. Everything that updates them is inside STATS(), so a build
+ * without LIBSIM_STATS pays nothing.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "../libsim_types.h"
+#include "stats.h"
+
+/**
+ * @brief Zero the counters, done at the start of every run
+ */
+void stats_reset(sim_stats *s)
+{
+	int i;
+
+	s->accepted = 0;
+	s->rejected = 0;
+	s->coasts = 0;
+	s->derivs = 0;
+	s->h_min = HUGE_VAL;
+	s->h_max = 0;
+	s->h_sum = 0;
+	for (i=0;i<STATS_BINS;i++)
+		s->h_hist[i] = 0;
+	s->t_gravity = 0;
+	s->t_drag = 0;
+	s->t_thrust = 0;
+	s->wall = 0;
+}
+
+/**
+ * @brief Count one accepted step
+ *
+ * @param s The counters
+ * @param h The step taken
+ * @param rejected Attempts thrown away before this one
+ */
+void stats_step(sim_stats *s, double h, long rejected)
+{
+	int e, bin;
+
+	s->accepted++;
+	s->rejected += rejected;
+	if (h < s->h_min)
+		s->h_min = h;
+	if (h > s->h_max)
+		s->h_max = h;
+	s->h_sum += h;
+
+	// h = m 2^e with 0.5 <= m < 1
+	frexp(h, &e);
+	bin = e - 1 - STATS_LOW_EXP;
+	if (bin < 0)
+		bin = 0;
+	if (bin >= STATS_BINS)
+		bin = STATS_BINS - 1;
+	s->h_hist[bin]++;
+}
+
+/**
+ * @brief Add the counters of one run to a running total
+ */
+void stats_merge(sim_stats *into, const sim_stats *from)
+{
+	int i;
+
+	into->accepted += from->accepted;
+	into->rejected += from->rejected;
+	into->coasts += from->coasts;
+	into->derivs += from->derivs;
+	if (from->h_min < into->h_min)
+		into->h_min = from->h_min;
+	if (from->h_max > into->h_max)
+		into->h_max = from->h_max;
+	into->h_sum += from->h_sum;
+	for (i=0;i<STATS_BINS;i++)
+		into->h_hist[i] += from->h_hist[i];
+	into->t_gravity += from->t_gravity;
+	into->t_drag += from->t_drag;
+	into->t_thrust += from->t_thrust;
+	into->wall += from->wall;
+}
+
+/**
+ * @brief Monotonic clock, seconds
+ */
+double stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,14 @@
+/**
+ * Wrap statistics code in STATS(...). It is only compiled in when LIBSIM_STATS
+ * is defined; otherwise the integrator runs exactly as without it.
+ */
+#ifdef LIBSIM_STATS
+#define STATS(x) x
+#else
+#define STATS(x)
+#endif
+
+void stats_reset(sim_stats *s);
+void stats_step(sim_stats *s, double h, long rejected);
+void stats_merge(sim_stats *into, const sim_stats *from);
+double stats_now(void);
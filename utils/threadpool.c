@@ -0,0 +1,375 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Work-stealing thread pool
+ *
+ * @section DESCRIPTION
+ *
+ * Every worker owns a double ended queue of tasks. A worker pushes and pops
+ * work at the bottom of its own queue and, when that runs dry, steals from the
+ * top of somebody else's. Trajectories take wildly different amounts of time
+ * so this keeps every core busy until the very last task, where a static split
+ * would leave cores idle waiting on the longest flights.
+ *
+ * Tasks submitted from inside a running task go to the submitting worker's own
+ * queue, so a task can fork more work (e.g. fragments) without a round trip
+ * through a central queue.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "threadpool.h"
+
+/// Initial capacity of a worker's queue, grows as needed
+#define DEQUE_INIT 64
+
+typedef struct {
+	task_func fn;
+	void *arg;
+} task;
+
+typedef struct {
+	pthread_mutex_t lock;
+	task *tasks;        // circular buffer
+	int capacity;
+	int top;            // steal end
+	int count;
+} deque;
+
+typedef struct {
+	threadpool *pool;
+	int id;
+	unsigned int seed;  // victim selection
+	pthread_t thread;
+} worker;
+
+struct threadpool {
+	int nthreads;
+	worker *workers;
+	deque *queues;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;   // signaled when a task is queued
+	pthread_cond_t done_cond;   // signaled when pending reaches zero
+	int queued;                 // tasks sitting in a queue
+	int pending;                // tasks submitted and not yet finished
+	int next;                   // round robin for outside submissions
+	int shutdown;
+};
+
+// Which worker (if any) the current thread is
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+static void make_worker_key(void)
+{
+	pthread_key_create(&worker_key, NULL);
+}
+
+/**
+ * Deque
+ */
+static int deque_init(deque *d)
+{
+	d->tasks = malloc(sizeof(task) * DEQUE_INIT);
+	if (d->tasks == NULL)
+		return -1;
+	d->capacity = DEQUE_INIT;
+	d->top = 0;
+	d->count = 0;
+	pthread_mutex_init(&d->lock, NULL);
+	return 0;
+}
+
+static int deque_push_bottom(deque *d, task t)
+{
+	pthread_mutex_lock(&d->lock);
+	if (d->count == d->capacity)
+	{
+		int i;
+		task *grown = malloc(sizeof(task) * d->capacity * 2);
+		if (grown == NULL)
+		{
+			pthread_mutex_unlock(&d->lock);
+			return -1;
+		}
+		for (i=0;i<d->count;i++)
+			grown[i] = d->tasks[(d->top + i) % d->capacity];
+		free(d->tasks);
+		d->tasks = grown;
+		d->top = 0;
+		d->capacity *= 2;
+	}
+	d->tasks[(d->top + d->count) % d->capacity] = t;
+	d->count++;
+	pthread_mutex_unlock(&d->lock);
+	return 0;
+}
+
+static int deque_pop_bottom(deque *d, task *t)
+{
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->count > 0)
+	{
+		d->count--;
+		*t = d->tasks[(d->top + d->count) % d->capacity];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static int deque_steal_top(deque *d, task *t)
+{
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->count > 0)
+	{
+		*t = d->tasks[d->top];
+		d->top = (d->top + 1) % d->capacity;
+		d->count--;
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+/**
+ * Find something to do: own queue first, then steal
+ */
+static int take_task(worker *w, task *t)
+{
+	threadpool *pool = w->pool;
+	int i;
+
+	if (deque_pop_bottom(&pool->queues[w->id], t))
+		return 1;
+
+	// Start at a random victim so thieves don't all pile onto worker 0
+	int start = rand_r(&w->seed) % pool->nthreads;
+	for (i=0;i<pool->nthreads;i++)
+	{
+		int victim = (start + i) % pool->nthreads;
+		if (victim == w->id)
+			continue;
+		if (deque_steal_top(&pool->queues[victim], t))
+			return 1;
+	}
+	return 0;
+}
+
+static void *worker_main(void *arg)
+{
+	worker *w = arg;
+	threadpool *pool = w->pool;
+	task t;
+
+	pthread_setspecific(worker_key, w);
+
+	for (;;)
+	{
+		if (take_task(w, &t))
+		{
+			pthread_mutex_lock(&pool->lock);
+			pool->queued--;
+			pthread_mutex_unlock(&pool->lock);
+
+			t.fn(t.arg);
+
+			pthread_mutex_lock(&pool->lock);
+			pool->pending--;
+			if (pool->pending == 0)
+				pthread_cond_broadcast(&pool->done_cond);
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+
+		// Nothing to take, sleep until something is queued
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queued <= 0 && !pool->shutdown)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->shutdown && pool->queued <= 0)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Stops the first started workers, which must have nothing left to do, and
+ * frees the pool; only the first queues deques were initialized
+ */
+static void pool_free(threadpool *pool, int started, int queues)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i=0;i<started;i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	for (i=0;i<queues;i++)
+	{
+		pthread_mutex_destroy(&pool->queues[i].lock);
+		free(pool->queues[i].tasks);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	free(pool->queues);
+	free(pool->workers);
+	free(pool);
+}
+
+/**
+ * @brief Start a pool of worker threads
+ *
+ * @param nthreads Number of workers, <= 0 picks one per online core
+ *
+ * @returns The pool, or NULL if it could not be started
+ */
+threadpool *threadpool_create(int nthreads)
+{
+	int i;
+	threadpool *pool;
+
+	pthread_once(&worker_key_once, make_worker_key);
+
+	if (nthreads <= 0)
+		nthreads = threadpool_default_threads();
+
+	pool = calloc(1, sizeof(threadpool));
+	if (pool == NULL)
+		return NULL;
+	pool->nthreads = nthreads;
+	pool->workers = calloc(nthreads, sizeof(worker));
+	pool->queues = calloc(nthreads, sizeof(deque));
+	if (pool->workers == NULL || pool->queues == NULL)
+	{
+		free(pool->workers);
+		free(pool->queues);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (i=0;i<nthreads;i++)
+	{
+		if (deque_init(&pool->queues[i]) != 0)
+		{
+			pool_free(pool, 0, i);
+			return NULL;
+		}
+	}
+
+	for (i=0;i<nthreads;i++)
+	{
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		pool->workers[i].seed = 2166136261u ^ (unsigned int) i;
+		if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0)
+		{
+			pool_free(pool, i, nthreads);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * @brief Queue a task
+ *
+ * Called from a worker of this pool the task lands on that worker's own queue,
+ * otherwise tasks are dealt out round robin.
+ *
+ * @returns 0 on success, -1 if the task could not be queued
+ */
+int threadpool_submit(threadpool *pool, task_func fn, void *arg)
+{
+	task t = {fn, arg};
+	worker *self = pthread_getspecific(worker_key);
+	int target;
+
+	pthread_mutex_lock(&pool->lock);
+	if (self != NULL && self->pool == pool)
+		target = self->id;
+	else
+		target = pool->next++ % pool->nthreads;
+
+	if (deque_push_bottom(&pool->queues[target], t) != 0)
+	{
+		pthread_mutex_unlock(&pool->lock);
+		return -1;
+	}
+	pool->queued++;
+	pool->pending++;
+	pthread_cond_signal(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * @brief Block until every submitted task (and anything they submitted) is done
+ *
+ * Must not be called from inside a task.
+ */
+void threadpool_wait(threadpool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Finish outstanding work, stop the workers and free the pool
+ */
+void threadpool_destroy(threadpool *pool)
+{
+	threadpool_wait(pool);
+	pool_free(pool, pool->nthreads, pool->nthreads);
+}
+
+int threadpool_size(const threadpool *pool)
+{
+	return pool->nthreads;
+}
+
+/**
+ * Number of online cores, at least one
+ */
+int threadpool_default_threads(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores < 1)
+		return 1;
+	return (int) cores;
+}
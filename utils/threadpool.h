@@ -0,0 +1,16 @@
+/**
+ * A task run by the thread pool
+ */
+typedef void (*task_func)(void *arg);
+
+/**
+ * Opaque work-stealing thread pool, see threadpool.c
+ */
+typedef struct threadpool threadpool;
+
+threadpool *threadpool_create(int nthreads);
+int threadpool_submit(threadpool *pool, task_func fn, void *arg);
+void threadpool_wait(threadpool *pool);
+void threadpool_destroy(threadpool *pool);
+int threadpool_size(const threadpool *pool);
+int threadpool_default_threads(void);
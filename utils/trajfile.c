@@ -0,0 +1,332 @@
+/**
+ * @file
+ * @author  Nathan Bergey <nathan.bergey@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Binary trajectory files
+ *
+ * @section DESCRIPTION
+ *
+ * Layout, in the writer's byte order (checked through byte_order):
+ *
+ *   traj_header
+ *   block 0: traj_block_header, then rows doubles of column 0, rows of
+ *            column 1, ... rows of column columns - 1
+ *   block 1: ...
+ *
+ * Columns are time, position, velocity, acceleration (ECEF, SI) and mass,
+ * and for 6-DOF runs the attitude quaternion and body rates; the header
+ * names each with its unit. Values are stored exactly, as doubles.
+ *
+ * The writer is a trajectory_sink: every chunk the integrator hands over is
+ * turned into columns and written as one block, so it streams a flight of
+ * any length in constant memory. If the file can seek, the row and block
+ * counts in the header are filled in when the sink finishes.
+ *
+ * The reader maps the file and walks the block headers once to index them.
+ * Columns are then read in place: traj_column() is a pointer into the
+ * mapping.
+ *
+ * Version 1. A reader must reject any other version; new versions may add
+ * fields at the end of the header, header_size says where the blocks begin.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../libsim_types.h"
+#include "../math/runge-kutta.h"
+#include "sink.h"
+#include "trajfile.h"
+
+// The header must keep the doubles after it aligned
+typedef char traj_header_is_aligned[(sizeof(traj_header) % 8 == 0) ? 1 : -1];
+
+static const traj_column_info columns[TRAJ_COLUMNS_MAX] = {
+	{ "t",  "s" },
+	{ "x",  "m" },      { "y",  "m" },      { "z",  "m" },
+	{ "vx", "m/s" },    { "vy", "m/s" },    { "vz", "m/s" },
+	{ "ax", "m/s^2" },  { "ay", "m/s^2" },  { "az", "m/s^2" },
+	{ "m",  "kg" },
+	{ "qw", "1" },      { "qx", "1" },      { "qy", "1" },      { "qz", "1" },
+	{ "wx", "rad/s" },  { "wy", "rad/s" },  { "wz", "rad/s" },
+};
+
+/**
+ * Writer
+ */
+static int trajfile_write(trajectory_sink *sink, const double *times, const state *states,
+	const state_attitude *attitude, int count)
+{
+	static const state_attitude level = { {{ .w = 1 }}, {{0, 0, 0}} };
+	traj_writer *w = sink->user;
+	traj_block_header block = { TRAJ_BLOCK_MAGIC, count };
+	int i, c, n = w->header.columns;
+
+	for (i=0;i<count;i++)
+	{
+		const state *s = &states[i];
+		w->buffer[TRAJ_T][i] = times[i];
+		for (c=0;c<3;c++)
+		{
+			w->buffer[TRAJ_X+c][i] = s->x.component[c];
+			w->buffer[TRAJ_VX+c][i] = s->v.component[c];
+			w->buffer[TRAJ_AX+c][i] = s->a.component[c];
+		}
+		w->buffer[TRAJ_M][i] = s->m;
+		if (n == TRAJ_COLUMNS_6DOF)
+		{
+			const state_attitude *a = attitude ? &attitude[i] : &level;
+			for (c=0;c<4;c++)
+				w->buffer[TRAJ_QW+c][i] = a->q.component[c];
+			for (c=0;c<3;c++)
+				w->buffer[TRAJ_WX+c][i] = a->omega.component[c];
+		}
+	}
+
+	if (fwrite(&block, sizeof(block), 1, w->f) != 1)
+		return -1;
+	for (c=0;c<n;c++)
+		if (fwrite(w->buffer[c], sizeof(double), count, w->f) != (size_t) count)
+			return -1;
+
+	w->header.rows += count;
+	w->header.blocks++;
+	return 0;
+}
+
+static void trajfile_close(trajectory_sink *sink)
+{
+	traj_writer *w = sink->user;
+	long end = ftell(w->f);
+
+	// Fill in the counts if we can get back to the header, a pipe cannot
+	if (end < 0 || fseek(w->f, w->start, SEEK_SET) != 0)
+		return;
+	if (fwrite(&w->header, sizeof(w->header), 1, w->f) != 1 && sink->error == 0)
+		sink->error = -1;
+	fseek(w->f, end, SEEK_SET);
+	if (fflush(w->f) != 0 && sink->error == 0)
+		sink->error = -1;
+}
+
+/**
+ * @brief Write states to an open file in the binary format
+ *
+ * The header is written straight away, with the run's tolerance, duration
+ * and integrator from ctx; 6-DOF contexts get the attitude columns. The
+ * file is not closed.
+ *
+ * @param label Stored in the header, cut to 63 characters, may be NULL
+ *
+ * @returns 0, or -1 if the header could not be written
+ */
+int sink_trajfile(trajectory_sink *sink, traj_writer *w, FILE *f, const sim_context *ctx,
+	const char *label)
+{
+	traj_header *h = &w->header;
+
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, TRAJ_MAGIC, sizeof(h->magic));
+	h->version = TRAJ_VERSION;
+	h->byte_order = TRAJ_BYTE_ORDER;
+	h->header_size = sizeof(traj_header);
+	h->columns = ctx->rigid_body ? TRAJ_COLUMNS_6DOF : TRAJ_COLUMNS_3DOF;
+	h->eps = ctx->eps;
+	h->duration = ctx->duration;
+	if (ctx->integrator)
+		strncpy(h->integrator, ctx->integrator->name, sizeof(h->integrator) - 1);
+	if (label)
+		strncpy(h->label, label, sizeof(h->label) - 1);
+	memcpy(h->info, columns, sizeof(columns));
+
+	w->f = f;
+	w->start = ftell(f);
+	sink_init(sink, trajfile_write, trajfile_close, w);
+
+	if (fwrite(h, sizeof(*h), 1, f) != 1)
+		return -1;
+	return 0;
+}
+
+/**
+ * Reader
+ */
+static int traj_index(traj_file *file)
+{
+	const traj_header *h = file->header;
+	size_t pos = h->header_size;
+	long n = 0, cap = 16;
+
+	file->block = malloc(sizeof(*file->block) * cap);
+	file->first_row = malloc(sizeof(long) * (cap + 1));
+	if (file->block == NULL || file->first_row == NULL)
+		return -1;
+
+	file->rows = 0;
+	while (pos < file->size)
+	{
+		const traj_block_header *b = (const traj_block_header *) (file->base + pos);
+		size_t bytes;
+
+		if (file->size - pos < sizeof(*b) || b->magic != TRAJ_BLOCK_MAGIC)
+			return -1;
+		bytes = sizeof(*b) + sizeof(double) * (size_t) h->columns * b->rows;
+		if (file->size - pos < bytes)
+			return -1;
+
+		if (n == cap)
+		{
+			cap *= 2;
+			const traj_block_header **block = realloc(file->block, sizeof(*block) * cap);
+			if (block == NULL)
+				return -1;
+			file->block = block;
+			long *first = realloc(file->first_row, sizeof(long) * (cap + 1));
+			if (first == NULL)
+				return -1;
+			file->first_row = first;
+		}
+		file->block[n] = b;
+		file->first_row[n] = file->rows;
+		file->rows += b->rows;
+		n++;
+		pos += bytes;
+	}
+	file->first_row[n] = file->rows;
+	file->blocks = n;
+
+	// A header that was filled in must agree
+	if (h->blocks != 0 && (h->blocks != (uint64_t) n || h->rows != (uint64_t) file->rows))
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief Map a trajectory file for reading
+ *
+ * @returns 0, or -1 if it cannot be read or is not a version 1 trajectory
+ * file in this machine's byte order
+ */
+int traj_open(traj_file *file, const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(file, 0, sizeof(*file));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(traj_header))
+	{
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	file->map = map;
+	file->base = map;
+	file->size = st.st_size;
+	file->header = map;
+
+	const traj_header *h = file->header;
+	if (memcmp(h->magic, TRAJ_MAGIC, sizeof(h->magic)) != 0 || h->version != TRAJ_VERSION
+		|| h->byte_order != TRAJ_BYTE_ORDER || h->header_size < sizeof(traj_header)
+		|| h->header_size % 8 != 0 || h->header_size > file->size
+		|| (h->columns != TRAJ_COLUMNS_3DOF && h->columns != TRAJ_COLUMNS_6DOF)
+		|| traj_index(file) != 0)
+	{
+		traj_close(file);
+		return -1;
+	}
+
+	return 0;
+}
+
+void traj_close(traj_file *file)
+{
+	if (file->map)
+		munmap(file->map, file->size);
+	free(file->block);
+	free(file->first_row);
+	memset(file, 0, sizeof(*file));
+}
+
+/**
+ * @brief One column of one block, in place
+ *
+ * @param rows Set to the number of values
+ *
+ * @returns Pointer into the mapping, NULL if block or column is out of range
+ */
+const double *traj_column(const traj_file *file, long block, int column, long *rows)
+{
+	const traj_block_header *b;
+
+	if (block < 0 || block >= file->blocks || column < 0 || column >= (int) file->header->columns)
+		return NULL;
+	b = file->block[block];
+	*rows = b->rows;
+	return (const double *) (b + 1) + (size_t) column * b->rows;
+}
+
+/**
+ * Block holding row, and where in it, by bisection on the first rows
+ *
+ * @returns 0, or -1 if row is out of range
+ */
+int traj_find_row(const traj_file *file, long row, long *block, long *offset)
+{
+	long lo = 0, hi = file->blocks;
+
+	if (row < 0 || row >= file->rows)
+		return -1;
+	while (hi - lo > 1)
+	{
+		long mid = (lo + hi) / 2;
+		if (file->first_row[mid] <= row)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	*block = lo;
+	*offset = row - file->first_row[lo];
+	return 0;
+}
+
+/**
+ * One value, NAN if out of range
+ */
+double traj_value(const traj_file *file, long row, int column)
+{
+	long block, offset, rows;
+	const double *c;
+
+	if (traj_find_row(file, row, &block, &offset) != 0)
+		return NAN;
+	c = traj_column(file, block, column, &rows);
+	return c ? c[offset] : NAN;
+}
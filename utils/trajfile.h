@@ -0,0 +1,91 @@
+/**
+ * Binary trajectory files, see trajfile.c for the layout. Needs stdint.h,
+ * stdio.h and sink.h.
+ */
+#define TRAJ_MAGIC "LSIMTRAJ"
+#define TRAJ_VERSION 1
+#define TRAJ_BYTE_ORDER 0x01020304u
+#define TRAJ_BLOCK_MAGIC 0x314b4c42u   // "BLK1" read little endian
+
+/**
+ * Columns, in file order. 3-DOF files stop after TRAJ_M.
+ */
+enum {
+	TRAJ_T, TRAJ_X, TRAJ_Y, TRAJ_Z, TRAJ_VX, TRAJ_VY, TRAJ_VZ, TRAJ_AX, TRAJ_AY, TRAJ_AZ,
+	TRAJ_M, TRAJ_QW, TRAJ_QX, TRAJ_QY, TRAJ_QZ, TRAJ_WX, TRAJ_WY, TRAJ_WZ
+};
+#define TRAJ_COLUMNS_3DOF 11
+#define TRAJ_COLUMNS_6DOF 18
+#define TRAJ_COLUMNS_MAX TRAJ_COLUMNS_6DOF
+
+/**
+ * Name and unit of a column, NUL padded
+ */
+typedef struct {
+	char name[8];
+	char unit[8];
+} traj_column_info;
+
+/**
+ * @brief File header, as it is on disk
+ *
+ * Every field is naturally aligned and the size is a multiple of 8, so the
+ * doubles in the blocks after it are aligned in a mapped file.
+ */
+typedef struct {
+	char magic[8];               ///< TRAJ_MAGIC, no NUL
+	uint32_t version;            ///< TRAJ_VERSION
+	uint32_t byte_order;         ///< TRAJ_BYTE_ORDER in the writer's byte order
+	uint32_t header_size;        ///< bytes to the first block
+	uint32_t columns;            ///< TRAJ_COLUMNS_3DOF or TRAJ_COLUMNS_6DOF
+	uint64_t rows;               ///< states in the file, 0 if the writer could not seek back
+	uint64_t blocks;
+	double eps;                  ///< run metadata: tolerance,
+	double duration;             ///< requested length of the run, s,
+	char integrator[16];         ///< integrator name,
+	char label[64];              ///< and free text, e.g. a sample number
+	traj_column_info info[TRAJ_COLUMNS_MAX];
+} traj_header;
+
+/**
+ * Start of every block, followed by columns arrays of rows doubles
+ */
+typedef struct {
+	uint32_t magic;              ///< TRAJ_BLOCK_MAGIC
+	uint32_t rows;
+} traj_block_header;
+
+/**
+ * Writes one file through a trajectory_sink, a block per sink chunk
+ */
+typedef struct {
+	FILE *f;
+	long start;                  ///< offset of the header, to fill in rows at the end
+	traj_header header;
+	double buffer[TRAJ_COLUMNS_MAX][SINK_CHUNK];
+} traj_writer;
+
+/**
+ * @brief A mapped trajectory file
+ *
+ * Nothing is copied: the header and columns point straight into the mapping.
+ */
+typedef struct {
+	const traj_header *header;
+	void *map;                   ///< the mapping
+	const unsigned char *base;   ///< the same, for offsets
+	size_t size;
+	long blocks;
+	const traj_block_header **block;  ///< each block in the mapping
+	long *first_row;             ///< row number of each block's first row, blocks + 1 of them
+	long rows;
+} traj_file;
+
+int sink_trajfile(trajectory_sink *sink, traj_writer *w, FILE *f, const sim_context *ctx,
+	const char *label);
+
+int traj_open(traj_file *file, const char *path);
+void traj_close(traj_file *file);
+const double *traj_column(const traj_file *file, long block, int column, long *rows);
+int traj_find_row(const traj_file *file, long row, long *block, long *offset);
+double traj_value(const traj_file *file, long row, int column);